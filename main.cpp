@@ -2,6 +2,9 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <map>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "imgui.h"
@@ -21,15 +24,37 @@
 #include <AL/al.h>
 #include <AL/alext.h>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define HAVE_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
 extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/avstring.h>
 #include <libavutil/bprint.h>
 #include <libavutil/dict.h>
+#include <libavutil/file.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/parseutils.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/time.h>
+#include <libavutil/tx.h>
+#include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavformat/avformat.h>
@@ -37,6 +62,24 @@ extern "C" {
 }
 
 #define AL_BUFFERS 16
+#define MAX_AUDIO_CHANNELS 8
+#define SPECTRUM_SIZE 1024
+#define SPECTROGRAM_ROWS 256
+
+enum AudioView {
+    AUDIO_VIEW_WAVEFORM,
+    AUDIO_VIEW_SPECTRUM,
+    AUDIO_VIEW_SPECTROGRAM,
+};
+
+typedef struct AudioAnalysis {
+    int nb_channels;
+    float min, max;
+    float peak[MAX_AUDIO_CHANNELS];
+    float rms[MAX_AUDIO_CHANNELS];
+    bool have_spectrum;
+    float spectrum[SPECTRUM_SIZE / 2];
+} AudioAnalysis;
 
 typedef struct FrameInfo {
     int width, height;
@@ -75,6 +118,41 @@ typedef struct Edge2Pad {
     enum AVMediaType type;
 } Edge2Pad;
 
+#define RENDER_QUEUE_SIZE 16
+
+typedef struct RenderOutput {
+    char *label;
+    enum AVMediaType type;
+    bool enabled;
+    char file_name[1024];
+    char encoder_name[64];
+
+    AVFilterContext *ctx;
+    const AVCodec *codec;
+    AVCodecContext *enc;
+    AVFormatContext *mux;
+    AVStream *stream;
+    ring_buffer_t queue;
+    bool header_written;
+    bool eof;
+    bool encoder_done;
+    // written and read under render_mutex
+    int64_t frames;
+    double position;
+} RenderOutput;
+
+typedef struct GraphIndex {
+    std::vector<std::vector<unsigned>> node_links;
+    std::unordered_map<int, unsigned> edge2link;
+} GraphIndex;
+
+typedef struct ProfileCounter {
+    int64_t time;
+    int64_t calls;
+} ProfileCounter;
+
+typedef std::vector<std::pair<const AVFilterContext *, ProfileCounter>> ProfileCounters;
+
 typedef struct OptStorage {
     union {
         int i32;
@@ -87,6 +165,66 @@ typedef struct OptStorage {
     } u;
 } OptStorage;
 
+typedef struct OptionInfo {
+    const AVOption *opt;
+    double min;
+    double max;
+    bool alias;
+    int rows;
+    std::vector<const AVOption *> consts;
+} OptionInfo;
+
+#define SHM_EXPORT_SLOTS 4
+#define SHM_EXPORT_VERSION 2
+
+/* Layout of a sink export object: ShmExportHeader, then nb_slots data
+ * slots of slot_size bytes each starting at data_offset. Slot n % nb_slots
+ * holds frame n; its seq is odd while the slot is being written and even
+ * once complete. Objects are never resized: when a frame outgrows the
+ * slots, a new object is created, its name is written to next_name and
+ * next_generation becomes non-zero; readers then open next_name. */
+typedef struct ShmFrameHeader {
+    uint64_t seq;
+    int64_t pts;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int32_t media_type;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t sample_rate;
+    int32_t nb_channels;
+    int32_t nb_samples;
+    int32_t nb_planes;
+    int32_t linesize[8];
+    uint64_t offset[8];
+    uint64_t size;
+} ShmFrameHeader;
+
+typedef struct ShmExportHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_slots;
+    uint64_t map_size;
+    uint64_t data_offset;
+    uint64_t slot_size;
+    uint64_t write_index;
+    uint32_t next_generation;
+    char next_name[128];
+    ShmFrameHeader frames[SHM_EXPORT_SLOTS];
+} ShmExportHeader;
+
+typedef struct ShmExport {
+    int fd;
+    ShmExportHeader *header;
+    size_t map_size;
+} ShmExport;
+
+typedef struct CachedFrame {
+    AVFrame *frame;
+    int64_t last_used;
+} CachedFrame;
+
 typedef struct BufferSink {
     unsigned id;
     char *label;
@@ -97,7 +235,20 @@ typedef struct BufferSink {
     ring_buffer_t render_frames;
     ring_buffer_t purge_frames;
     unsigned render_ring_size;
+    int readahead_frames;
+    int readahead_mb;
+    int64_t consume_bytes;
+    int64_t render_bytes;
+    int64_t purge_bytes;
+    int64_t cache_bytes;
+    int64_t head_pts;
+    bool shm_export;
+    ShmExport *shm;
+    unsigned shm_generation;
     double speed;
+    int64_t frames_late;
+    int64_t frames_dropped;
+    int64_t drift;
     bool ready;
     bool fullscreen;
     bool muted;
@@ -105,11 +256,39 @@ typedef struct BufferSink {
     bool have_window_pos;
     ImVec2 window_pos;
     GLuint texture;
+    GLuint plane_textures[3];
+    GLuint framebuffer;
+    GLuint pixel_buffers[4];
+    unsigned pixel_buffer_index;
+    int plane_width;
+    int plane_height;
+    int plane_format;
+    int texture_width;
+    int texture_height;
+    int texture_format;
+    const AVFrame *uploaded_frame;
+    int64_t uploaded_pts;
+    int scope;
+    GLuint scope_accum;
+    GLuint scope_texture;
+    int scope_accum_height;
+    const AVFrame *scope_frame;
+    int64_t scope_pts;
+    int scope_mode;
+    const AVFrame *grid_frame;
+    int64_t grid_pts;
+    std::vector<CachedFrame> frame_cache;
+    int64_t frame_cache_bytes;
+    int64_t frame_cache_clock;
+    int cache_index;
     ALuint source;
     ALenum format;
     float gain;
     float position[3];
     ALuint buffers[AL_BUFFERS];
+    int queue_target;
+    int64_t queued_buffers;
+    int64_t underruns;
     std::vector<ALuint> processed_bufids;
     std::vector<ALuint> unprocessed_bufids;
 
@@ -125,6 +304,23 @@ typedef struct BufferSink {
 
     float *samples;
     unsigned nb_samples;
+
+    int audio_view;
+    int nb_channels;
+    float peak[MAX_AUDIO_CHANNELS];
+    float rms[MAX_AUDIO_CHANNELS];
+    float *spectrum;
+    bool new_spectrum;
+    GLuint spectrogram_texture;
+    unsigned spectrogram_row;
+    AVBufferPool *analysis_pool;
+    AVTXContext *tx;
+    av_tx_fn tx_fn;
+    float *tx_history;
+    float *tx_window;
+    AVComplexFloat *tx_in;
+    AVComplexFloat *tx_out;
+    unsigned tx_pos;
     unsigned sample_index;
 } BufferSink;
 
@@ -142,27 +338,51 @@ typedef struct FilterNode {
     AVFilterContext *probe;
     AVFilterContext *ctx;
 
+    int tap_pad;
+
     std::vector<int> inpad_edges;
     std::vector<int> outpad_edges;
 
     std::vector<OptStorage> opt_storage;
 } FilterNode;
 
+typedef struct TapPreview {
+    unsigned node;
+    AVFilterContext *ctx;
+    AVFrame *pending;
+    AVFrame *spare;
+    GLuint texture;
+    int width;
+    int height;
+    int64_t last_update;
+} TapPreview;
+
 static void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
+bool headless = false;
 bool full_screen = false;
 bool restart_display = false;
 int filter_graph_nb_threads = 0;
 int filter_graph_auto_convert_flags = 0;
+int sink_queue_size = 8;
+bool filter_graph_driver_mode = false;
+bool live_filter_commands = true;
+bool filter_graph_profiling = false;
+bool profiling_active = false;
+int hw_device_type = AV_HWDEVICE_TYPE_NONE;
+char hw_device_name[256] = { 0 };
+AVBufferRef *hw_device_ctx = NULL;
+bool graph_driver_active = false;
 unsigned focus_buffersink_window = -1;
 unsigned focus_abuffersink_window = -1;
 bool show_abuffersink_window = true;
 bool show_buffersink_window = true;
 bool show_dumpgraph_window = false;
 bool show_commands_window = false;
+bool show_profile_window = false;
 bool show_filtergraph_editor_window = true;
 bool show_mini_map = true;
 int mini_map_location = ImNodesMiniMapLocation_BottomRight;
@@ -170,29 +390,111 @@ int mini_map_location = ImNodesMiniMapLocation_BottomRight;
 char *import_script_file_name = NULL;
 
 bool need_filters_reinit = true;
+bool sink_threads_stop = false;
 bool framestep = false;
 bool paused = true;
+bool idle_when_paused = true;
+int idle_frames = 0;
 bool show_info = false;
 bool show_help = false;
 bool show_console = false;
 bool show_log_window = false;
 
 int log_level = AV_LOG_INFO;
-ImGuiTextBuffer log_buffer;
-ImVector<int> log_lines_offsets;
-std::mutex log_mutex;
+
+#define LOG_RING_SIZE 4096
+
+typedef struct LogEntry {
+    unsigned seq;
+    int level;
+    int64_t time;
+    char class_name[32];
+    char item_name[64];
+    char message[512];
+} LogEntry;
+
+static LogEntry log_ring[LOG_RING_SIZE];
+static unsigned log_write_index = 0;
+static unsigned log_clear_index = 0;
+static int64_t log_start_time = 0;
 
 GLint global_upscale_interpolation = GL_NEAREST;
 GLint global_downscale_interpolation = GL_NEAREST;
+bool gpu_color_conversion = true;
+int frame_cache_mb = 0;
+bool present_by_clock = true;
+bool clock_running = false;
+int64_t clock_offset = 0;
+GLuint yuv2rgb_program = 0;
+GLuint empty_vao = 0;
+
+enum ScopeType {
+    SCOPE_NONE,
+    SCOPE_HISTOGRAM,
+    SCOPE_WAVEFORM,
+    SCOPE_VECTORSCOPE,
+};
+
+#define SCOPE_SIZE 256
+#define SCOPE_MAX_POINTS (512 * 512)
+
+GLuint scope_program = 0;
+GLuint scope_display_program = 0;
+GLuint scope_framebuffer = 0;
+float scope_opacity = 0.8f;
+
+enum CompareMode {
+    COMPARE_SPLIT,
+    COMPARE_FLIP,
+    COMPARE_DIFFERENCE,
+    COMPARE_HEATMAP,
+};
+
+bool show_compare_window = false;
+int compare_sinks[2] = { 0, 1 };
+int compare_mode = COMPARE_SPLIT;
+float compare_split = 0.5f;
+float compare_gain = 4.f;
+int compare_flip_ms = 500;
+bool compare_flipped = false;
+int64_t compare_flip_time = 0;
+GLuint compare_program = 0;
+GLuint compare_stats_program = 0;
+GLuint compare_reduce_program = 0;
+GLuint compare_framebuffer = 0;
+GLuint compare_texture = 0;
+GLuint compare_stats_textures[2] = { 0 };
+int compare_width = 0;
+int compare_height = 0;
+int compare_stats_width = 0;
+int compare_stats_height = 0;
+int64_t compare_stats_pts[2] = { AV_NOPTS_VALUE, AV_NOPTS_VALUE };
+double compare_psnr = 0.;
+double compare_ssim = 0.;
+
+bool grid_presentation = false;
+int grid_max_size = 4096;
+GLuint grid_framebuffer = 0;
+GLuint grid_read_framebuffer = 0;
+GLuint grid_texture = 0;
+GLuint grid_pixel_buffer = 0;
+int grid_columns = 0;
+int grid_rows = 0;
+int grid_cell_width = 0;
+int grid_cell_height = 0;
 
 int output_sample_rate = 44100;
+bool resample_audio_outputs = false;
+bool al_multichannel_formats = false;
 int display_w;
 int display_h;
 int width = 1280;
 int height = 720;
 bool filter_graph_is_valid = false;
 AVFilterGraph *filter_graph = NULL;
+ProfileCounters *profile_counters = NULL;
 AVFilterGraph *probe_graph = NULL;
+std::unordered_map<const AVClass *, std::vector<OptionInfo>> option_info_cache;
 char *graphdump_text = NULL;
 float audio_sample_range[2] = { 1.f, 1.f };
 float audio_window_size[2] = { 0, 100 };
@@ -203,9 +505,25 @@ int editor_edge = 0;
 ImNodesEditorContext *node_editor_context;
 
 std::mutex filtergraph_mutex;
+std::mutex tap_mutex;
+std::vector<TapPreview> tap_previews;
+int tap_updates_per_second = 10;
+int tap_width = 160;
+double tap_budget = 0.;
+int64_t tap_budget_time = 0;
+
+std::thread graph_driver_thread;
+std::mutex graph_driver_mutex;
+std::condition_variable graph_driver_cv;
+bool graph_driver_ready = false;
+bool graph_driver_stop = false;
 
 std::vector<ALuint> play_sources;
 std::thread play_sound_thread;
+std::mutex playback_mutex;
+std::condition_variable playback_cv;
+bool playback_paused = true;
+bool playback_stop = false;
 
 std::vector<BufferSink> abuffer_sinks;
 std::vector<BufferSink> buffer_sinks;
@@ -218,10 +536,38 @@ std::vector<std::thread> video_sink_threads;
 std::vector<FilterNode> filter_nodes;
 std::vector<std::pair<int, int>> filter_links;
 std::vector<Edge2Pad> edge2pad;
+GraphIndex graph_index;
+
+std::vector<RenderOutput> render_outputs;
+std::vector<std::thread> render_threads;
+std::mutex render_mutex;
+std::condition_variable render_cv;
+AVFilterGraph *render_graph = NULL;
+bool show_render_window = false;
+bool render_running = false;
+bool render_stop = false;
+int render_active = 0;
+float render_duration = 0.f;
+int64_t render_start_time = 0;
+int64_t render_end_time = 0;
+
+#define AUTOTUNE_WINDOW 2000000
+
+std::thread autotune_thread;
+std::vector<int> autotune_threads;
+std::vector<double> autotune_scores;
+unsigned autotune_index = 0;
+bool autotune_running = false;
+bool autotune_finished = false;
 
 static const enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_RGBA, AV_PIX_FMT_NONE };
-static const enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_NONE };
-static const int sample_rates[] = { output_sample_rate, 0 };
+static const enum AVPixelFormat gpu_pix_fmts[] = { AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010,
+                                                   AV_PIX_FMT_YUV444P, AV_PIX_FMT_GBRP, AV_PIX_FMT_NONE };
+static const enum AVPixelFormat hw_pix_fmts[] = { AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010,
+                                                  AV_PIX_FMT_YUV444P, AV_PIX_FMT_GBRP, AV_PIX_FMT_VAAPI,
+                                                  AV_PIX_FMT_DRM_PRIME, AV_PIX_FMT_CUDA, AV_PIX_FMT_NONE };
+static const enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_NONE };
+static int sample_rates[] = { 0, 0 };
 
 ALCdevice *al_dev = NULL;
 ALCcontext *al_ctx = NULL;
@@ -230,2886 +576,7147 @@ float listener_position[3] = { 0, 0, 0 };
 
 FrameInfo frame_info;
 
-static void clear_ring_buffer(ring_buffer_t *ring_buffer)
-{
-    while (ring_buffer_num_items(ring_buffer) > 0) {
-        AVFrame *frame;
-
-        ring_buffer_dequeue(ring_buffer, &frame);
-        av_frame_free(&frame);
-    }
-}
+bool show_memory_window = false;
+int frame_memory_cap_mb = 0;
+int64_t frame_memory_total = 0;
+int64_t frame_memory_slowest_pts = AV_NOPTS_VALUE;
 
-static void sound_thread(ALsizei nb_sources, std::vector<ALuint> *sources)
+static size_t frame_bytes(const AVFrame *frame)
 {
-    bool state = paused && !framestep;
+    size_t size = 0;
 
-    if (state)
-        alSourceStopv(nb_sources, sources->data());
-
-    while (!need_filters_reinit && filter_graph_is_valid) {
-        bool new_state = paused && !framestep;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        if (frame->buf[i])
+            size += frame->buf[i]->size;
+    }
 
-        if (sources->size() == 0)
-            break;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
 
-        if (state != new_state) {
-            state = new_state;
-            if (state == true)
-                alSourcePausev(nb_sources, sources->data());
-            else
-                alSourcePlayv(nb_sources, sources->data());
-        }
-        av_usleep(10000);
-    }
+    return size;
 }
 
-static void worker_thread(BufferSink *sink, std::mutex *mutex, std::condition_variable *cv)
+static bool sink_wants_frame(BufferSink *sink)
 {
-    int ret;
-
-    while (sink->ctx) {
-        std::unique_lock lk(*mutex);
-        cv->wait(lk, [sink]{ return sink->ready == true; });
-        mutex->unlock();
-        if (need_filters_reinit)
-            break;
-        if (sink->ready == false)
-            continue;
-        sink->ready = false;
-
-        if (ring_buffer_num_items(&sink->consume_frames) < 1) {
-            AVFrame *filter_frame;
-            int64_t start, end;
-
-            filter_frame = av_frame_alloc();
-            if (!filter_frame)
-                break;
-            start = av_gettime_relative();
-            filtergraph_mutex.lock();
-            ret = av_buffersink_get_frame_flags(sink->ctx, filter_frame, 0);
-            filtergraph_mutex.unlock();
-            end = av_gettime_relative();
-            if (end > start && filter_frame)
-                sink->speed = 1000000. * (std::max(filter_frame->nb_samples, 1)) * av_q2d(av_inv_q(sink->frame_rate)) / (end - start);
-            if (ret < 0 && ret != AVERROR(EAGAIN)) {
-                av_frame_free(&filter_frame);
-                break;
-            }
+    const unsigned queued = ring_buffer_num_items(&sink->consume_frames);
+    const int64_t max_bytes = (int64_t)sink->readahead_mb << 20;
 
-            ring_buffer_enqueue(&sink->consume_frames, filter_frame);
-        }
+    if (queued == 0)
+        return true;
+    if (queued >= (unsigned)sink->readahead_frames)
+        return false;
+    if (max_bytes > 0 && __atomic_load_n(&sink->consume_bytes, __ATOMIC_RELAXED) >= max_bytes)
+        return false;
+    if (frame_memory_cap_mb > 0 &&
+        __atomic_load_n(&frame_memory_total, __ATOMIC_RELAXED) >= ((int64_t)frame_memory_cap_mb << 20)) {
+        const int64_t slowest = __atomic_load_n(&frame_memory_slowest_pts, __ATOMIC_RELAXED);
+        const int64_t head = __atomic_load_n(&sink->head_pts, __ATOMIC_RELAXED);
 
-        if (paused)
-            av_usleep(100000);
+        if (slowest == AV_NOPTS_VALUE || head == AV_NOPTS_VALUE || head > slowest)
+            return false;
     }
-
-    clear_ring_buffer(&sink->consume_frames);
-    clear_ring_buffer(&sink->render_frames);
-    clear_ring_buffer(&sink->purge_frames);
+    return true;
 }
 
-static void kill_audio_sink_threads()
+static int64_t unique_frame_bytes(const AVFrame *frame, std::vector<const AVBuffer *> &seen)
 {
-    for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
-        BufferSink *sink = &abuffer_sinks[i];
+    int64_t size = 0;
 
-        if (audio_sink_threads[i].joinable()) {
-            { std::lock_guard lk(amutexes[i]); sink->ready = true; }
-            acv[i].notify_one();
-            audio_sink_threads[i].join();
-        }
+    for (int i = 0; i < AV_NUM_DATA_POINTERS + frame->nb_extended_buf; i++) {
+        const AVBufferRef *buf = i < AV_NUM_DATA_POINTERS ? frame->buf[i] :
+                                 frame->extended_buf[i - AV_NUM_DATA_POINTERS];
 
-        av_freep(&sink->label);
-        av_freep(&sink->samples);
-        alDeleteSources(1, &sink->source);
-        alDeleteBuffers(AL_BUFFERS, sink->buffers);
+        if (!buf || std::find(seen.begin(), seen.end(), buf->buffer) != seen.end())
+            continue;
+        seen.push_back(buf->buffer);
+        size += buf->size;
     }
+
+    return size;
 }
 
-static void kill_video_sink_threads()
+static int64_t ring_buffer_bytes(ring_buffer_t *ring_buffer, std::vector<const AVBuffer *> &seen)
 {
-    for (unsigned i = 0; i < video_sink_threads.size(); i++) {
-        BufferSink *sink = &buffer_sinks[i];
+    const unsigned nb_items = ring_buffer_num_items(ring_buffer);
+    int64_t size = 0;
 
-        if (video_sink_threads[i].joinable()) {
-            { std::lock_guard lk(mutexes[i]); sink->ready = true; }
-            cv[i].notify_one();
-            video_sink_threads[i].join();
-        }
+    for (unsigned i = 0; i < nb_items; i++) {
+        AVFrame *frame = NULL;
 
-        av_freep(&sink->label);
-        glDeleteTextures(1, &sink->texture);
+        ring_buffer_peek(ring_buffer, &frame, i);
+        if (frame)
+            size += unique_frame_bytes(frame, seen);
     }
+
+    return size;
 }
 
-static int get_nb_filter_threads(const AVFilter *filter)
+static int64_t get_sink_bytes(BufferSink *sink)
 {
-    if (filter->flags & AVFILTER_FLAG_SLICE_THREADS)
-        return 0;
-    return 1;
+    return __atomic_load_n(&sink->consume_bytes, __ATOMIC_RELAXED) +
+           sink->render_bytes + __atomic_load_n(&sink->purge_bytes, __ATOMIC_RELAXED) + sink->cache_bytes;
 }
 
-static int filters_setup()
+static int download_hw_frame(AVFrame **frame)
 {
-    const AVFilter *new_filter;
+    AVFrame *sw_frame;
     int ret;
 
-    if (need_filters_reinit == false)
+    if (!(*frame)->hw_frames_ctx)
         return 0;
 
-    if (play_sound_thread.joinable())
-        play_sound_thread.join();
-    play_sources.clear();
-
-    kill_audio_sink_threads();
-    kill_video_sink_threads();
-
-    audio_sink_threads.clear();
-    video_sink_threads.clear();
+    sw_frame = av_frame_alloc();
+    if (!sw_frame)
+        return AVERROR(ENOMEM);
 
-    need_filters_reinit = false;
-    filter_graph_is_valid = false;
+    ret = av_hwframe_map(sw_frame, *frame, AV_HWFRAME_MAP_READ);
+    if (ret < 0) {
+        av_frame_unref(sw_frame);
+        ret = av_hwframe_transfer_data(sw_frame, *frame, 0);
+    }
+    if (ret >= 0)
+        ret = av_frame_copy_props(sw_frame, *frame);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot download hardware frame.\n");
+        av_frame_free(&sw_frame);
+        return ret;
+    }
 
-    if (filter_nodes.size() == 0)
-        return 0;
+    if (std::find(gpu_pix_fmts, gpu_pix_fmts + IM_ARRAYSIZE(gpu_pix_fmts) - 1, sw_frame->format) ==
+        gpu_pix_fmts + IM_ARRAYSIZE(gpu_pix_fmts) - 1) {
+        av_log(NULL, AV_LOG_ERROR, "Unsupported hardware frame software format: %s.\n",
+               av_get_pix_fmt_name((enum AVPixelFormat)sw_frame->format));
+        av_frame_free(&sw_frame);
+        return AVERROR(ENOSYS);
+    }
 
-    buffer_sinks.clear();
-    abuffer_sinks.clear();
-    cv.clear();
-    acv.clear();
-    mutexes.clear();
-    amutexes.clear();
+    av_frame_free(frame);
+    *frame = sw_frame;
 
-    av_freep(&graphdump_text);
+    return 0;
+}
 
-    avfilter_graph_free(&filter_graph);
-    filter_graph = avfilter_graph_alloc();
-    if (!filter_graph) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot allocate filter graph.\n");
-        ret = AVERROR(ENOMEM);
-        goto error;
+static void analyze_samples(const float *src, int nb_samples, int nb_channels, AudioAnalysis *analysis)
+{
+    const int total = nb_samples * nb_channels;
+    float ch_min[MAX_AUDIO_CHANNELS], ch_max[MAX_AUDIO_CHANNELS], ch_sq[MAX_AUDIO_CHANNELS];
+    int n = 0;
+
+    for (int c = 0; c < nb_channels; c++) {
+        ch_min[c] = FLT_MAX;
+        ch_max[c] = -FLT_MAX;
+        ch_sq[c] = 0.f;
     }
 
-    filter_graph->nb_threads = filter_graph_nb_threads;
-    avfilter_graph_set_auto_convert(filter_graph, filter_graph_auto_convert_flags);
+    // with 1, 2 or 4 channels every vector lane always holds the same channel
+    if (4 % nb_channels == 0) {
+        float lane_min[4], lane_max[4], lane_sq[4];
+#if HAVE_SSE
+        __m128 vmin = _mm_set1_ps(FLT_MAX);
+        __m128 vmax = _mm_set1_ps(-FLT_MAX);
+        __m128 vsq = _mm_setzero_ps();
 
-    for (unsigned i = 0; i < filter_nodes.size(); i++) {
-        AVFilterContext *filter_ctx;
+        for (; n + 4 <= total; n += 4) {
+            const __m128 x = _mm_loadu_ps(src + n);
 
-        new_filter = filter_nodes[i].filter;
-        if (!new_filter) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot [%d] get filter by name: %s.\n", i, filter_nodes[i].filter_name);
-            ret = AVERROR(ENOSYS);
-            goto error;
+            vmin = _mm_min_ps(vmin, x);
+            vmax = _mm_max_ps(vmax, x);
+            vsq = _mm_add_ps(vsq, _mm_mul_ps(x, x));
+        }
+        _mm_storeu_ps(lane_min, vmin);
+        _mm_storeu_ps(lane_max, vmax);
+        _mm_storeu_ps(lane_sq, vsq);
+#elif HAVE_NEON
+        float32x4_t vmin = vdupq_n_f32(FLT_MAX);
+        float32x4_t vmax = vdupq_n_f32(-FLT_MAX);
+        float32x4_t vsq = vdupq_n_f32(0.f);
+
+        for (; n + 4 <= total; n += 4) {
+            const float32x4_t x = vld1q_f32(src + n);
+
+            vmin = vminq_f32(vmin, x);
+            vmax = vmaxq_f32(vmax, x);
+            vsq = vmlaq_f32(vsq, x, x);
+        }
+        vst1q_f32(lane_min, vmin);
+        vst1q_f32(lane_max, vmax);
+        vst1q_f32(lane_sq, vsq);
+#else
+        for (int l = 0; l < 4; l++) {
+            lane_min[l] = FLT_MAX;
+            lane_max[l] = -FLT_MAX;
+            lane_sq[l] = 0.f;
         }
 
-        filter_ctx = avfilter_graph_alloc_filter(filter_graph, new_filter, filter_nodes[i].filter_label);
-        if (!filter_ctx) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot allocate filter context.\n");
-            ret = AVERROR(ENOMEM);
-            goto error;
+        for (; n + 4 <= total; n += 4) {
+            for (int l = 0; l < 4; l++) {
+                lane_min[l] = std::min(lane_min[l], src[n + l]);
+                lane_max[l] = std::max(lane_max[l], src[n + l]);
+                lane_sq[l] += src[n + l] * src[n + l];
+            }
         }
+#endif
+        for (int l = 0; l < 4; l++) {
+            const int c = l % nb_channels;
 
-        av_opt_set_defaults(filter_ctx);
-        filter_ctx->nb_threads = get_nb_filter_threads(filter_ctx->filter);
+            ch_min[c] = std::min(ch_min[c], lane_min[l]);
+            ch_max[c] = std::max(ch_max[c], lane_max[l]);
+            ch_sq[c] += lane_sq[l];
+        }
+    }
 
-        if (!strcmp(filter_ctx->filter->name, "buffersink")) {
-            BufferSink new_sink;
+    for (; n < total; n++) {
+        const int c = n % nb_channels;
 
-            new_sink.ctx = filter_ctx;
-            new_sink.ready = false;
-            new_sink.have_window_pos = false;
-            new_sink.fullscreen = false;
-            new_sink.muted = false;
-            new_sink.show_osd = true;
-            new_sink.frame_number = 0;
-            new_sink.upscale_interpolator = global_upscale_interpolation;
-            new_sink.downscale_interpolator = global_downscale_interpolation;
-            ret = av_opt_set_int_list(filter_ctx, "pix_fmts", pix_fmts,
-                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot set buffersink output pixel format.\n");
-                goto error;
-            }
+        ch_min[c] = std::min(ch_min[c], src[n]);
+        ch_max[c] = std::max(ch_max[c], src[n]);
+        ch_sq[c] += src[n] * src[n];
+    }
 
-            buffer_sinks.push_back(new_sink);
-        } else if (!strcmp(filter_ctx->filter->name, "abuffersink")) {
-            BufferSink new_sink;
+    analysis->nb_channels = nb_channels;
+    analysis->min = FLT_MAX;
+    analysis->max = -FLT_MAX;
+    for (int c = 0; c < nb_channels; c++) {
+        analysis->min = std::min(analysis->min, ch_min[c]);
+        analysis->max = std::max(analysis->max, ch_max[c]);
+        analysis->peak[c] = std::max(std::abs(ch_min[c]), std::abs(ch_max[c]));
+        analysis->rms[c] = sqrtf(ch_sq[c] / nb_samples);
+    }
+}
 
-            new_sink.ctx = filter_ctx;
-            new_sink.ready = false;
-            new_sink.have_window_pos = false;
-            new_sink.fullscreen = false;
-            new_sink.muted = false;
-            new_sink.show_osd = true;
-            new_sink.upscale_interpolator = 0;
-            new_sink.downscale_interpolator = 0;
-            new_sink.frame_number = 0;
-            ret = av_opt_set_int_list(filter_ctx, "sample_fmts", sample_fmts,
-                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot set abuffersink output sample formats.\n");
-                goto error;
-            }
+static void analyze_spectrum(BufferSink *sink, const float *src, int nb_samples, int nb_channels, AudioAnalysis *analysis)
+{
+    const float scale = 1.f / nb_channels;
 
-            ret = av_opt_set_int_list(filter_ctx, "sample_rates", sample_rates,
-                                      0, AV_OPT_SEARCH_CHILDREN);
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot set abuffersink output sample rates.\n");
-                goto error;
-            }
+    for (int n = 0; n < nb_samples; n++) {
+        float sum = 0.f;
 
-            abuffer_sinks.push_back(new_sink);
-        }
+        for (int c = 0; c < nb_channels; c++)
+            sum += src[n * nb_channels + c];
+        sink->tx_history[sink->tx_pos] = sum * scale;
+        sink->tx_pos = (sink->tx_pos + 1) % SPECTRUM_SIZE;
+    }
 
-        filter_nodes[i].ctx = filter_ctx;
+    for (int n = 0; n < SPECTRUM_SIZE; n++) {
+        sink->tx_in[n].re = sink->tx_history[(sink->tx_pos + n) % SPECTRUM_SIZE] * sink->tx_window[n];
+        sink->tx_in[n].im = 0.f;
+    }
 
-        av_freep(&filter_nodes[i].ctx_options);
-        if (filter_nodes[i].probe) {
-            ret = av_opt_serialize(filter_nodes[i].probe, 0, AV_OPT_SERIALIZE_SKIP_DEFAULTS,
-                                   &filter_nodes[i].ctx_options, '=', ':');
-            if (ret < 0)
-                av_log(NULL, AV_LOG_WARNING, "Cannot serialize filter ctx options.\n");
-        }
+    sink->tx_fn(sink->tx, sink->tx_out, sink->tx_in, sizeof(AVComplexFloat));
 
-        av_freep(&filter_nodes[i].filter_options);
-        if (filter_nodes[i].probe) {
-            ret = av_opt_serialize(filter_nodes[i].probe->priv, AV_OPT_FLAG_FILTERING_PARAM, AV_OPT_SERIALIZE_SKIP_DEFAULTS,
-                                   &filter_nodes[i].filter_options, '=', ':');
-            if (ret < 0)
-                av_log(NULL, AV_LOG_WARNING, "Cannot serialize filter private options.\n");
-        }
+    for (int n = 0; n < SPECTRUM_SIZE / 2; n++) {
+        const float re = sink->tx_out[n].re;
+        const float im = sink->tx_out[n].im;
 
-        ret = av_opt_set_from_string(filter_ctx, filter_nodes[i].ctx_options, NULL, "=", ":");
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Error setting filter ctx options.\n");
-            goto error;
-        }
+        analysis->spectrum[n] = 10.f * log10f((re * re + im * im) * (4.f / (SPECTRUM_SIZE * SPECTRUM_SIZE)) + 1e-12f);
+    }
+    analysis->have_spectrum = true;
+}
 
-        ret = av_opt_set_from_string(filter_ctx->priv, filter_nodes[i].filter_options, NULL, "=", ":");
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Error setting filter private options.\n");
-            goto error;
-        }
+static void analyze_audio_frame(BufferSink *sink, AVFrame *frame)
+{
+    const int nb_channels = frame->ch_layout.nb_channels;
+    AudioAnalysis *analysis;
 
-        ret = avfilter_init_str(filter_ctx, NULL);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot init str for filter.\n");
-            goto error;
-        }
-    }
+    if (!sink->analysis_pool || frame->nb_samples <= 0 || nb_channels <= 0 ||
+        nb_channels > MAX_AUDIO_CHANNELS || frame->format != AV_SAMPLE_FMT_FLT)
+        return;
 
-    for (unsigned i = 0; i < filter_links.size(); i++) {
-        const std::pair<int, int> p = filter_links[i];
+    av_buffer_unref(&frame->opaque_ref);
+    frame->opaque_ref = av_buffer_pool_get(sink->analysis_pool);
+    if (!frame->opaque_ref)
+        return;
 
-        if ((unsigned)p.first >= edge2pad.size() ||
-            (unsigned)p.second >= edge2pad.size()) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: edges out of range (%d, %d) >= (%ld).\n", p.first, p.second, edge2pad.size());
-            ret = AVERROR(EINVAL);
-            goto error;
-        }
+    analysis = (AudioAnalysis *)frame->opaque_ref->data;
+    analysis->have_spectrum = false;
+    analyze_samples((const float *)frame->extended_data[0], frame->nb_samples, nb_channels, analysis);
+    if (sink->tx && sink->audio_view != AUDIO_VIEW_WAVEFORM)
+        analyze_spectrum(sink, (const float *)frame->extended_data[0], frame->nb_samples, nb_channels, analysis);
+}
 
-        unsigned x = edge2pad[p.first].node;
-        unsigned y = edge2pad[p.second].node;
-        unsigned x_pad = edge2pad[p.first].pad_index;
-        unsigned y_pad = edge2pad[p.second].pad_index;
-        bool x_out = edge2pad[p.first].is_output;
-        bool y_out = edge2pad[p.second].is_output;
+#ifndef _WIN32
+static void get_shm_export_name(const BufferSink *sink, unsigned generation, char *name, size_t size)
+{
+    if (generation)
+        snprintf(name, size, "/lavfi-preview-%d-%s%u.%u", (int)getpid(),
+                 av_get_media_type_string(sink->ctx->inputs[0]->type), sink->id, generation);
+    else
+        snprintf(name, size, "/lavfi-preview-%d-%s%u", (int)getpid(),
+                 av_get_media_type_string(sink->ctx->inputs[0]->type), sink->id);
+}
 
-        if (x >= filter_nodes.size() || y >= filter_nodes.size()) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: index (%d, %d) out of range (%ld)\n",
-                   x, y, filter_nodes.size());
-            ret = AVERROR(EINVAL);
-            goto error;
-        }
+static void unmap_shm_export(BufferSink *sink)
+{
+    char name[128];
+
+    get_shm_export_name(sink, sink->shm_generation, name, sizeof(name));
+    if (sink->shm->header)
+        munmap(sink->shm->header, sink->shm->map_size);
+    if (sink->shm->fd >= 0)
+        close(sink->shm->fd);
+    shm_unlink(name);
+    sink->shm->header = NULL;
+    sink->shm->fd = -1;
+}
+#endif
 
-        if (y_out == true) {
-            std::swap(x, y);
-            std::swap(x_pad, y_pad);
-            std::swap(x_out, y_out);
-        }
+static void close_shm_export(BufferSink *sink)
+{
+#ifndef _WIN32
+    if (!sink->shm)
+        return;
 
-        if ((ret = avfilter_link(filter_nodes[x].ctx, x_pad, filter_nodes[y].ctx, y_pad)) < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: %s(%d|%d) <-> %s(%d|%d)\n",
-                   filter_nodes[x].filter_label, x_pad, x_out, filter_nodes[y].filter_label, y_pad, y_out);
-            goto error;
-        }
-    }
+    unmap_shm_export(sink);
+    av_freep(&sink->shm);
+    __atomic_store_n(&sink->shm_generation, 0u, __ATOMIC_RELAXED);
+#endif
+}
 
-    if ((ret = avfilter_graph_config(filter_graph, NULL)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot configure graph.\n");
-        goto error;
+#ifndef _WIN32
+static int open_shm_export(BufferSink *sink, size_t slot_size)
+{
+    const size_t data_offset = FFALIGN(sizeof(ShmExportHeader), 64);
+    const size_t map_size = data_offset + SHM_EXPORT_SLOTS * slot_size;
+    const unsigned generation = sink->shm ? sink->shm_generation + 1 : 0;
+    ShmExportHeader *header;
+    char name[128];
+    void *map;
+    int fd;
+
+    get_shm_export_name(sink, generation, name, sizeof(name));
+
+    if (!sink->shm) {
+        sink->shm = (ShmExport *)av_mallocz(sizeof(*sink->shm));
+        if (!sink->shm)
+            return AVERROR(ENOMEM);
+        sink->shm->fd = -1;
     }
 
-    filter_graph_is_valid = true;
-    framestep = false;
-    paused = true;
-
-    graphdump_text = avfilter_graph_dump(filter_graph, NULL);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        const int ret = AVERROR(errno);
 
-    show_abuffersink_window = true;
-    show_buffersink_window = true;
+        av_log(NULL, AV_LOG_ERROR, "Cannot create shared memory export %s.\n", name);
+        return ret;
+    }
 
-error:
+    if (ftruncate(fd, map_size) < 0) {
+        const int ret = AVERROR(errno);
 
-    if (ret < 0)
+        close(fd);
+        shm_unlink(name);
         return ret;
+    }
 
-    std::vector<std::condition_variable> cv_list(buffer_sinks.size());
-    cv.swap(cv_list);
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        const int ret = AVERROR(errno);
 
-    std::vector<std::mutex> mutex_list(buffer_sinks.size());
-    mutexes.swap(mutex_list);
+        close(fd);
+        shm_unlink(name);
+        return ret;
+    }
 
-    std::vector<std::thread> thread_list(buffer_sinks.size());
-    video_sink_threads.swap(thread_list);
+    header = (ShmExportHeader *)map;
+    memcpy(header->magic, "LAVFIPRV", 8);
+    header->version = SHM_EXPORT_VERSION;
+    header->nb_slots = SHM_EXPORT_SLOTS;
+    header->map_size = map_size;
+    header->data_offset = data_offset;
+    header->slot_size = slot_size;
+
+    if (sink->shm->header) {
+        av_strlcpy(sink->shm->header->next_name, name, sizeof(sink->shm->header->next_name));
+        __atomic_store_n(&sink->shm->header->next_generation, generation, __ATOMIC_RELEASE);
+        unmap_shm_export(sink);
+    }
 
-    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
-        BufferSink *sink = &buffer_sinks[i];
+    sink->shm->fd = fd;
+    sink->shm->header = header;
+    sink->shm->map_size = map_size;
+    __atomic_store_n(&sink->shm_generation, generation, __ATOMIC_RELAXED);
 
-        sink->id = i;
-        sink->label = av_asprintf("Video FilterGraph Output %d", i);
-        sink->time_base = av_buffersink_get_time_base(sink->ctx);
-        sink->frame_rate = av_buffersink_get_frame_rate(sink->ctx);
-        sink->pts = AV_NOPTS_VALUE;
-        sink->sample_index = 0;
-        sink->samples = NULL;
-        sink->pos = 0;
-        sink->frame_number = 0;
-        sink->frame_nb_samples = 0;
-        sink->nb_samples = 0;
-        sink->render_ring_size = 2;
-        ring_buffer_init(&sink->consume_frames);
-        ring_buffer_init(&sink->render_frames);
-        ring_buffer_init(&sink->purge_frames);
+    return 0;
+}
+#endif
 
-        glGenTextures(1, &sink->texture);
+static void export_sink_frame(BufferSink *sink, const AVFrame *frame)
+{
+#ifndef _WIN32
+    ShmFrameHeader *slot;
+    size_t sizes[4] = { 0 };
+    size_t total = 0;
+    uint64_t index;
+    uint8_t *dst;
+    int nb_planes = 0;
+
+    if (!__atomic_load_n(&sink->shm_export, __ATOMIC_RELAXED)) {
+        close_shm_export(sink);
+        return;
+    }
 
-        std::thread sink_thread(worker_thread, &buffer_sinks[i], &mutexes[i], &cv[i]);
+    if (!frame->buf[0] || frame->hw_frames_ctx)
+        return;
 
-        video_sink_threads[i].swap(sink_thread);
+    if (sink->ctx->inputs[0]->type == AVMEDIA_TYPE_VIDEO) {
+        ptrdiff_t linesizes[4];
+
+        for (int i = 0; i < 4; i++) {
+            if (frame->linesize[i] < 0)
+                return;
+            linesizes[i] = frame->linesize[i];
+        }
+        if (av_image_fill_plane_sizes(sizes, (enum AVPixelFormat)frame->format, frame->height, linesizes) < 0)
+            return;
+        for (nb_planes = 0; nb_planes < 4 && sizes[nb_planes]; nb_planes++)
+            total += sizes[nb_planes];
+    } else {
+        const int planar = av_sample_fmt_is_planar((enum AVSampleFormat)frame->format);
+        const int channels = frame->ch_layout.nb_channels;
+
+        nb_planes = planar ? channels : 1;
+        sizes[0] = (size_t)frame->nb_samples * av_get_bytes_per_sample((enum AVSampleFormat)frame->format) *
+                   (planar ? 1 : channels);
+        total = sizes[0] * nb_planes;
+        if (nb_planes > 8)
+            return;
     }
 
-    std::vector<std::condition_variable> acv_list(abuffer_sinks.size());
-    acv.swap(acv_list);
+    if (!sink->shm || sink->shm->header->slot_size < total) {
+        if (open_shm_export(sink, FFALIGN(total, 4096)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot map shared memory export for %s.\n", sink->label);
+            close_shm_export(sink);
+            __atomic_store_n(&sink->shm_export, false, __ATOMIC_RELAXED);
+            return;
+        }
+    }
 
-    std::vector<std::mutex> amutex_list(abuffer_sinks.size());
-    amutexes.swap(amutex_list);
+    index = sink->shm->header->write_index;
+    slot = &sink->shm->header->frames[index % SHM_EXPORT_SLOTS];
+    dst = (uint8_t *)sink->shm->header + sink->shm->header->data_offset +
+          (index % SHM_EXPORT_SLOTS) * sink->shm->header->slot_size;
+
+    __atomic_store_n(&slot->seq, index * 2 + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->pts = frame->pts;
+    slot->time_base_num = sink->time_base.num;
+    slot->time_base_den = sink->time_base.den;
+    slot->media_type = sink->ctx->inputs[0]->type;
+    slot->format = frame->format;
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->sample_rate = frame->sample_rate;
+    slot->nb_channels = frame->ch_layout.nb_channels;
+    slot->nb_samples = frame->nb_samples;
+    slot->nb_planes = nb_planes;
+    slot->size = total;
+
+    total = 0;
+    for (int i = 0; i < 8; i++) {
+        slot->linesize[i] = 0;
+        slot->offset[i] = 0;
+        if (i >= nb_planes)
+            continue;
 
-    std::vector<std::thread> athread_list(abuffer_sinks.size());
-    audio_sink_threads.swap(athread_list);
+        slot->offset[i] = total;
+        if (slot->media_type == AVMEDIA_TYPE_VIDEO) {
+            const int bytewidth = av_image_get_linesize((enum AVPixelFormat)frame->format, frame->width, i);
 
-    for (unsigned i = 0; i < abuffer_sinks.size(); i++) {
-        BufferSink *sink = &abuffer_sinks[i];
+            slot->linesize[i] = frame->linesize[i];
+            if (bytewidth > 0)
+                av_image_copy_plane(dst + total, frame->linesize[i], frame->data[i], frame->linesize[i],
+                                    bytewidth, sizes[i] / frame->linesize[i]);
+            else
+                memcpy(dst + total, frame->data[i], sizes[i]);
+            total += sizes[i];
+        } else {
+            slot->linesize[i] = sizes[0];
+            memcpy(dst + total, frame->extended_data[i], sizes[0]);
+            total += sizes[0];
+        }
+    }
 
-        sink->id = i;
-        sink->label = av_asprintf("Audio FilterGraph Output %d", i);
-        sink->time_base = av_buffersink_get_time_base(sink->ctx);
-        sink->frame_rate = av_make_q(av_buffersink_get_sample_rate(sink->ctx), 1);
-        sink->sample_index = 0;
-        sink->nb_samples = 512;
-        sink->pos = 0;
-        sink->frame_number = 0;
-        sink->frame_nb_samples = 0;
-        sink->pts = AV_NOPTS_VALUE;
-        sink->samples = (float *)av_calloc(sink->nb_samples, sizeof(float));
-        sink->render_ring_size = 2;
-        ring_buffer_init(&sink->consume_frames);
-        ring_buffer_init(&sink->render_frames);
-        ring_buffer_init(&sink->purge_frames);
+    __atomic_store_n(&slot->seq, index * 2 + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&sink->shm->header->write_index, index + 1, __ATOMIC_RELEASE);
+#endif
+}
 
-        sink->format = AL_FORMAT_MONO_FLOAT32;
+static int sink_enqueue_frame(BufferSink *sink, AVFrame **frame)
+{
+    int64_t size;
+    int ret;
 
-        alGenBuffers(AL_BUFFERS, sink->buffers);
-        for (unsigned j = 0; j < AL_BUFFERS; j++)
-            sink->unprocessed_bufids.push_back(sink->buffers[j]);
+    ret = download_hw_frame(frame);
+    if (ret < 0)
+        return ret;
 
-        alGenSources(1, &sink->source);
-        play_sources.push_back(sink->source);
-        sink->gain = 1.f;
-        sink->position[0] =  0.f;
-        sink->position[1] =  0.f;
-        sink->position[2] = -1.f;
-        alSource3f(sink->source, AL_POSITION, sink->position[0], sink->position[1], sink->position[2]);
-        alSourcei(sink->source, AL_SOURCE_RELATIVE, AL_TRUE);
-        alSourcei(sink->source, AL_ROLLOFF_FACTOR, 0);
+    analyze_audio_frame(sink, *frame);
+    export_sink_frame(sink, *frame);
 
-        std::thread asink_thread(worker_thread, &abuffer_sinks[i], &amutexes[i], &acv[i]);
+    size = frame_bytes(*frame);
+    if ((*frame)->pts != AV_NOPTS_VALUE)
+        __atomic_store_n(&sink->head_pts, av_rescale_q((*frame)->pts, sink->time_base, AV_TIME_BASE_Q), __ATOMIC_RELAXED);
 
-        audio_sink_threads[i].swap(asink_thread);
+    __atomic_add_fetch(&sink->consume_bytes, size, __ATOMIC_RELAXED);
+    ret = ring_buffer_enqueue(&sink->consume_frames, *frame);
+    if (ret < 0)
+        __atomic_sub_fetch(&sink->consume_bytes, size, __ATOMIC_RELAXED);
+    else if (!headless)
+        glfwPostEmptyEvent();
+
+    return ret;
+}
+
+static void sink_dequeue_frame(BufferSink *sink, AVFrame **frame)
+{
+    ring_buffer_dequeue(&sink->consume_frames, frame);
+    if (*frame)
+        __atomic_sub_fetch(&sink->consume_bytes, (int64_t)frame_bytes(*frame), __ATOMIC_RELAXED);
+}
+
+static void clear_ring_buffer(ring_buffer_t *ring_buffer)
+{
+    while (ring_buffer_num_items(ring_buffer) > 0) {
+        AVFrame *frame;
+
+        ring_buffer_dequeue(ring_buffer, &frame);
+        av_frame_free(&frame);
     }
+}
 
-    std::thread new_sound_thread(sound_thread, abuffer_sinks.size(), &play_sources);
-    play_sound_thread.swap(new_sound_thread);
+static void recycle_sink_frame(BufferSink *sink, AVFrame **frame)
+{
+    int64_t size;
 
-    return 0;
+    if (!*frame)
+        return;
+    size = frame_bytes(*frame);
+    __atomic_add_fetch(&sink->purge_bytes, size, __ATOMIC_RELAXED);
+    if (ring_buffer_enqueue(&sink->purge_frames, *frame) < 0) {
+        __atomic_sub_fetch(&sink->purge_bytes, size, __ATOMIC_RELAXED);
+        av_frame_free(frame);
+    }
+    *frame = NULL;
 }
 
-static void load_frame(GLuint *out_texture, int *width, int *height, AVFrame *frame,
-                       BufferSink *sink)
+static AVFrame *get_recycled_frame(BufferSink *sink)
 {
-    *width  = frame->width;
-    *height = frame->height;
+    AVFrame *frame = NULL;
 
-    glBindTexture(GL_TEXTURE_2D, *out_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sink->downscale_interpolator);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sink->upscale_interpolator);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[0] / 4);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame->width, frame->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame->data[0]);
+    while (ring_buffer_num_items(&sink->purge_frames) > 0) {
+        AVFrame *old = NULL;
+
+        ring_buffer_dequeue(&sink->purge_frames, &old);
+        __atomic_sub_fetch(&sink->purge_bytes, (int64_t)frame_bytes(old), __ATOMIC_RELAXED);
+        if (frame) {
+            av_frame_free(&old);
+        } else {
+            av_frame_unref(old);
+            frame = old;
+        }
+    }
+
+    return frame ? frame : av_frame_alloc();
 }
 
-static void draw_info(bool *p_open, FrameInfo *frame)
+static void clear_frame_cache(BufferSink *sink)
 {
-    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
-                                          ImGuiWindowFlags_AlwaysAutoResize |
-                                          ImGuiWindowFlags_NoSavedSettings |
-                                          ImGuiWindowFlags_NoNav |
-                                          ImGuiWindowFlags_NoMouseInputs |
-                                          ImGuiWindowFlags_NoFocusOnAppearing |
-                                          ImGuiWindowFlags_NoMove;
+    for (unsigned i = 0; i < sink->frame_cache.size(); i++)
+        av_frame_free(&sink->frame_cache[i].frame);
+    sink->frame_cache.clear();
+    sink->frame_cache_bytes = 0;
+    sink->frame_cache_clock = 0;
+    sink->cache_index = -1;
+    sink->uploaded_frame = NULL;
+}
 
-    ImGui::SetNextWindowPos(ImVec2(display_w/2, display_h/2), 0, ImVec2(0.5, 0.5));
-    ImGui::SetNextWindowBgAlpha(0.7f);
-    ImGui::SetNextWindowFocus();
+static void cache_frame(BufferSink *sink, const AVFrame *frame)
+{
+    const int64_t max_bytes = (int64_t)frame_cache_mb << 20;
+    std::vector<CachedFrame>::iterator it;
+    CachedFrame new_entry;
+    int index;
 
-    if (!ImGui::Begin("##Info", p_open, window_flags)) {
-        ImGui::End();
+    if (max_bytes <= 0 || !frame->buf[0] || frame->pts == AV_NOPTS_VALUE)
+        return;
+
+    it = std::lower_bound(sink->frame_cache.begin(), sink->frame_cache.end(), frame->pts,
+                          [](const CachedFrame &entry, int64_t pts) { return entry.frame->pts < pts; });
+    if (it != sink->frame_cache.end() && it->frame->pts == frame->pts) {
+        it->last_used = ++sink->frame_cache_clock;
         return;
     }
 
-    ImGui::Separator();
-    if (frame->width && frame->height) {
-        ImGui::Text("SIZE: %dx%d", frame->width, frame->height);
-        ImGui::Separator();
-        ImGui::Text("KEY FRAME: %d", frame->key_frame);
-        ImGui::Separator();
-        ImGui::Text("PICTURE TYPE: %c", av_get_picture_type_char(frame->pict_type));
-        ImGui::Separator();
-        ImGui::Text("SAR: %dx%d", frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den);
-        ImGui::Separator();
-        ImGui::Text("COLOR RANGE: %s", av_color_range_name(frame->color_range));
-        ImGui::Separator();
-        ImGui::Text("COLOR PRIMARIES: %s", av_color_primaries_name(frame->color_primaries));
-        ImGui::Separator();
-        ImGui::Text("COLOR TRC: %s", av_color_transfer_name(frame->color_trc));
-        ImGui::Separator();
-        ImGui::Text("COLOR SPACE: %s", av_color_space_name(frame->colorspace));
-        ImGui::Separator();
-        ImGui::Text("CHROMA LOCATION: %s", av_chroma_location_name(frame->chroma_location));
-        ImGui::Separator();
-        ImGui::Text("PIXEL FORMAT: %s", av_get_pix_fmt_name((enum AVPixelFormat)frame->format));
-        ImGui::Separator();
-    } else if (frame->nb_samples) {
-        ImGui::Text("SAMPLES: %d", frame->nb_samples);
-        ImGui::Separator();
-        ImGui::Text("SAMPLE RATE: %d", frame->sample_rate);
-        ImGui::Separator();
-        ImGui::Text("SAMPLE FORMAT: %s", av_get_sample_fmt_name((enum AVSampleFormat)frame->format));
-        ImGui::Separator();
+    new_entry.frame = av_frame_clone(frame);
+    if (!new_entry.frame)
+        return;
+    new_entry.last_used = ++sink->frame_cache_clock;
+    index = it - sink->frame_cache.begin();
+    sink->frame_cache.insert(it, new_entry);
+    sink->frame_cache_bytes += frame_bytes(new_entry.frame);
+
+    while (sink->frame_cache_bytes > max_bytes && sink->frame_cache.size() > 1) {
+        int victim = -1;
+
+        for (int i = 0; i < (int)sink->frame_cache.size(); i++) {
+            if (i == index || i == sink->cache_index)
+                continue;
+            if (victim < 0 || sink->frame_cache[i].last_used < sink->frame_cache[victim].last_used)
+                victim = i;
+        }
+        if (victim < 0)
+            break;
+
+        sink->frame_cache_bytes -= frame_bytes(sink->frame_cache[victim].frame);
+        if (sink->uploaded_frame == sink->frame_cache[victim].frame)
+            sink->uploaded_frame = NULL;
+        recycle_sink_frame(sink, &sink->frame_cache[victim].frame);
+        sink->frame_cache.erase(sink->frame_cache.begin() + victim);
+        if (victim < index)
+            index--;
+        if (victim < sink->cache_index)
+            sink->cache_index--;
     }
-    ImGui::Text("PTS: %ld", frame->pts);
-    ImGui::Separator();
-    ImGui::Text("TIME BASE: %d/%d", frame->time_base.num, frame->time_base.den);
-    ImGui::Separator();
-    ImGui::Text("PACKET POSITION: %ld", frame->pkt_pos);
-    ImGui::Separator();
-    ImGui::Text("PACKET SIZE: %d", frame->pkt_size);
-    ImGui::Separator();
-    ImGui::Text("PACKET DURATION: %ld", frame->pkt_duration);
-    ImGui::End();
 }
 
-static void draw_help(bool *p_open)
+static void step_frame_cache(BufferSink *sink, int direction)
 {
-    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
-                                          ImGuiWindowFlags_AlwaysAutoResize |
-                                          ImGuiWindowFlags_NoSavedSettings |
-                                          ImGuiWindowFlags_NoNav |
-                                          ImGuiWindowFlags_NoMouseInputs |
-                                          ImGuiWindowFlags_NoFocusOnAppearing |
-                                          ImGuiWindowFlags_NoMove;
-    const int align = 555;
+    const int size = sink->frame_cache.size();
+    int index = sink->cache_index;
 
-    ImGui::SetNextWindowPos(ImVec2(display_w/2, display_h/2), 0, ImVec2(0.5, 0.5));
-    ImGui::SetNextWindowBgAlpha(0.5f);
-    ImGui::SetNextWindowFocus();
+    if (size == 0)
+        return;
 
-    if (!ImGui::Begin("##Help", p_open, window_flags)) {
-        ImGui::End();
+    if (index < 0) {
+        index = size - 1;
+        for (int i = 0; i < size; i++) {
+            if (sink->frame_cache[i].frame->pts == sink->pts) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    index += direction;
+    if (index >= size) {
+        sink->cache_index = -1;
+        framestep = true;
         return;
     }
 
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::Text("Global Keys:");
-    ImGui::Separator();
-    ImGui::Text("Show Help:");
-    ImGui::SameLine(align);
-    ImGui::Text("F1");
-    ImGui::Separator();
-    ImGui::Text("Jump to FilterGraph Editor:");
-    ImGui::SameLine(align);
-    ImGui::Text("F2");
-    ImGui::Separator();
-    ImGui::Text("Jump to FilterGraph Commands Window:");
-    ImGui::SameLine(align);
-    ImGui::Text("F3");
-    ImGui::Separator();
-    ImGui::Text("Jump to FilterGraph Dump Window:");
-    ImGui::SameLine(align);
-    ImGui::Text("F4");
-    ImGui::Separator();
-    ImGui::Text("Jump to FilterGraph Log Window:");
-    ImGui::SameLine(align);
-    ImGui::Text("F5");
-    ImGui::Separator();
-    ImGui::Text("Toggle Console:");
-    ImGui::SameLine(align);
-    ImGui::Text("Escape");
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::Text("FilterGraph Editor Keys:");
-    ImGui::Separator();
-    ImGui::Text("Add New Filter:");
-    ImGui::SameLine(align);
-    ImGui::Text("A");
-    ImGui::Separator();
-    ImGui::Text("Auto Connect Filter Outputs to Sinks:");
-    ImGui::SameLine(align);
-    ImGui::Text("Shift + A");
-    ImGui::Separator();
-    ImGui::Text("Remove Selected Filters:");
-    ImGui::SameLine(align);
-    ImGui::Text("Shift + X");
-    ImGui::Separator();
-    ImGui::Text("Remove Selected Links:");
-    ImGui::SameLine(align);
-    ImGui::Text("X");
-    ImGui::Separator();
-    ImGui::Text("Clone Selected Filters:");
-    ImGui::SameLine(align);
-    ImGui::Text("Shift + C");
-    ImGui::Separator();
-    ImGui::Text("Configure Graph:");
-    ImGui::SameLine(align);
-    ImGui::Text("Ctrl + Enter");
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::Text("Video/Audio FilterGraph Outputs:");
-    ImGui::Separator();
-    ImGui::Text("Pause playback:");
-    ImGui::SameLine(align);
-    ImGui::Text("Space");
-    ImGui::Separator();
-    ImGui::Text("Toggle fullscreen:");
-    ImGui::SameLine(align);
-    ImGui::Text("F");
-    ImGui::Separator();
-    ImGui::Text("Toggle zooming:");
-    ImGui::SameLine(align);
-    ImGui::Text("Z");
-    ImGui::Separator();
-    ImGui::Text("Framestep forward:");
-    ImGui::SameLine(align);
-    ImGui::Text("'.'");
-    ImGui::Separator();
-    ImGui::Text("Toggle OSD:");
-    ImGui::SameLine(align);
-    ImGui::Text("O");
-    ImGui::Separator();
-    ImGui::Text("Jump to #numbered Video output:");
-    ImGui::SameLine(align);
-    ImGui::Text("Ctrl + <number>");
-    ImGui::Separator();
-    ImGui::Text("Jump to #numbered Audio output:");
-    ImGui::SameLine(align);
-    ImGui::Text("Alt + <number>");
-    ImGui::Separator();
-    ImGui::Text("Toggle Audio output mute:");
-    ImGui::SameLine(align);
-    ImGui::Text("M");
-    ImGui::Separator();
-    ImGui::Text("Show Extended Info:");
-    ImGui::SameLine(align);
-    ImGui::Text("I");
-    ImGui::Separator();
-    ImGui::Text("Exit from output:");
-    ImGui::SameLine(align);
-    ImGui::Text("Shift + Q");
-    ImGui::Separator();
-    ImGui::End();
+    sink->cache_index = std::max(index, 0);
 }
 
-static void add_filter_node(const AVFilter *filter, ImVec2 pos)
+#define TRACE_BUFFER_SIZE 65536
+
+typedef struct TraceEvent {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    int id;
+    char media;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    int tid;
+    char name[32];
+    TraceEvent *events;
+    unsigned count;
+    bool exited;
+} TraceBuffer;
+
+struct TraceThread {
+    TraceBuffer *buffer = NULL;
+    char name[32] = { 0 };
+
+    ~TraceThread() {
+        if (buffer)
+            __atomic_store_n(&buffer->exited, true, __ATOMIC_RELEASE);
+    }
+};
+
+static thread_local TraceThread trace_thread;
+std::mutex trace_mutex;
+std::vector<TraceBuffer *> trace_buffers;
+bool trace_enabled = false;
+int trace_next_tid = 1;
+char trace_file_name[1024] = "lavfi-preview-trace.json";
+
+static void trace_set_thread_name(const char *fmt, ...)
 {
-    FilterNode node;
+    va_list vl;
 
-    node.edge = editor_edge++;
-    node.filter = filter;
-    node.id = filter_nodes.size();
-    node.filter_name = av_strdup(filter->name);
-    node.filter_label = av_asprintf("%s%d", filter->name, node.id);
-    node.filter_options = NULL;
-    node.ctx_options = NULL;
-    node.probe = NULL;
-    node.ctx = NULL;
-    node.pos = pos;
-    node.colapsed = false;
-    node.set_pos = true;
+    va_start(vl, fmt);
+    vsnprintf(trace_thread.name, sizeof(trace_thread.name), fmt, vl);
+    va_end(vl);
+}
 
-    filter_nodes.push_back(node);
+static TraceBuffer *get_trace_buffer()
+{
+    TraceBuffer *buffer;
+
+    if (trace_thread.buffer)
+        return trace_thread.buffer;
+
+    buffer = (TraceBuffer *)av_mallocz(sizeof(*buffer));
+    if (!buffer)
+        return NULL;
+    buffer->events = (TraceEvent *)av_calloc(TRACE_BUFFER_SIZE, sizeof(*buffer->events));
+    if (!buffer->events) {
+        av_free(buffer);
+        return NULL;
+    }
+
+    std::lock_guard lk(trace_mutex);
+    buffer->tid = trace_next_tid++;
+    if (trace_thread.name[0])
+        av_strlcpy(buffer->name, trace_thread.name, sizeof(buffer->name));
+    else
+        snprintf(buffer->name, sizeof(buffer->name), "thread %d", buffer->tid);
+    trace_buffers.push_back(buffer);
+    trace_thread.buffer = buffer;
+
+    return buffer;
 }
 
-static void draw_console(bool *p_open)
+static inline int64_t trace_begin()
 {
-    char input_line[4096] = { 0 };
-    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
-                                          ImGuiWindowFlags_NoSavedSettings |
-                                          ImGuiWindowFlags_NoNav |
-                                          ImGuiWindowFlags_NoMove;
+    return __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED) ? av_gettime_relative() : 0;
+}
 
-    ImGui::SetNextWindowPos(ImVec2(0, display_h - 35));
-    ImGui::SetNextWindowSize(ImVec2(display_w, 30));
-    ImGui::SetNextWindowBgAlpha(0.5f);
-    ImGui::SetNextWindowFocus();
+static void trace_end(const char *name, int64_t start, const BufferSink *sink)
+{
+    TraceBuffer *buffer;
+    TraceEvent *event;
+    unsigned count;
 
-    if (!ImGui::Begin("##Console", p_open, window_flags)) {
-        ImGui::End();
+    if (!start || !__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))
         return;
-    }
 
-    ImGuiInputTextFlags input_text_flags = ImGuiInputTextFlags_EnterReturnsTrue;
+    buffer = get_trace_buffer();
+    if (!buffer)
+        return;
 
-    ImGui::SetKeyboardFocusHere();
-    ImGui::PushStyleColor(ImGuiCol_FrameBg, IM_COL32(0,   0, 0, 200));
-    ImGui::PushStyleColor(ImGuiCol_Text,    IM_COL32(0, 255, 0, 200));
-    if (ImGui::InputText("##>", input_line, IM_ARRAYSIZE(input_line), input_text_flags)) {
-        if (!strncmp(input_line, "a ", 2) && filter_graph_is_valid == false) {
-            const AVFilter *filter = avfilter_get_by_name(input_line + 2);
+    count = __atomic_load_n(&buffer->count, __ATOMIC_RELAXED);
+    event = &buffer->events[count & (TRACE_BUFFER_SIZE - 1)];
+    event->name = name;
+    event->start = start;
+    event->duration = av_gettime_relative() - start;
+    event->id = sink ? (int)sink->id : -1;
+    event->media = sink ? (sink->ctx->inputs[0]->type == AVMEDIA_TYPE_AUDIO ? 'a' : 'v') : 0;
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
 
-            if (filter)
-                add_filter_node(filter, ImVec2(0, 0));
+static void start_trace()
+{
+    std::lock_guard lk(trace_mutex);
+
+    for (unsigned i = 0; i < trace_buffers.size();) {
+        TraceBuffer *buffer = trace_buffers[i];
+
+        if (__atomic_load_n(&buffer->exited, __ATOMIC_ACQUIRE)) {
+            av_freep(&buffer->events);
+            av_freep(&buffer);
+            trace_buffers.erase(trace_buffers.begin() + i);
+            continue;
         }
+        __atomic_store_n(&buffer->count, 0U, __ATOMIC_RELAXED);
+        i++;
     }
-    ImGui::PopStyleColor();
-    ImGui::PopStyleColor();
 
-    ImGui::End();
+    __atomic_store_n(&trace_enabled, true, __ATOMIC_RELEASE);
 }
 
-static void draw_osd(BufferSink *sink, int width, int height, int64_t pos)
+static int dump_trace(const char *file_name)
 {
-    char osd_text[1024];
+    FILE *file;
+    bool first = true;
 
-    snprintf(osd_text, sizeof(osd_text), "FRAME: %ld | SIZE: %dx%d | TIME: %.5f | SPEED: %011.5f | FPS: %d/%d (%.5f) | POS: %ld",
-             sink->frame_number - 1,
-             width, height,
-             av_q2d(sink->time_base) * sink->pts,
-             sink->speed,
-             sink->frame_rate.num, sink->frame_rate.den, av_q2d(sink->frame_rate), pos);
+    __atomic_store_n(&trace_enabled, false, __ATOMIC_RELEASE);
 
-    if (sink->fullscreen) {
-        ImVec2 max_size = ImGui::GetIO().DisplaySize;
-        ImVec2 tsize = ImGui::CalcTextSize(osd_text);
-        ImVec2 start_pos = ImVec2(std::min(max_size.x * osd_fullscreen_pos[0], max_size.x - tsize.x - 25), std::min(max_size.y * osd_fullscreen_pos[1], max_size.y - tsize.y - 25));
-        ImVec2 stop_pos = ImVec2(std::min(start_pos.x + tsize.x + 25, max_size.x), std::min(start_pos.y + tsize.y + 25, max_size.y));
-        ImGui::GetWindowDrawList()->AddRectFilled(start_pos, stop_pos,
-                                                  ImGui::GetColorU32(ImGuiCol_WindowBg, osd_transparency));
-        ImGui::SetCursorPos(ImVec2(std::min(start_pos.x + 12, max_size.x - tsize.x - 12), std::min(start_pos.y + 12, max_size.y - tsize.y - 12)));
-        ImGui::Text(osd_text);
-    } else {
-        ImGui::TextWrapped(osd_text);
+    file = fopen(file_name, "w");
+    if (!file) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open trace file '%s'.\n", file_name);
+        return AVERROR(errno);
+    }
+
+    std::lock_guard lk(trace_mutex);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (unsigned i = 0; i < trace_buffers.size(); i++) {
+        const TraceBuffer *buffer = trace_buffers[i];
+        const unsigned count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        const unsigned nb_events = std::min(count, (unsigned)TRACE_BUFFER_SIZE);
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->name);
+        first = false;
+
+        for (unsigned j = count - nb_events; j != count; j++) {
+            const TraceEvent *event = &buffer->events[j & (TRACE_BUFFER_SIZE - 1)];
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%ld,\"dur\":%ld",
+                    event->name, buffer->tid, event->start, event->duration);
+            if (event->media)
+                fprintf(file, ",\"args\":{\"sink\":\"%s %d\"}", event->media == 'a' ? "audio" : "video", event->id);
+            fprintf(file, "}");
+        }
     }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    av_log(NULL, AV_LOG_INFO, "Wrote trace to '%s'.\n", file_name);
+
+    return 0;
 }
 
-static void update_frame_info(FrameInfo *frame_info, const AVFrame *frame)
+static void free_trace_buffers()
 {
-    if (!ImGui::IsKeyDown(ImGuiKey_I))
-        return;
+    std::lock_guard lk(trace_mutex);
 
-    frame_info->width = frame->width;
-    frame_info->height = frame->height;
-    frame_info->nb_samples = frame->nb_samples;
-    frame_info->format = frame->format;
-    frame_info->key_frame = frame->key_frame;
-    frame_info->pict_type = frame->pict_type;
-    frame_info->sample_aspect_ratio = frame->sample_aspect_ratio;
-    frame_info->pts = frame->pts;
-    frame_info->pkt_dts = frame->pkt_dts;
-    frame_info->time_base = frame->time_base;
-    frame_info->coded_picture_number = frame->coded_picture_number;
-    frame_info->display_picture_number = frame->display_picture_number;
-    frame_info->interlaced_frame = frame->interlaced_frame;
-    frame_info->top_field_first = frame->top_field_first;
-    frame_info->sample_rate = frame->sample_rate;
-    frame_info->color_range = frame->color_range;
-    frame_info->color_primaries = frame->color_primaries;
-    frame_info->color_trc = frame->color_trc;
-    frame_info->colorspace = frame->colorspace;
-    frame_info->chroma_location = frame->chroma_location;
-    frame_info->pkt_pos = frame->pkt_pos;
-    frame_info->pkt_duration = frame->pkt_duration;
-    frame_info->pkt_size = frame->pkt_size;
-    frame_info->crop_top = frame->crop_top;
-    frame_info->crop_bottom = frame->crop_bottom;
-    frame_info->crop_left = frame->crop_left;
-    frame_info->crop_right = frame->crop_right;
+    for (unsigned i = 0; i < trace_buffers.size(); i++) {
+        av_freep(&trace_buffers[i]->events);
+        av_freep(&trace_buffers[i]);
+    }
+    trace_buffers.clear();
+    trace_thread.buffer = NULL;
 }
 
-static void draw_frame(GLuint *texture, bool *p_open, AVFrame *new_frame,
-                       BufferSink *sink)
+static void sound_thread(ALsizei nb_sources, std::vector<ALuint> *sources)
 {
-    ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
-    int width, height;
-    bool style = false;
+    std::unique_lock lk(playback_mutex);
+    bool state = playback_paused;
 
-    if (!*p_open || !new_frame)
-        goto end;
+    trace_set_thread_name("sound");
 
-    update_frame_info(&frame_info, new_frame);
-    sink->pts = new_frame->pts;
+    if (state)
+        alSourceStopv(nb_sources, sources->data());
 
-    load_frame(texture, &width, &height, new_frame, sink);
-    if (sink->fullscreen) {
-        const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    while (sources->size() > 0) {
+        playback_cv.wait(lk, [state]{ return playback_stop || playback_paused != state; });
+        if (playback_stop)
+            break;
 
-        sink->have_window_pos = true;
+        state = playback_paused;
+        lk.unlock();
+        if (state == true)
+            alSourcePausev(nb_sources, sources->data());
+        else
+            alSourcePlayv(nb_sources, sources->data());
+        lk.lock();
+    }
+}
 
-        ImGui::SetNextWindowPos(viewport->Pos);
-        ImGui::SetNextWindowSize(viewport->Size);
+static void update_playback_state()
+{
+    const bool state = paused && !framestep;
 
-        flags |= ImGuiWindowFlags_NoDecoration;
-        flags |= ImGuiWindowFlags_NoTitleBar;
-        flags |= ImGuiWindowFlags_NoMove;
-        flags |= ImGuiWindowFlags_NoResize;
+    if (state == playback_paused)
+        return;
 
-        ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
-        ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-        style = true;
-    } else {
-        ImGui::SetNextWindowSizeConstraints(ImVec2(width + 20, height), ImVec2(width + 20, height + 200));
-        if (sink->have_window_pos == true) {
-            ImGui::SetNextWindowPos(sink->window_pos);
-            sink->have_window_pos = false;
-        }
+    {
+        std::lock_guard lk(playback_mutex);
+        playback_paused = state;
     }
+    playback_cv.notify_all();
+}
 
-    if (focus_buffersink_window == sink->id) {
-        ImGui::SetNextWindowFocus();
-        focus_buffersink_window = -1;
-    }
+static void stop_sound_thread()
+{
+    if (!play_sound_thread.joinable())
+        return;
 
-    if (!ImGui::Begin(sink->label, p_open, flags)) {
-        ImGui::End();
-        goto end;
+    {
+        std::lock_guard lk(playback_mutex);
+        playback_stop = true;
     }
+    playback_cv.notify_all();
+    play_sound_thread.join();
+    playback_stop = false;
+}
 
-    if (sink->fullscreen == false)
-        sink->window_pos = ImGui::GetWindowPos();
+static void drain_tap_previews()
+{
+    for (unsigned i = 0; i < tap_previews.size(); i++) {
+        TapPreview *tap = &tap_previews[i];
+        AVFrame *frame = tap->spare ? tap->spare : av_frame_alloc();
 
-    if (ImGui::IsWindowFocused()) {
-        if (ImGui::IsKeyReleased(ImGuiKey_F))
-            sink->fullscreen = !sink->fullscreen;
-        if (ImGui::IsKeyReleased(ImGuiKey_Space))
-            paused = !paused;
-        framestep = ImGui::IsKeyPressed(ImGuiKey_Period, true);
-        if (framestep)
-            paused = true;
-        if (ImGui::IsKeyDown(ImGuiKey_Q) && ImGui::GetIO().KeyShift) {
-            show_abuffersink_window = false;
-            show_buffersink_window = false;
-            filter_graph_is_valid = false;
+        tap->spare = NULL;
+        if (!frame)
+            return;
+
+        while (av_buffersink_get_frame_flags(tap->ctx, frame, AV_BUFFERSINK_FLAG_NO_REQUEST) >= 0) {
+            {
+                std::lock_guard lk(tap_mutex);
+                std::swap(tap->pending, frame);
+            }
+            if (frame)
+                av_frame_unref(frame);
+            else
+                frame = av_frame_alloc();
+            if (!frame)
+                return;
         }
-        if (ImGui::IsKeyReleased(ImGuiKey_O))
-            sink->show_osd = !sink->show_osd;
+        tap->spare = frame;
     }
+}
 
-    if (ImGui::IsKeyDown((ImGuiKey)(ImGuiKey_0 + sink->id)) && ImGui::GetIO().KeyCtrl)
-        focus_buffersink_window = sink->id;
+static void free_tap_previews()
+{
+    for (unsigned i = 0; i < tap_previews.size(); i++) {
+        TapPreview *tap = &tap_previews[i];
 
-    if (sink->fullscreen) {
-        ImGui::GetWindowDrawList()->AddImage((void*)(intptr_t)*texture, ImVec2(0.f, 0.f),
-                                             ImGui::GetWindowSize(),
-                                             ImVec2(0.f, 0.f), ImVec2(1.f, 1.f), IM_COL32_WHITE);
-    } else {
-        ImGui::Image((void*)(intptr_t)*texture, ImVec2(width, height));
+        av_frame_free(&tap->pending);
+        av_frame_free(&tap->spare);
+        if (!headless)
+            glDeleteTextures(1, &tap->texture);
     }
+    tap_previews.clear();
+}
 
-    if ((ImGui::IsItemHovered() || sink->fullscreen) && ImGui::IsKeyDown(ImGuiKey_Z)) {
-        ImGuiIO& io = ImGui::GetIO();
-        ImVec2 size = ImGui::GetWindowSize();
-        ImVec2 pos = ImGui::GetWindowPos();
-        ImGui::BeginTooltip();
-        float my_tex_w = (float)width;
-        float my_tex_h = (float)height;
-        ImVec4 tint_col   = ImVec4(1.0f, 1.0f, 1.0f, 1.0f); // No tint
-        ImVec4 border_col = ImVec4(1.0f, 1.0f, 1.0f, 0.5f); // 50% opaque white
-        float region_sz = 32.0f;
-        float region_x = (io.MousePos.x - pos.x - region_sz * 0.5f) * width  / size.x;
-        float region_y = (io.MousePos.y - pos.y - region_sz * 0.5f) * height / size.y;
-        static float zoom = 4.f;
-        zoom = av_clipf(zoom + io.MouseWheel * 0.3f, 1.5f, 12.f);
-        if (region_x < 0.0f) { region_x = 0.0f; }
-        else if (region_x > my_tex_w - region_sz) { region_x = my_tex_w - region_sz; }
-        if (region_y < 0.0f) { region_y = 0.0f; }
-        else if (region_y > my_tex_h - region_sz) { region_y = my_tex_h - region_sz; }
-        ImVec2 uv0 = ImVec2((region_x) / my_tex_w, (region_y) / my_tex_h);
-        ImVec2 uv1 = ImVec2((region_x + region_sz) / my_tex_w, (region_y + region_sz) / my_tex_h);
-        ImGui::Image((void*)(intptr_t)*texture, ImVec2(region_sz * zoom, region_sz * zoom), uv0, uv1, tint_col, border_col);
-        ImGui::EndTooltip();
-    }
+static void worker_thread(BufferSink *sink, std::mutex *mutex, std::condition_variable *cv)
+{
+    int ret;
 
-    if (sink->show_osd)
-        draw_osd(sink, width, height, new_frame->pkt_pos);
+    trace_set_thread_name("%s sink %u", av_get_media_type_string(sink->ctx->inputs[0]->type), sink->id);
 
-    if (style) {
-        ImGui::PopStyleVar();
-        ImGui::PopStyleVar();
-    }
+    while (sink->ctx) {
+        {
+            std::unique_lock lk(*mutex);
+            cv->wait(lk, [sink]{ return sink->ready == true; });
+            sink->ready = false;
+        }
+        if (sink_threads_stop)
+            break;
 
-    ImGui::End();
+        ret = 0;
+        while (sink_wants_frame(sink) && !sink_threads_stop) {
+            AVFrame *filter_frame;
+            int64_t start, end, trace_start;
 
-end:
+            filter_frame = get_recycled_frame(sink);
+            if (!filter_frame) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            start = av_gettime_relative();
+            trace_start = trace_begin();
+            filtergraph_mutex.lock();
+            trace_end("lock wait", trace_start, sink);
+            trace_start = trace_begin();
+            ret = av_buffersink_get_frame_flags(sink->ctx, filter_frame, 0);
+            trace_end("graph pull", trace_start, sink);
+            drain_tap_previews();
+            filtergraph_mutex.unlock();
+            end = av_gettime_relative();
+            if (end > start && filter_frame)
+                sink->speed = 1000000. * (std::max(filter_frame->nb_samples, 1)) * av_q2d(av_inv_q(sink->frame_rate)) / (end - start);
+            if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                av_frame_free(&filter_frame);
+                break;
+            }
 
-    if (new_frame && new_frame->nb_samples == 0) {
-        sink->frame_number++;
-        new_frame->nb_samples = 1;
+            if (ret == AVERROR(EAGAIN) && ring_buffer_num_items(&sink->consume_frames) > 0) {
+                av_frame_free(&filter_frame);
+                break;
+            }
+
+            if (sink_enqueue_frame(sink, &filter_frame) < 0)
+                av_frame_free(&filter_frame);
+
+            if (ret == AVERROR(EAGAIN))
+                break;
+        }
+
+        if (ret < 0 && ret != AVERROR(EAGAIN))
+            break;
     }
+
+    clear_ring_buffer(&sink->consume_frames);
+    clear_ring_buffer(&sink->render_frames);
+    clear_ring_buffer(&sink->purge_frames);
+    sink->consume_bytes = 0;
 }
 
-static void draw_aframe(bool *p_open, BufferSink *sink)
+static void graph_driver(std::vector<BufferSink *> sinks, std::vector<AVFilterContext *> detached)
 {
-    ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
-    ALint queued;
+    std::vector<std::pair<BufferSink *, int64_t>> requested;
+    std::vector<bool> eof(sinks.size(), false);
+    AVFrame *filter_frame = NULL;
+    int64_t trace_start;
+    int ret;
 
-    if (!*p_open)
-        return;
+    trace_set_thread_name("graph driver");
 
-    if (focus_abuffersink_window == sink->id) {
-        ImGui::SetNextWindowFocus();
-        focus_abuffersink_window = -1;
-    }
+    while (1) {
+        bool graph_eof = false;
 
-    if (!ImGui::Begin(sink->label, p_open, flags)) {
-        ImGui::End();
-        return;
-    }
+        {
+            std::unique_lock lk(graph_driver_mutex);
+            graph_driver_cv.wait(lk, []{ return graph_driver_ready || graph_driver_stop; });
+            if (graph_driver_stop)
+                break;
+            graph_driver_ready = false;
 
-    if (ImGui::IsWindowFocused()) {
-        if (ImGui::IsKeyReleased(ImGuiKey_Space))
-            paused = !paused;
-        if (ImGui::IsKeyReleased(ImGuiKey_M))
-            sink->muted = !sink->muted;
-        framestep = ImGui::IsKeyPressed(ImGuiKey_Period, true);
-        if (framestep)
-            paused = true;
-        if (ImGui::IsKeyDown(ImGuiKey_Q) && ImGui::GetIO().KeyShift) {
-            show_abuffersink_window = false;
-            show_buffersink_window = false;
-            filter_graph_is_valid = false;
+            requested.clear();
+            for (unsigned i = 0; i < sinks.size(); i++) {
+                if (sinks[i]->ready == false || eof[i])
+                    continue;
+                sinks[i]->ready = false;
+                requested.push_back(std::make_pair(sinks[i], av_gettime_relative()));
+            }
         }
-        if (ImGui::IsKeyReleased(ImGuiKey_O))
-            sink->show_osd = !sink->show_osd;
-    }
 
-    if (ImGui::IsKeyDown((ImGuiKey)(ImGuiKey_0 + sink->id)) && ImGui::GetIO().KeyAlt)
-        focus_abuffersink_window = sink->id;
+        while (requested.size() > 0) {
+            for (unsigned i = 0; i < requested.size();) {
+                BufferSink *sink = requested[i].first;
+
+                if (sink_wants_frame(sink)) {
+                    if (!filter_frame)
+                        filter_frame = get_recycled_frame(sink);
+                    if (!filter_frame)
+                        goto end;
+
+                    trace_start = trace_begin();
+                    filtergraph_mutex.lock();
+                    ret = av_buffersink_get_frame_flags(sink->ctx, filter_frame, AV_BUFFERSINK_FLAG_NO_REQUEST);
+                    filtergraph_mutex.unlock();
+                    trace_end("graph pull", trace_start, sink);
+                    if (ret == AVERROR(EAGAIN)) {
+                        i++;
+                        continue;
+                    }
 
-    ImVec2 window_size = { audio_window_size[0], audio_window_size[1] };
-    ImGui::PlotLines("##Audio Samples", sink->samples, sink->nb_samples, 0, NULL, -audio_sample_range[0], audio_sample_range[1], window_size);
-    if (sink->show_osd) {
-        ImGui::Text("FRAME: %ld", sink->frame_number);
-        ImGui::Text("SIZE:  %d", sink->frame_nb_samples);
-        ImGui::Text("TIME:  %.5f", sink->pts != AV_NOPTS_VALUE ? av_q2d(sink->time_base) * sink->pts : NAN);
-        ImGui::Text("SPEED: %011.5f", sink->speed);
-        alGetSourcei(sink->source, AL_BUFFERS_QUEUED, &queued);
-        ImGui::Text("POS:   %ld", sink->pos);
-        ImGui::Text("QUEUE: %d", queued);
+                    if (ret >= 0) {
+                        const int64_t end = av_gettime_relative();
+                        const int64_t start = requested[i].second;
+
+                        if (end > start)
+                            sink->speed = 1000000. * (std::max(filter_frame->nb_samples, 1)) * av_q2d(av_inv_q(sink->frame_rate)) / (end - start);
+                        if (sink_enqueue_frame(sink, &filter_frame) < 0)
+                            av_frame_free(&filter_frame);
+                        filter_frame = NULL;
+                        requested[i].second = end;
+                        if (sink_wants_frame(sink))
+                            continue;
+                    } else {
+                        eof[std::find(sinks.begin(), sinks.end(), sink) - sinks.begin()] = true;
+                    }
+                }
+
+                requested.erase(requested.begin() + i);
+            }
+
+            filtergraph_mutex.lock();
+            for (unsigned i = 0; i < detached.size(); i++) {
+                AVFrame *frame = av_frame_alloc();
+
+                if (!frame)
+                    break;
+                while (av_buffersink_get_frame_flags(detached[i], frame, AV_BUFFERSINK_FLAG_NO_REQUEST) >= 0)
+                    av_frame_unref(frame);
+                av_frame_free(&frame);
+            }
+            drain_tap_previews();
+            filtergraph_mutex.unlock();
+
+            if (requested.size() == 0 || graph_eof)
+                break;
+
+            trace_start = trace_begin();
+            filtergraph_mutex.lock();
+            ret = avfilter_graph_request_oldest(filter_graph);
+            filtergraph_mutex.unlock();
+            trace_end("graph request", trace_start, NULL);
+            if (ret == AVERROR(EAGAIN))
+                break;
+            if (ret == AVERROR_EOF) {
+                graph_eof = true;
+                continue;
+            }
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot request frame from filter graph.\n");
+                goto end;
+            }
+        }
     }
-    if (ImGui::DragFloat("Gain", &sink->gain, 0.01f, 0.f, 2.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
-        alSourcef(sink->source, AL_GAIN, sink->gain);
-    if (ImGui::DragFloat3("Position", sink->position, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
-        alSource3f(sink->source, AL_POSITION, sink->position[0], sink->position[1], sink->position[2]);
 
-    ImGui::End();
+end:
+    av_frame_free(&filter_frame);
 }
 
-static void queue_sound(AVFrame *frame, BufferSink *sink)
+static void kill_graph_driver_thread()
 {
-    ALint processed = 0;
+    if (!graph_driver_thread.joinable())
+        return;
 
-    alSourcef(sink->source, AL_GAIN, sink->gain * !sink->muted);
+    { std::lock_guard lk(graph_driver_mutex); graph_driver_stop = true; }
+    graph_driver_cv.notify_one();
+    graph_driver_thread.join();
+    graph_driver_stop = false;
+    graph_driver_ready = false;
+}
 
-    alGetSourcei(sink->source, AL_BUFFERS_PROCESSED, &processed);
-    while (processed > 0 && (!paused || framestep)) {
-        ALuint bufid;
+static void start_graph_driver_thread()
+{
+    std::vector<BufferSink *> sinks;
+    std::vector<AVFilterContext *> detached;
 
-        alSourceUnqueueBuffers(sink->source, 1, &bufid);
-        processed--;
+    kill_graph_driver_thread();
 
-        sink->processed_bufids.push_back(bufid);
+    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+        if (buffer_sinks[i].consume_frames.capacity > 0)
+            sinks.push_back(&buffer_sinks[i]);
+        else
+            detached.push_back(buffer_sinks[i].ctx);
     }
 
-    if (sink->processed_bufids.size() > 0 && frame->nb_samples > 0) {
-        ALuint bufid = sink->processed_bufids.back();
+    for (unsigned i = 0; i < abuffer_sinks.size(); i++) {
+        if (abuffer_sinks[i].consume_frames.capacity > 0)
+            sinks.push_back(&abuffer_sinks[i]);
+        else
+            detached.push_back(abuffer_sinks[i].ctx);
+    }
 
-        sink->processed_bufids.pop_back();
-        alBufferData(bufid, sink->format, frame->extended_data[0],
-                     (ALsizei)frame->nb_samples * sizeof(float), frame->sample_rate);
-        alSourceQueueBuffers(sink->source, 1, &bufid);
-        frame->nb_samples = 0;
-    } else if (sink->unprocessed_bufids.size() > 0 && frame->nb_samples > 0) {
-        ALuint bufid = sink->unprocessed_bufids.back();
+    if (sinks.size() == 0)
+        return;
 
-        sink->unprocessed_bufids.pop_back();
-        alBufferData(bufid, sink->format, frame->extended_data[0],
-                     (ALsizei)frame->nb_samples * sizeof(float), frame->sample_rate);
-        alSourceQueueBuffers(sink->source, 1, &bufid);
-        frame->nb_samples = 0;
-    }
+    std::thread new_graph_driver_thread(graph_driver, sinks, detached);
+    graph_driver_thread.swap(new_graph_driver_thread);
 }
 
-static bool query_ranges(void *obj, const AVOption *opt,
-                         double *min, double *max)
+static void request_sink_frame(BufferSink *sink, std::mutex *mutex, std::condition_variable *cv)
 {
-    switch (opt->type) {
-        case AV_OPT_TYPE_INT:
-        case AV_OPT_TYPE_INT64:
-        case AV_OPT_TYPE_UINT64:
-        case AV_OPT_TYPE_DOUBLE:
-        case AV_OPT_TYPE_FLOAT:
-        case AV_OPT_TYPE_RATIONAL:
-        case AV_OPT_TYPE_BOOL:
-        case AV_OPT_TYPE_FLAGS:
-        case AV_OPT_TYPE_DURATION:
-            *min = opt->min;
-            *max = opt->max;
-            break;
-        default:
-            break;
+    if (graph_driver_active) {
+        { std::lock_guard lk(graph_driver_mutex); sink->ready = true; graph_driver_ready = true; }
+        graph_driver_cv.notify_one();
+    } else {
+        { std::lock_guard lk(*mutex); sink->ready = true; }
+        cv->notify_one();
     }
-
-    return true;
 }
 
-static bool is_simple_filter(const AVFilter *filter)
+static void kill_audio_sink_threads()
 {
-    if (avfilter_filter_pad_count(filter, 0) == 1 &&
-        avfilter_filter_pad_count(filter, 1) == 1)
-        return true;
-    return false;
-}
+    kill_graph_driver_thread();
 
-static bool is_simple_audio_filter(const AVFilter *filter)
-{
-    if (is_simple_filter(filter) &&
-        avfilter_pad_get_type(filter->inputs,  0) == AVMEDIA_TYPE_AUDIO &&
-        avfilter_pad_get_type(filter->outputs, 0) == AVMEDIA_TYPE_AUDIO) {
-        return true;
+    for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
+        BufferSink *sink = &abuffer_sinks[i];
+
+        if (audio_sink_threads[i].joinable()) {
+            { std::lock_guard lk(amutexes[i]); sink->ready = true; }
+            acv[i].notify_one();
+            audio_sink_threads[i].join();
+        }
+
+        clear_ring_buffer(&sink->consume_frames);
+        clear_ring_buffer(&sink->render_frames);
+        clear_ring_buffer(&sink->purge_frames);
+        ring_buffer_free(&sink->consume_frames);
+        ring_buffer_free(&sink->render_frames);
+        ring_buffer_free(&sink->purge_frames);
+
+        close_shm_export(sink);
+        av_freep(&sink->label);
+        av_freep(&sink->samples);
+        av_freep(&sink->spectrum);
+        av_freep(&sink->tx_history);
+        av_freep(&sink->tx_window);
+        av_freep(&sink->tx_in);
+        av_freep(&sink->tx_out);
+        av_tx_uninit(&sink->tx);
+        av_buffer_pool_uninit(&sink->analysis_pool);
+        if (headless)
+            continue;
+        glDeleteTextures(1, &sink->spectrogram_texture);
+        alDeleteSources(1, &sink->source);
+        alDeleteBuffers(AL_BUFFERS, sink->buffers);
     }
-    return false;
 }
 
-static bool is_simple_video_filter(const AVFilter *filter)
+static void kill_video_sink_threads()
 {
-    if (is_simple_filter(filter) &&
-        avfilter_pad_get_type(filter->inputs,  0) == AVMEDIA_TYPE_VIDEO &&
-        avfilter_pad_get_type(filter->outputs, 0) == AVMEDIA_TYPE_VIDEO) {
-        return true;
+    kill_graph_driver_thread();
+
+    for (unsigned i = 0; i < video_sink_threads.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+
+        if (video_sink_threads[i].joinable()) {
+            { std::lock_guard lk(mutexes[i]); sink->ready = true; }
+            cv[i].notify_one();
+            video_sink_threads[i].join();
+        }
+
+        clear_ring_buffer(&sink->consume_frames);
+        clear_ring_buffer(&sink->render_frames);
+        clear_ring_buffer(&sink->purge_frames);
+        ring_buffer_free(&sink->consume_frames);
+        ring_buffer_free(&sink->render_frames);
+        ring_buffer_free(&sink->purge_frames);
+
+        close_shm_export(sink);
+        av_freep(&sink->label);
+        clear_frame_cache(sink);
+        if (headless)
+            continue;
+        glDeleteTextures(1, &sink->texture);
+        glDeleteTextures(3, sink->plane_textures);
+        glDeleteFramebuffers(1, &sink->framebuffer);
+        glDeleteBuffers(IM_ARRAYSIZE(sink->pixel_buffers), sink->pixel_buffers);
+        glDeleteTextures(1, &sink->scope_accum);
+        glDeleteTextures(1, &sink->scope_texture);
     }
-    return false;
 }
 
-static bool is_source_filter(const AVFilter *filter)
+static ProfileCounter *find_profile_counter(ProfileCounters *counters, const AVFilterContext *ctx)
 {
-    if ((avfilter_filter_pad_count(filter, 0)  > 0  ||  (filter->flags & AVFILTER_FLAG_DYNAMIC_INPUTS)) ||
-        (avfilter_filter_pad_count(filter, 1) == 0  && !(filter->flags & AVFILTER_FLAG_DYNAMIC_OUTPUTS))) {
-        return false;
-    }
+    ProfileCounters::iterator it;
 
-    return true;
+    if (!counters || !ctx)
+        return NULL;
+
+    it = std::lower_bound(counters->begin(), counters->end(), ctx,
+                          [](const std::pair<const AVFilterContext *, ProfileCounter> &entry, const AVFilterContext *ctx) {
+                              return std::less<const AVFilterContext *>()(entry.first, ctx);
+                          });
+    if (it == counters->end() || it->first != ctx)
+        return NULL;
+
+    return &it->second;
 }
 
-static bool is_sink_filter(const AVFilter *filter)
+static int profile_execute(AVFilterContext *ctx, avfilter_action_func *func, void *arg, int *ret, int nb_jobs)
 {
-    if ((avfilter_filter_pad_count(filter, 0)  > 0  ||  (filter->flags & AVFILTER_FLAG_DYNAMIC_INPUTS)) &&
-        (avfilter_filter_pad_count(filter, 1) == 0  && !(filter->flags & AVFILTER_FLAG_DYNAMIC_OUTPUTS))) {
-        return true;
+    const int64_t start = av_gettime_relative();
+    ProfileCounter *counter;
+    int64_t end;
+
+    for (int i = 0; i < nb_jobs; i++) {
+        const int r = func(ctx, arg, i, nb_jobs);
+
+        if (ret)
+            ret[i] = r;
     }
 
-    return false;
+    end = av_gettime_relative();
+    counter = find_profile_counter((ProfileCounters *)ctx->graph->opaque, ctx);
+    if (counter) {
+        __atomic_add_fetch(&counter->time, end - start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counter->calls, 1, __ATOMIC_RELAXED);
+    }
+
+    return 0;
 }
 
-static bool is_source_audio_filter(const AVFilter *filter)
+static int build_graph_index(GraphIndex *index)
 {
-    if (is_source_filter(filter)) {
-        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 1); i++) {
-            if (avfilter_pad_get_type(filter->outputs, i) != AVMEDIA_TYPE_AUDIO)
-                return false;
-        }
+    int ret = 0;
 
-        return true;
+    index->node_links.assign(filter_nodes.size(), std::vector<unsigned>());
+    index->edge2link.clear();
+    index->edge2link.reserve(filter_links.size() * 2);
+
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const std::pair<int, int> p = filter_links[i];
+
+        if ((unsigned)p.first >= edge2pad.size() ||
+            (unsigned)p.second >= edge2pad.size())
+            continue;
+
+        const unsigned a = edge2pad[p.first].node;
+        const unsigned b = edge2pad[p.second].node;
+        const int in_edge = edge2pad[p.first].is_output ? p.second : p.first;
+        const int out_edge = edge2pad[p.first].is_output ? p.first : p.second;
+
+        if (a < filter_nodes.size())
+            index->node_links[a].push_back(i);
+        if (b < filter_nodes.size() && b != a)
+            index->node_links[b].push_back(i);
+
+        if (!index->edge2link.emplace(in_edge, i).second)
+            ret = AVERROR(EINVAL);
+        index->edge2link.emplace(out_edge, i);
     }
 
-    return false;
+    return ret;
 }
 
-static bool is_source_video_filter(const AVFilter *filter)
+static void erase_links(const std::vector<bool> &dead_links)
 {
-    if (is_source_filter(filter)) {
-        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 1); i++) {
-            if (avfilter_pad_get_type(filter->outputs, i) != AVMEDIA_TYPE_VIDEO)
-                return false;
-        }
+    unsigned nb_links = 0;
 
-        return true;
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const std::pair<int, int> p = filter_links[i];
+
+        if (dead_links[i]) {
+            edge2pad[p.first].removed    = true;
+            edge2pad[p.second].removed   = true;
+            edge2pad[p.first].is_output  = false;
+            edge2pad[p.second].is_output = false;
+            continue;
+        }
+
+        filter_links[nb_links++] = p;
     }
 
-    return false;
+    filter_links.resize(nb_links);
 }
 
-static bool is_source_media_filter(const AVFilter *filter)
+static int get_nb_filter_threads(const AVFilter *filter)
 {
-    if (is_source_filter(filter) && !is_source_audio_filter(filter) && !is_source_video_filter(filter))
-        return true;
-    return false;
+    if (filter->flags & AVFILTER_FLAG_SLICE_THREADS)
+        return 0;
+    return 1;
 }
 
-static bool is_sink_audio_filter(const AVFilter *filter)
+static ALenum get_al_format(int nb_channels)
 {
-    if (is_sink_filter(filter)) {
-        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 0); i++) {
-            if (avfilter_pad_get_type(filter->inputs, i) != AVMEDIA_TYPE_AUDIO)
-                return false;
-        }
-
-        return true;
+    switch (nb_channels) {
+    case 2: return AL_FORMAT_STEREO_FLOAT32;
+    case 4: return AL_FORMAT_QUAD32;
+    case 6: return AL_FORMAT_51CHN32;
+    case 7: return AL_FORMAT_61CHN32;
+    case 8: return AL_FORMAT_71CHN32;
+    default: return AL_FORMAT_MONO_FLOAT32;
     }
+}
 
-    return false;
+typedef struct GraphBuildLink {
+    AVFilterContext *src;
+    unsigned src_pad;
+    AVFilterContext *dst;
+    unsigned dst_pad;
+} GraphBuildLink;
+
+typedef struct GraphBuild {
+    AVFilterGraph *graph;
+    AVBufferRef *hw_device_ctx;
+    int hw_device_type;
+    char hw_device_name[256];
+    std::vector<AVFilterContext *> ctxs;
+    std::vector<GraphBuildLink> links;
+    std::vector<TapPreview> taps;
+    ProfileCounters *profile_counters;
+    char *graphdump_text;
+    bool profiling;
+    bool finished;
+    int ret;
+} GraphBuild;
+
+GraphBuild graph_build = { 0 };
+GraphBuild autotune_build = { 0 };
+std::thread graph_build_thread;
+bool graph_build_running = false;
+
+static void free_graph_build(GraphBuild *build)
+{
+    avfilter_graph_free(&build->graph);
+    delete build->profile_counters;
+    build->profile_counters = NULL;
+    av_buffer_unref(&build->hw_device_ctx);
+    av_freep(&build->graphdump_text);
+    build->ctxs.clear();
+    build->links.clear();
+    build->taps.clear();
+    build->finished = false;
+    build->ret = 0;
 }
 
-static bool is_sink_video_filter(const AVFilter *filter)
+static AVFilterContext *alloc_tap_filter(AVFilterGraph *graph, const char *filter_name, unsigned node,
+                                         const char *key, const char *value)
 {
-    if (is_sink_filter(filter)) {
-        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 0); i++) {
-            if (avfilter_pad_get_type(filter->inputs, i) != AVMEDIA_TYPE_VIDEO)
-                return false;
-        }
+    char name[128];
+    AVFilterContext *ctx;
 
-        return true;
-    }
+    snprintf(name, sizeof(name), "tap%u_%s", node, filter_name);
+    ctx = avfilter_graph_alloc_filter(graph, avfilter_get_by_name(filter_name), name);
+    if (ctx && key && av_opt_set(ctx, key, value, AV_OPT_SEARCH_CHILDREN) < 0)
+        return NULL;
 
-    return false;
+    return ctx;
 }
 
-static bool is_media_filter(const AVFilter *filter)
+static bool filter_outputs_hw_frames(const AVFilter *filter)
 {
-    if (is_simple_filter(filter) &&
-        avfilter_pad_get_type(filter->inputs, 0) !=
-        avfilter_pad_get_type(filter->outputs, 0)) {
+    static const char *const suffixes[] = { "_vaapi", "_cuda", "_npp", "_qsv", "_vulkan", "_opencl",
+                                            "_videotoolbox", "_d3d11", "_amf" };
+    const size_t len = strlen(filter->name);
+
+    if (!strncmp(filter->name, "hwupload", 8) || !strcmp(filter->name, "hwmap"))
         return true;
+    for (unsigned i = 0; i < IM_ARRAYSIZE(suffixes); i++) {
+        const size_t suffix_len = strlen(suffixes[i]);
+
+        if (len > suffix_len && !strcmp(filter->name + len - suffix_len, suffixes[i]))
+            return true;
     }
 
     return false;
 }
 
-static bool is_complex_filter(const AVFilter *filter)
+/* Marks nodes that output hardware frames, either themselves or by passing
+ * through frames of an upstream hardware filter, until a hwdownload. */
+static void find_hw_frame_nodes(std::vector<bool> &hw_nodes)
 {
-    if (!is_sink_filter(filter) && !is_source_filter(filter) && !is_simple_filter(filter))
-        return true;
-    return false;
-}
+    bool changed = true;
 
-static void handle_nodeitem(const AVFilter *filter, ImVec2 click_pos)
-{
-    if (ImGui::MenuItem(filter->name))
-        add_filter_node(filter, click_pos);
+    hw_nodes.assign(filter_nodes.size(), false);
+    for (unsigned i = 0; i < filter_nodes.size(); i++)
+        hw_nodes[i] = filter_outputs_hw_frames(filter_nodes[i].filter);
 
-    if (ImGui::IsItemHovered())
-        ImGui::SetTooltip("%s", filter->description);
+    for (unsigned pass = 0; changed && pass < filter_nodes.size(); pass++) {
+        changed = false;
+        for (unsigned i = 0; i < filter_links.size(); i++) {
+            const std::pair<int, int> p = filter_links[i];
+            unsigned src, dst;
+
+            if ((unsigned)p.first >= edge2pad.size() || (unsigned)p.second >= edge2pad.size())
+                continue;
+            src = edge2pad[edge2pad[p.first].is_output ? p.first : p.second].node;
+            dst = edge2pad[edge2pad[p.first].is_output ? p.second : p.first].node;
+            if (src >= filter_nodes.size() || dst >= filter_nodes.size() || !hw_nodes[src] || hw_nodes[dst] ||
+                !strcmp(filter_nodes[dst].filter->name, "hwdownload"))
+                continue;
+            hw_nodes[dst] = true;
+            changed = true;
+        }
+    }
 }
 
-static void draw_options(FilterNode *node, void *av_class)
+static int prepare_tap_previews(GraphBuild *build)
 {
-    const AVOption *opt = NULL;
-    const void *obj = av_class;
-    int last_offset = -1;
-    double min, max;
-    int index = 0;
+    static const enum AVPixelFormat tap_pix_fmts[] = { AV_PIX_FMT_RGBA, AV_PIX_FMT_NONE };
+    std::vector<bool> hw_nodes;
+    unsigned nb_taps = 0;
+    char value[64];
 
-    while ((opt = av_opt_next(obj, opt))) {
-        if (last_offset == opt->offset)
-            continue;
-        last_offset = opt->offset;
-        if (!query_ranges((void *)obj, opt, &min, &max))
+    find_hw_frame_nodes(hw_nodes);
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        nb_taps += filter_nodes[i].tap_pad >= 0 && !hw_nodes[i];
+        if (filter_nodes[i].tap_pad >= 0 && hw_nodes[i])
+            av_log(NULL, AV_LOG_WARNING, "Cannot tap hardware frames of %s.\n", filter_nodes[i].filter_label);
+    }
+    if (nb_taps == 0)
+        return 0;
+
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        const unsigned pad = filter_nodes[i].tap_pad;
+        AVFilterContext *src = build->ctxs[i];
+        AVFilterContext *split = NULL, *fps, *scale, *sink;
+        TapPreview tap = { 0 };
+
+        if (filter_nodes[i].tap_pad < 0 || hw_nodes[i])
             continue;
-        switch (opt->type) {
-            case AV_OPT_TYPE_INT64:
-                {
-                    int64_t value;
-                    int64_t smin = min;
-                    int64_t smax = max;
-                    if (av_opt_get_int(av_class, opt->name, 0, &value))
-                        break;
-                    if (ImGui::DragScalar(opt->name, ImGuiDataType_S64, &value, 1, &smin, &smax, "%ld", ImGuiSliderFlags_AlwaysClamp)) {
-                        av_opt_set_int(av_class, opt->name, value, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_UINT64:
-                {
-                    int64_t value;
-                    uint64_t uvalue;
-                    uint64_t umin = min;
-                    uint64_t umax = max;
-                    if (av_opt_get_int(av_class, opt->name, 0, &value))
-                        break;
-                    uvalue = value;
-                    if (ImGui::DragScalar(opt->name, ImGuiDataType_U64, &value, 1, &umin, &umax, "%lu", ImGuiSliderFlags_AlwaysClamp)) {
-                        value = uvalue;
-                        av_opt_set_int(av_class, opt->name, value, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_DURATION:
-                {
-                    int64_t value;
-                    double dvalue;
-                    if (av_opt_get_int(av_class, opt->name, 0, &value))
-                        break;
-                    dvalue = value / 1000000.0;
-                    if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &dvalue, 0.1f, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
-                        value = dvalue * 1000000.0;
-                        av_opt_set_int(av_class, opt->name, value, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_FLAGS:
-            case AV_OPT_TYPE_BOOL:
-                {
-                    int64_t value;
-                    int ivalue;
-                    int imin = min;
-                    int imax = max;
-                    if (av_opt_get_int(av_class, opt->name, 0, &value))
-                        break;
-                    ivalue = value;
-                    if (imax < INT_MAX/2 && imin > INT_MIN/2) {
-                        if (ImGui::SliderInt(opt->name, &ivalue, imin, imax)) {
-                            value = ivalue;
-                            av_opt_set_int(av_class, opt->name, value, 0);
-                        }
-                    } else {
-                        if (ImGui::DragInt(opt->name, &ivalue, imin, imax, ImGuiSliderFlags_AlwaysClamp)) {
-                            value = ivalue;
-                            av_opt_set_int(av_class, opt->name, value, 0);
-                        }
-                    }
 
-                    if (opt->unit) {
-                        char combo_name[20];
+        for (unsigned j = 0; j < build->links.size(); j++) {
+            GraphBuildLink *link = &build->links[j];
 
-                        snprintf(combo_name, sizeof(combo_name), "##%s", opt->unit);
-                        if (ImGui::BeginCombo(combo_name, 0, 0)) {
-                            const AVOption *copt = NULL;
+            if (link->src != src || link->src_pad != pad)
+                continue;
 
-                            while ((copt = av_opt_next(obj, copt))) {
-                                const bool is_selected = value == copt->default_val.i64;
+            split = alloc_tap_filter(build->graph, "split", i, NULL, NULL);
+            if (!split)
+                return AVERROR(ENOMEM);
+            build->links.push_back(GraphBuildLink { split, 0, link->dst, link->dst_pad });
+            link->dst = split;
+            link->dst_pad = 0;
+            break;
+        }
 
-                                if (!copt->unit)
-                                    continue;
-                                if (strcmp(copt->unit, opt->unit) || copt->type != AV_OPT_TYPE_CONST)
-                                    continue;
+        snprintf(value, sizeof(value), "%d/%u", std::max(tap_updates_per_second, 1), nb_taps);
+        fps = alloc_tap_filter(build->graph, "fps", i, "fps", value);
+        snprintf(value, sizeof(value), "%d", tap_width);
+        scale = alloc_tap_filter(build->graph, "scale", i, "w", value);
+        sink = alloc_tap_filter(build->graph, "buffersink", i, NULL, NULL);
+        if (!fps || !scale || !sink ||
+            av_opt_set(scale, "h", "-2", AV_OPT_SEARCH_CHILDREN) < 0 ||
+            av_opt_set(scale, "flags", "fast_bilinear", AV_OPT_SEARCH_CHILDREN) < 0 ||
+            av_opt_set_int_list(sink, "pix_fmts", tap_pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create tap preview for %s.\n", filter_nodes[i].filter_label);
+            return AVERROR(ENOMEM);
+        }
 
-                                if (ImGui::Selectable(copt->name, is_selected))
-                                    av_opt_set_int(av_class, opt->name, copt->default_val.i64, 0);
-                                ImGui::SameLine();
-                                ImGui::Text("\t\t%s", copt->help);
+        if (split)
+            build->links.push_back(GraphBuildLink { split, 1, fps, 0 });
+        else
+            build->links.push_back(GraphBuildLink { src, pad, fps, 0 });
+        build->links.push_back(GraphBuildLink { fps, 0, scale, 0 });
+        build->links.push_back(GraphBuildLink { scale, 0, sink, 0 });
 
-                                if (is_selected)
-                                    ImGui::SetItemDefaultFocus();
-                            }
+        tap.node = i;
+        tap.ctx = sink;
+        build->taps.push_back(tap);
+    }
 
-                            ImGui::EndCombo();
-                        }
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_INT:
-                {
-                    int64_t value;
-                    int ivalue;
-                    int imin = min;
-                    int imax = max;
-                    if (av_opt_get_int(av_class, opt->name, 0, &value))
-                        break;
-                    ivalue = value;
-                    if (imax < INT_MAX/2 && imin > INT_MIN/2) {
-                        if (ImGui::SliderInt(opt->name, &ivalue, imin, imax)) {
-                            value = ivalue;
-                            av_opt_set_int(av_class, opt->name, value, 0);
-                        }
-                    } else {
-                        if (ImGui::DragInt(opt->name, &ivalue, imin, imax, ImGuiSliderFlags_AlwaysClamp)) {
-                            value = ivalue;
-                            av_opt_set_int(av_class, opt->name, value, 0);
-                        }
-                    }
+    return 0;
+}
 
-                    if (opt->unit) {
-                        char combo_name[20];
+static int prepare_graph_build(GraphBuild *build, int nb_threads, bool taps)
+{
+    const AVFilter *new_filter;
+    int ret;
 
-                        snprintf(combo_name, sizeof(combo_name), "##%s", opt->unit);
-                        if (ImGui::BeginCombo(combo_name, 0, 0)) {
-                            const AVOption *copt = NULL;
+    free_graph_build(build);
 
-                            while ((copt = av_opt_next(obj, copt))) {
-                                const bool is_selected = value == copt->default_val.i64;
+    build->graph = avfilter_graph_alloc();
+    if (!build->graph) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot allocate filter graph.\n");
+        return AVERROR(ENOMEM);
+    }
 
-                                if (!copt->unit)
-                                    continue;
-                                if (strcmp(copt->unit, opt->unit) || copt->type != AV_OPT_TYPE_CONST)
-                                    continue;
+    build->graph->nb_threads = nb_threads;
+    avfilter_graph_set_auto_convert(build->graph, filter_graph_auto_convert_flags);
+    if (filter_graph_profiling)
+        build->graph->execute = profile_execute;
+    build->profiling = filter_graph_profiling;
+    build->hw_device_type = hw_device_type;
+    av_strlcpy(build->hw_device_name, hw_device_name, sizeof(build->hw_device_name));
 
-                                if (ImGui::Selectable(copt->name, is_selected))
-                                    av_opt_set_int(av_class, opt->name, copt->default_val.i64, 0);
-                                ImGui::SameLine();
-                                ImGui::Text("\t\t%s", copt->help);
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        AVFilterContext *filter_ctx;
 
-                                if (is_selected)
-                                    ImGui::SetItemDefaultFocus();
-                            }
+        new_filter = filter_nodes[i].filter;
+        if (!new_filter) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot [%d] get filter by name: %s.\n", i, filter_nodes[i].filter_name);
+            return AVERROR(ENOSYS);
+        }
 
-                            ImGui::EndCombo();
-                        }
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_DOUBLE:
-                {
-                    double value;
+        filter_ctx = avfilter_graph_alloc_filter(build->graph, new_filter, filter_nodes[i].filter_label);
+        if (!filter_ctx) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot allocate filter context.\n");
+            return AVERROR(ENOMEM);
+        }
 
-                    if (av_opt_get_double(av_class, opt->name, 0, &value))
-                        break;
-                    if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &value, 1.0, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
-                        av_opt_set_double(av_class, opt->name, value, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_FLOAT:
-                {
-                    double value;
-                    float fvalue;
-                    float fmin = min;
-                    float fmax = max;
+        av_opt_set_defaults(filter_ctx);
+        filter_ctx->nb_threads = get_nb_filter_threads(new_filter);
 
-                    if (av_opt_get_double(av_class, opt->name, 0, &value))
-                        break;
-                    fvalue = value;
-                    if (ImGui::DragFloat(opt->name, &fvalue, 1.f, fmin, fmax, "%f", ImGuiSliderFlags_AlwaysClamp)) {
-                        value = fvalue;
-                        av_opt_set_double(av_class, opt->name, value, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_STRING:
-                {
-                    char new_str[1024] = {0};
-                    uint8_t *str = NULL;
+        if (!strcmp(filter_ctx->filter->name, "buffersink")) {
+            ret = av_opt_set_int_list(filter_ctx, "pix_fmts",
+                                      build->hw_device_type != AV_HWDEVICE_TYPE_NONE && gpu_color_conversion ? hw_pix_fmts :
+                                      gpu_color_conversion ? gpu_pix_fmts : pix_fmts,
+                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot set buffersink output pixel format.\n");
+                return ret;
+            }
+        } else if (!strcmp(filter_ctx->filter->name, "abuffersink")) {
+            ret = av_opt_set_int_list(filter_ctx, "sample_fmts", sample_fmts,
+                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot set abuffersink output sample formats.\n");
+                return ret;
+            }
 
-                    if (av_opt_get(av_class, opt->name, 0, &str))
-                        break;
-                    if (str) {
-                        memcpy(new_str, str, strlen((const char *)str));
-                        av_freep(&str);
-                    }
-                    if (ImGui::InputText(opt->name, new_str, IM_ARRAYSIZE(new_str))) {
-                        av_opt_set(av_class, opt->name, new_str, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_RATIONAL:
-                {
-                    AVRational rate = (AVRational){ 0, 0 };
-                    int irate[2] = { 0, 0 };
+            ret = av_opt_set(filter_ctx, "ch_layouts", al_multichannel_formats ?
+                             "mono|stereo|quad|5.1|5.1(side)|6.1|7.1" : "mono|stereo", AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot set abuffersink output channel layouts.\n");
+                return ret;
+            }
 
-                    if (rate.num == 0 && rate.den == 0)
-                        av_opt_get_q(av_class, opt->name, 0, &rate);
-                    irate[0] = rate.num;
-                    irate[1] = rate.den;
-                    if (ImGui::DragInt2(opt->name, irate, 1, -8192, 8192)) {
-                        rate.num = irate[0];
-                        rate.den = irate[1];
-                        av_opt_set_q(av_class, opt->name, rate, 0);
-                    }
+            if (resample_audio_outputs) {
+                sample_rates[0] = output_sample_rate;
+                ret = av_opt_set_int_list(filter_ctx, "sample_rates", sample_rates,
+                                          0, AV_OPT_SEARCH_CHILDREN);
+                if (ret < 0) {
+                    av_log(NULL, AV_LOG_ERROR, "Cannot set abuffersink output sample rates.\n");
+                    return ret;
                 }
-                break;
-            case AV_OPT_TYPE_BINARY:
-                break;
-            case AV_OPT_TYPE_DICT:
-                break;
-            case AV_OPT_TYPE_IMAGE_SIZE:
-                {
-                    int size[2] = {0,0};
+            }
+        }
 
-                    av_opt_get_image_size(av_class, opt->name, 0, &size[0], &size[1]);
-                    if (ImGui::DragInt2(opt->name, size, 1, 1, 4096)) {
-                        av_opt_set_image_size(av_class, opt->name, size[0], size[1], 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_VIDEO_RATE:
-                {
-                    int irate[2] = { 0, 0 };
-                    uint8_t *old_rate_str = NULL;
-                    char rate_str[256];
-
-                    av_opt_get(av_class, opt->name, 0, &old_rate_str);
-                    if (old_rate_str) {
-                        sscanf((const char *)old_rate_str, "%d/%d", &irate[0], &irate[1]);
-                        av_freep(&old_rate_str);
-                    }
-                    if (ImGui::DragInt2(opt->name, irate, 1, -8192, 8192)) {
-                        snprintf(rate_str, sizeof(rate_str), "%d/%d", irate[0], irate[1]);
-                        av_opt_set(av_class, opt->name, rate_str, 0);
-                    }
-                }
-                break;
-            case AV_OPT_TYPE_PIXEL_FMT:
-                if (ImGui::BeginCombo("pixel format", 0, 0)) {
-                    const AVPixFmtDescriptor *pix_desc = NULL;
-                    AVPixelFormat fmt;
-
-                    av_opt_get_pixel_fmt(av_class, opt->name, 0, &fmt);
-                    while ((pix_desc = av_pix_fmt_desc_next(pix_desc))) {
-                        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(pix_desc);
-                        const bool is_selected = av_pix_fmt_desc_get_id(pix_desc) == fmt;
+        if (filter_nodes[i].probe) {
+            av_freep(&filter_nodes[i].ctx_options);
+            ret = av_opt_serialize(filter_nodes[i].probe, 0, AV_OPT_SERIALIZE_SKIP_DEFAULTS,
+                                   &filter_nodes[i].ctx_options, '=', ':');
+            if (ret < 0)
+                av_log(NULL, AV_LOG_WARNING, "Cannot serialize filter ctx options.\n");
+        }
 
-                        if (ImGui::Selectable(pix_desc->name, is_selected))
-                            av_opt_set_pixel_fmt(av_class, opt->name, pix_fmt, 0);
+        if (filter_nodes[i].probe) {
+            av_freep(&filter_nodes[i].filter_options);
+            ret = av_opt_serialize(filter_nodes[i].probe->priv, AV_OPT_FLAG_FILTERING_PARAM, AV_OPT_SERIALIZE_SKIP_DEFAULTS,
+                                   &filter_nodes[i].filter_options, '=', ':');
+            if (ret < 0)
+                av_log(NULL, AV_LOG_WARNING, "Cannot serialize filter private options.\n");
+        }
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
-                break;
-            case AV_OPT_TYPE_SAMPLE_FMT:
-                break;
-            case AV_OPT_TYPE_COLOR:
-                {
-                    float col[4] = { 0.4f, 0.7f, 0.0f, 0.5f };
-                    unsigned icol[4] = { 0 };
-                    char new_str[16] = { 0 };
-                    uint8_t *old_str = NULL;
+        ret = av_opt_set_from_string(filter_ctx, filter_nodes[i].ctx_options, NULL, "=", ":");
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error setting filter ctx options.\n");
+            return ret;
+        }
 
-                    if (av_opt_get(av_class, opt->name, 0, &old_str))
-                        break;
-                    sscanf((const char *)old_str, "0x%02x%02x%02x%02X", &icol[0], &icol[1], &icol[2], &icol[3]);
-                    av_freep(&old_str);
-                    col[0] = icol[0] / 255.f;
-                    col[1] = icol[1] / 255.f;
-                    col[2] = icol[2] / 255.f;
-                    col[3] = icol[3] / 255.f;
-                    ImGui::PushID(index++);
-                    ImGui::ColorEdit4("color", col, ImGuiColorEditFlags_NoDragDrop);
-                    ImGui::PopID();
-                    icol[0] = col[0] * 255.f;
-                    icol[1] = col[1] * 255.f;
-                    icol[2] = col[2] * 255.f;
-                    icol[3] = col[3] * 255.f;
-                    snprintf(new_str, sizeof(new_str), "0x%02x%02x%02x%02x", icol[0], icol[1], icol[2], icol[3]);
-                    av_opt_set(av_class, opt->name, new_str, 0);
-                }
-                break;
-            case AV_OPT_TYPE_CHLAYOUT:
-                break;
-            case AV_OPT_TYPE_CONST:
-                break;
-            default:
-                break;
+        ret = av_opt_set_from_string(filter_ctx->priv, filter_nodes[i].filter_options, NULL, "=", ":");
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error setting filter private options.\n");
+            return ret;
         }
 
-        if (ImNodes::IsNodeSelected(node->edge) && ImGui::IsItemHovered() && opt->type != AV_OPT_TYPE_CONST)
-            ImGui::SetTooltip("%s", opt->help);
+        build->ctxs.push_back(filter_ctx);
     }
-}
 
-static void draw_filter_commands(const AVFilterContext *ctx, unsigned n, unsigned *toggle_filter,
-                                 bool is_opened, bool *clean_storage, bool tree)
-{
-    if (ctx->filter->process_command) {
-        if (tree == false) {
-            if (filter_nodes[n].colapsed == false && !ImGui::Button("Commands"))
-                return;
-            filter_nodes[n].colapsed = true;
-            if (filter_nodes[n].colapsed == true && ImGui::Button("Close"))
-                filter_nodes[n].colapsed = false;
+    if (build->profiling) {
+        build->profile_counters = new ProfileCounters();
+        for (unsigned i = 0; i < build->ctxs.size(); i++)
+            build->profile_counters->push_back(std::make_pair(build->ctxs[i], ProfileCounter { 0, 0 }));
+        std::sort(build->profile_counters->begin(), build->profile_counters->end(),
+                  [](const auto &a, const auto &b) { return std::less<const AVFilterContext *>()(a.first, b.first); });
+        build->graph->opaque = build->profile_counters;
+    }
+
+    if (build_graph_index(&graph_index) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot link filters: input pad connected more than once.\n");
+        return AVERROR(EINVAL);
+    }
+
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const std::pair<int, int> p = filter_links[i];
+
+        if ((unsigned)p.first >= edge2pad.size() ||
+            (unsigned)p.second >= edge2pad.size()) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: edges out of range (%d, %d) >= (%ld).\n", p.first, p.second, edge2pad.size());
+            return AVERROR(EINVAL);
         }
 
-        if (tree ? ImGui::TreeNode("Commands") : ImGui::BeginListBox("##Commands", ImVec2(200, 100))) {
-            std::vector<OptStorage> opt_storage = filter_nodes[n].opt_storage;
-            const AVOption *opt = NULL;
-            unsigned opt_index = 0;
+        Edge2Pad x = edge2pad[p.first];
+        Edge2Pad y = edge2pad[p.second];
 
-            if (is_opened && *clean_storage) {
-                opt_storage.clear();
-                *clean_storage = false;
-            }
+        if (x.node >= filter_nodes.size() || y.node >= filter_nodes.size()) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: index (%d, %d) out of range (%ld)\n",
+                   x.node, y.node, filter_nodes.size());
+            return AVERROR(EINVAL);
+        }
 
-            while ((opt = av_opt_next(ctx->priv, opt))) {
-                double min, max;
-                void *ptr;
+        if (y.is_output == true)
+            std::swap(x, y);
 
-                if (!(opt->flags & AV_OPT_FLAG_RUNTIME_PARAM))
-                    continue;
+        build->links.push_back(GraphBuildLink { build->ctxs[x.node], x.pad_index, build->ctxs[y.node], y.pad_index });
+    }
 
-                if (!query_ranges((void *)&ctx->filter->priv_class, opt, &min, &max))
-                    continue;
+    return taps ? prepare_tap_previews(build) : 0;
+}
 
-                ptr = av_opt_ptr(ctx->filter->priv_class, ctx->priv, opt->name);
-                if (!ptr)
-                    continue;
+static void graph_build_worker(GraphBuild *build)
+{
+    const int64_t trace_start = trace_begin();
+    int ret = 0;
 
-                ImGui::PushID(opt_index);
-                switch (opt->type) {
-                    case AV_OPT_TYPE_FLAGS:
-                    case AV_OPT_TYPE_BOOL:
-                    case AV_OPT_TYPE_INT:
-                    case AV_OPT_TYPE_DOUBLE:
-                    case AV_OPT_TYPE_FLOAT:
-                    case AV_OPT_TYPE_INT64:
-                    case AV_OPT_TYPE_UINT64:
-                    case AV_OPT_TYPE_STRING:
-                        if (ImGui::Button("Send")) {
-                            char arg[1024] = { 0 };
-
-                            switch (opt->type) {
-                                case AV_OPT_TYPE_FLAGS:
-                                case AV_OPT_TYPE_BOOL:
-                                case AV_OPT_TYPE_INT:
-                                    snprintf(arg, sizeof(arg) - 1, "%d", opt_storage[opt_index].u.i32);
-                                    break;
-                                case AV_OPT_TYPE_INT64:
-                                    snprintf(arg, sizeof(arg) - 1, "%ld", opt_storage[opt_index].u.i64);
-                                    break;
-                                case AV_OPT_TYPE_UINT64:
-                                    snprintf(arg, sizeof(arg) - 1, "%lu", opt_storage[opt_index].u.u64);
-                                    break;
-                                case AV_OPT_TYPE_DOUBLE:
-                                    snprintf(arg, sizeof(arg) - 1, "%f", opt_storage[opt_index].u.dbl);
-                                    break;
-                                case AV_OPT_TYPE_FLOAT:
-                                    snprintf(arg, sizeof(arg) - 1, "%f", opt_storage[opt_index].u.flt);
-                                    break;
-                                case AV_OPT_TYPE_STRING:
-                                    snprintf(arg, strlen(opt_storage[opt_index].u.str) + 1, "%s", opt_storage[opt_index].u.str);
-                                    break;
-                                default:
-                                    break;
-                            }
+    if (build->hw_device_type != AV_HWDEVICE_TYPE_NONE) {
+        ret = av_hwdevice_ctx_create(&build->hw_device_ctx, (enum AVHWDeviceType)build->hw_device_type,
+                                     build->hw_device_name[0] ? build->hw_device_name : NULL, NULL, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create %s hardware device.\n",
+                   av_hwdevice_get_type_name((enum AVHWDeviceType)build->hw_device_type));
+            goto end;
+        }
+    }
 
-                            avfilter_graph_send_command(filter_graph, ctx->name, opt->name, arg, NULL, 0, 0);
-                        }
-                        ImGui::SameLine();
-                    default:
-                        break;
-                }
+    for (unsigned i = 0; i < build->graph->nb_filters; i++) {
+        AVFilterContext *filter_ctx = build->graph->filters[i];
 
-                switch (opt->type) {
-                    case AV_OPT_TYPE_FLAGS:
-                    case AV_OPT_TYPE_BOOL:
-                        {
-                            int value = *(int *)ptr;
-                            int imin = min;
-                            int imax = max;
+        if (build->hw_device_ctx) {
+            filter_ctx->hw_device_ctx = av_buffer_ref(build->hw_device_ctx);
+            if (!filter_ctx->hw_device_ctx) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+        }
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+        ret = avfilter_init_str(filter_ctx, NULL);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot init str for filter.\n");
+            goto end;
+        }
+    }
 
-                                new_opt.u.i32 = *(int *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
+    for (unsigned i = 0; i < build->links.size(); i++) {
+        const GraphBuildLink &link = build->links[i];
 
-                            value = opt_storage[opt_index].u.i32;
-                            if (ImGui::SliderInt(opt->name, &value, imin, imax)) {
-                                opt_storage[opt_index].u.i32 = value;
-                            }
-                        }
-                        break;
-                    case AV_OPT_TYPE_INT:
-                        {
-                            int value = *(int *)ptr;
-                            int imin = min;
-                            int imax = max;
+        if ((ret = avfilter_link(link.src, link.src_pad, link.dst, link.dst_pad)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: %s(%d) <-> %s(%d)\n",
+                   link.src->name, link.src_pad, link.dst->name, link.dst_pad);
+            goto end;
+        }
+    }
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+    if ((ret = avfilter_graph_config(build->graph, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot configure graph.\n");
+        goto end;
+    }
 
-                                new_opt.u.i32 = *(int *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
-                            value = opt_storage[opt_index].u.i32;
-                            if (imax < INT_MAX/2 && imin > INT_MIN/2) {
-                                if (ImGui::SliderInt(opt->name, &value, imin, imax)) {
-                                    opt_storage[opt_index].u.i32 = value;
-                                }
-                            } else {
-                                if (ImGui::DragInt(opt->name, &value, imin, imax, ImGuiSliderFlags_AlwaysClamp)) {
-                                    opt_storage[opt_index].u.i32 = value;
-                                }
-                            }
-                        }
-                        break;
-                    case AV_OPT_TYPE_INT64:
-                        {
-                            int64_t value = *(int64_t *)ptr;
-                            int64_t imin = min;
-                            int64_t imax = max;
+    build->graphdump_text = avfilter_graph_dump(build->graph, NULL);
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+end:
+    trace_end("graph build", trace_start, NULL);
+    build->ret = ret;
+    __atomic_store_n(&build->finished, true, __ATOMIC_RELEASE);
+}
 
-                                new_opt.u.i64 = *(int64_t *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
-                            value = opt_storage[opt_index].u.i64;
-                            if (ImGui::DragScalar(opt->name, ImGuiDataType_S64, &value, 1, &imin, &imax, "%ld", ImGuiSliderFlags_AlwaysClamp)) {
-                                opt_storage[opt_index].u.i64 = value;
-                            }
-                        }
-                        break;
-                    case AV_OPT_TYPE_UINT64:
-                        {
-                            uint64_t value = *(uint64_t *)ptr;
-                            uint64_t umin = min;
-                            uint64_t umax = max;
+static void teardown_filter_graph()
+{
+    stop_sound_thread();
+    play_sources.clear();
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+    sink_threads_stop = true;
+    kill_audio_sink_threads();
+    kill_video_sink_threads();
+    sink_threads_stop = false;
 
-                                new_opt.u.u64 = *(uint64_t *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
-                            value = opt_storage[opt_index].u.u64;
-                            if (ImGui::DragScalar(opt->name, ImGuiDataType_U64, &value, 1, &umin, &umax, "%lu", ImGuiSliderFlags_AlwaysClamp)) {
-                                opt_storage[opt_index].u.u64 = value;
-                            }
-                        }
-                        break;
-                    case AV_OPT_TYPE_DOUBLE:
-                        {
-                            double value = *(double *)ptr;
+    audio_sink_threads.clear();
+    video_sink_threads.clear();
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+    filter_graph_is_valid = false;
+    graph_driver_active = false;
+    profiling_active = false;
 
-                                new_opt.u.dbl = *(double *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
-                            value = opt_storage[opt_index].u.dbl;
-                            if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &value, 1.0, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
-                                opt_storage[opt_index].u.dbl = value;
-                            }
-                        }
-                        break;
-                    case AV_OPT_TYPE_FLOAT:
-                        {
-                            float fmax = max;
-                            float fmin = min;
-                            float value;
+    buffer_sinks.clear();
+    abuffer_sinks.clear();
+    cv.clear();
+    acv.clear();
+    mutexes.clear();
+    amutexes.clear();
+    free_tap_previews();
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+    av_freep(&graphdump_text);
+}
 
-                                new_opt.u.flt = *(float *)ptr;
-                                opt_storage.push_back(new_opt);
-                            }
-                            value = opt_storage[opt_index].u.flt;
-                            if (ImGui::DragFloat(opt->name, &value, 1.f, fmin, fmax, "%f", ImGuiSliderFlags_AlwaysClamp))
-                                opt_storage[opt_index].u.flt = value;
-                        }
-                        break;
-                    case AV_OPT_TYPE_STRING:
-                        {
-                            char string[1024] = { 0 };
-                            uint8_t *str = NULL;
+static int install_graph_build(GraphBuild *build)
+{
+    teardown_filter_graph();
 
-                            if (opt_storage.size() <= opt_index) {
-                                OptStorage new_opt;
+    avfilter_graph_free(&filter_graph);
+    delete profile_counters;
+    filter_graph = build->graph;
+    build->graph = NULL;
+    profile_counters = build->profile_counters;
+    build->profile_counters = NULL;
+    av_buffer_unref(&hw_device_ctx);
+    hw_device_ctx = build->hw_device_ctx;
+    build->hw_device_ctx = NULL;
+    graphdump_text = build->graphdump_text;
+    build->graphdump_text = NULL;
+    profiling_active = build->profiling;
+
+    for (unsigned i = 0; i < build->ctxs.size(); i++) {
+        AVFilterContext *filter_ctx = build->ctxs[i];
 
-                                av_opt_get(ctx->priv, opt->name, 0, &str);
-                                new_opt.u.str = (char *)str;
-                                opt_storage.push_back(new_opt);
-                            }
+        if (!strcmp(filter_ctx->filter->name, "buffersink")) {
+            BufferSink new_sink;
 
-                            if (opt_storage[opt_index].u.str)
-                                memcpy(string, opt_storage[opt_index].u.str, std::min(sizeof(string) - 1, strlen(opt_storage[opt_index].u.str)));
+            new_sink.ctx = filter_ctx;
+            new_sink.ready = false;
+            new_sink.have_window_pos = false;
+            new_sink.fullscreen = false;
+            new_sink.muted = false;
+            new_sink.show_osd = true;
+            new_sink.frame_number = 0;
+            new_sink.upscale_interpolator = global_upscale_interpolation;
+            new_sink.downscale_interpolator = global_downscale_interpolation;
+            new_sink.consume_frames = {};
+            new_sink.render_frames = {};
+            new_sink.purge_frames = {};
+
+            buffer_sinks.push_back(new_sink);
+        } else if (!strcmp(filter_ctx->filter->name, "abuffersink")) {
+            BufferSink new_sink;
+
+            new_sink.ctx = filter_ctx;
+            new_sink.ready = false;
+            new_sink.have_window_pos = false;
+            new_sink.fullscreen = false;
+            new_sink.muted = false;
+            new_sink.show_osd = true;
+            new_sink.upscale_interpolator = 0;
+            new_sink.downscale_interpolator = 0;
+            new_sink.frame_number = 0;
+            new_sink.consume_frames = {};
+            new_sink.render_frames = {};
+            new_sink.purge_frames = {};
+
+            abuffer_sinks.push_back(new_sink);
+        }
+
+        filter_nodes[i].ctx = filter_ctx;
+    }
+    build->ctxs.clear();
+    tap_previews.swap(build->taps);
+
+    for (unsigned i = 0; i < buffer_sinks.size() + abuffer_sinks.size(); i++) {
+        BufferSink *sink = i < buffer_sinks.size() ? &buffer_sinks[i] : &abuffer_sinks[i - buffer_sinks.size()];
+
+        if (ring_buffer_init(&sink->consume_frames, sink_queue_size) < 0 ||
+            ring_buffer_init(&sink->render_frames,  sink_queue_size) < 0 ||
+            ring_buffer_init(&sink->purge_frames,   sink_queue_size) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot allocate frame queues for FilterGraph outputs.\n");
+            for (unsigned j = 0; j < buffer_sinks.size() + abuffer_sinks.size(); j++) {
+                sink = j < buffer_sinks.size() ? &buffer_sinks[j] : &abuffer_sinks[j - buffer_sinks.size()];
+                ring_buffer_free(&sink->consume_frames);
+                ring_buffer_free(&sink->render_frames);
+                ring_buffer_free(&sink->purge_frames);
+            }
+            teardown_filter_graph();
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    filter_graph_is_valid = true;
+    framestep = false;
+    paused = true;
+
+    show_abuffersink_window = true;
+    show_buffersink_window = true;
+
+    std::vector<std::condition_variable> cv_list(buffer_sinks.size());
+    cv.swap(cv_list);
+
+    std::vector<std::mutex> mutex_list(buffer_sinks.size());
+    mutexes.swap(mutex_list);
+
+    std::vector<std::thread> thread_list(buffer_sinks.size());
+    video_sink_threads.swap(thread_list);
+
+    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+
+        sink->id = i;
+        sink->label = av_asprintf("Video FilterGraph Output %d", i);
+        sink->time_base = av_buffersink_get_time_base(sink->ctx);
+        sink->frame_rate = av_buffersink_get_frame_rate(sink->ctx);
+        sink->pts = AV_NOPTS_VALUE;
+        sink->sample_index = 0;
+        sink->samples = NULL;
+        sink->pos = 0;
+        sink->frame_number = 0;
+        sink->frame_nb_samples = 0;
+        sink->nb_samples = 0;
+        sink->render_ring_size = 2;
+        sink->readahead_frames = 1;
+        sink->readahead_mb = 0;
+        sink->consume_bytes = 0;
+        sink->render_bytes = 0;
+        sink->purge_bytes = 0;
+        sink->cache_bytes = 0;
+        sink->head_pts = AV_NOPTS_VALUE;
+        sink->shm_export = false;
+        sink->shm = NULL;
+        sink->shm_generation = 0;
+        sink->frames_late = 0;
+        sink->frames_dropped = 0;
+        sink->drift = 0;
+
+        if (headless)
+            continue;
+
+        glGenTextures(1, &sink->texture);
+        glGenTextures(3, sink->plane_textures);
+        glGenFramebuffers(1, &sink->framebuffer);
+        glGenBuffers(IM_ARRAYSIZE(sink->pixel_buffers), sink->pixel_buffers);
+        sink->pixel_buffer_index = 0;
+        sink->plane_width = 0;
+        sink->plane_height = 0;
+        sink->plane_format = AV_PIX_FMT_NONE;
+        sink->texture_width = 0;
+        sink->texture_height = 0;
+        sink->texture_format = AV_PIX_FMT_NONE;
+        sink->uploaded_frame = NULL;
+        sink->uploaded_pts = AV_NOPTS_VALUE;
+        sink->scope = SCOPE_NONE;
+        sink->scope_accum = 0;
+        sink->scope_texture = 0;
+        sink->scope_accum_height = 0;
+        sink->scope_frame = NULL;
+        sink->scope_pts = AV_NOPTS_VALUE;
+        sink->scope_mode = SCOPE_NONE;
+        sink->grid_frame = NULL;
+        sink->grid_pts = AV_NOPTS_VALUE;
+        sink->frame_cache.clear();
+        sink->frame_cache_bytes = 0;
+        sink->frame_cache_clock = 0;
+        sink->cache_index = -1;
+
+        if (filter_graph_driver_mode)
+            continue;
+
+        std::thread sink_thread(worker_thread, &buffer_sinks[i], &mutexes[i], &cv[i]);
+
+        video_sink_threads[i].swap(sink_thread);
+    }
+
+    std::vector<std::condition_variable> acv_list(abuffer_sinks.size());
+    acv.swap(acv_list);
+
+    std::vector<std::mutex> amutex_list(abuffer_sinks.size());
+    amutexes.swap(amutex_list);
+
+    std::vector<std::thread> athread_list(abuffer_sinks.size());
+    audio_sink_threads.swap(athread_list);
+
+    for (unsigned i = 0; i < abuffer_sinks.size(); i++) {
+        BufferSink *sink = &abuffer_sinks[i];
+
+        sink->id = i;
+        sink->label = av_asprintf("Audio FilterGraph Output %d", i);
+        sink->time_base = av_buffersink_get_time_base(sink->ctx);
+        sink->frame_rate = av_make_q(av_buffersink_get_sample_rate(sink->ctx), 1);
+        sink->sample_index = 0;
+        sink->nb_samples = 512;
+        sink->pos = 0;
+        sink->frame_number = 0;
+        sink->frame_nb_samples = 0;
+        sink->pts = AV_NOPTS_VALUE;
+        sink->samples = (float *)av_calloc(sink->nb_samples, sizeof(float));
+        sink->render_ring_size = 2;
+        sink->readahead_frames = 1;
+        sink->readahead_mb = 0;
+        sink->consume_bytes = 0;
+        sink->render_bytes = 0;
+        sink->purge_bytes = 0;
+        sink->cache_bytes = 0;
+        sink->head_pts = AV_NOPTS_VALUE;
+        sink->shm_export = false;
+        sink->shm = NULL;
+        sink->shm_generation = 0;
+
+        sink->format = get_al_format(av_buffersink_get_channels(sink->ctx));
+        sink->audio_view = AUDIO_VIEW_WAVEFORM;
+        sink->nb_channels = 0;
+        sink->new_spectrum = false;
+        sink->spectrogram_texture = 0;
+        sink->spectrogram_row = 0;
+        sink->tx_pos = 0;
+        sink->analysis_pool = av_buffer_pool_init(sizeof(AudioAnalysis), NULL);
+        sink->spectrum = (float *)av_calloc(SPECTRUM_SIZE / 2, sizeof(*sink->spectrum));
+        sink->tx_history = (float *)av_calloc(SPECTRUM_SIZE, sizeof(*sink->tx_history));
+        sink->tx_window = (float *)av_calloc(SPECTRUM_SIZE, sizeof(*sink->tx_window));
+        sink->tx_in = (AVComplexFloat *)av_calloc(SPECTRUM_SIZE, sizeof(*sink->tx_in));
+        sink->tx_out = (AVComplexFloat *)av_calloc(SPECTRUM_SIZE, sizeof(*sink->tx_out));
+        sink->tx = NULL;
+        if (sink->spectrum && sink->tx_history && sink->tx_window && sink->tx_in && sink->tx_out) {
+            const float scale = 1.f;
+
+            for (int n = 0; n < SPECTRUM_SIZE; n++)
+                sink->tx_window[n] = 0.5f - 0.5f * cosf(2.f * M_PI * n / (SPECTRUM_SIZE - 1));
+            if (av_tx_init(&sink->tx, &sink->tx_fn, AV_TX_FLOAT_FFT, 0, SPECTRUM_SIZE, &scale, 0) < 0)
+                av_log(NULL, AV_LOG_WARNING, "Cannot init spectrum transform for %s.\n", sink->label);
+        }
+        sink->queue_target = AL_BUFFERS / 2;
+        sink->queued_buffers = 0;
+        sink->underruns = 0;
+
+        if (headless)
+            continue;
+
+        alGenBuffers(AL_BUFFERS, sink->buffers);
+        for (unsigned j = 0; j < AL_BUFFERS; j++)
+            sink->unprocessed_bufids.push_back(sink->buffers[j]);
+
+        alGenSources(1, &sink->source);
+        play_sources.push_back(sink->source);
+        sink->gain = 1.f;
+        sink->position[0] =  0.f;
+        sink->position[1] =  0.f;
+        sink->position[2] = -1.f;
+        alSource3f(sink->source, AL_POSITION, sink->position[0], sink->position[1], sink->position[2]);
+        alSourcei(sink->source, AL_SOURCE_RELATIVE, AL_TRUE);
+        alSourcei(sink->source, AL_ROLLOFF_FACTOR, 0);
+
+        if (filter_graph_driver_mode)
+            continue;
+
+        std::thread asink_thread(worker_thread, &abuffer_sinks[i], &amutexes[i], &acv[i]);
+
+        audio_sink_threads[i].swap(asink_thread);
+    }
+
+    if (headless)
+        return 0;
+
+    if (filter_graph_driver_mode) {
+        graph_driver_active = true;
+        start_graph_driver_thread();
+    }
+
+    playback_paused = paused && !framestep;
+    std::thread new_sound_thread(sound_thread, abuffer_sinks.size(), &play_sources);
+    play_sound_thread.swap(new_sound_thread);
+
+    return 0;
+}
+
+static int filters_setup()
+{
+    int ret;
+
+    if (need_filters_reinit == false)
+        return 0;
+
+    need_filters_reinit = false;
+
+    if (filter_nodes.size() == 0) {
+        teardown_filter_graph();
+        return 0;
+    }
+
+    ret = prepare_graph_build(&graph_build, filter_graph_nb_threads, true);
+    if (ret >= 0) {
+        graph_build_worker(&graph_build);
+        ret = graph_build.ret;
+    }
+    if (ret >= 0)
+        ret = install_graph_build(&graph_build);
+    free_graph_build(&graph_build);
+
+    return ret;
+}
+
+static bool graph_build_matches_nodes(const GraphBuild *build)
+{
+    if (build->ctxs.size() != filter_nodes.size())
+        return false;
+
+    for (unsigned i = 0; i < build->ctxs.size(); i++) {
+        if (build->ctxs[i]->filter != filter_nodes[i].filter)
+            return false;
+    }
+
+    return true;
+}
+
+static void update_graph_build()
+{
+    if (graph_build_running) {
+        if (!__atomic_load_n(&graph_build.finished, __ATOMIC_ACQUIRE))
+            return;
+
+        graph_build_thread.join();
+        graph_build_running = false;
+        if (graph_build.ret >= 0 && !need_filters_reinit && graph_build_matches_nodes(&graph_build))
+            install_graph_build(&graph_build);
+        free_graph_build(&graph_build);
+        return;
+    }
+
+    if (need_filters_reinit == false || autotune_running)
+        return;
+
+    need_filters_reinit = false;
+
+    if (filter_nodes.size() == 0) {
+        teardown_filter_graph();
+        return;
+    }
+
+    if (prepare_graph_build(&graph_build, filter_graph_nb_threads, true) < 0) {
+        free_graph_build(&graph_build);
+        return;
+    }
+
+    std::thread new_graph_build_thread(graph_build_worker, &graph_build);
+    graph_build_thread.swap(new_graph_build_thread);
+    graph_build_running = true;
+}
+
+static void stop_graph_build()
+{
+    if (graph_build_thread.joinable())
+        graph_build_thread.join();
+    graph_build_running = false;
+    free_graph_build(&graph_build);
+}
+
+static GLuint compile_shader(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    GLint status = 0;
+
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE) {
+        char log[1024] = { 0 };
+
+        glGetShaderInfoLog(shader, sizeof(log) - 1, NULL, log);
+        av_log(NULL, AV_LOG_ERROR, "Cannot compile shader: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static GLuint create_program(const char *vertex_source, const char *fragment_source)
+{
+    GLuint vertex_shader, fragment_shader, program;
+    GLint status = 0;
+
+    vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source);
+    fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+    if (!vertex_shader || !fragment_shader) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return 0;
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glBindFragDataLocation(program, 0, "color");
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        char log[1024] = { 0 };
+
+        glGetProgramInfoLog(program, sizeof(log) - 1, NULL, log);
+        av_log(NULL, AV_LOG_ERROR, "Cannot link shader program: %s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static const char *quad_vertex_shader =
+    "#version 130\n"
+    "out vec2 uv;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 pos = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1));\n"
+    "    uv = pos;\n"
+    "    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *yuv2rgb_fragment_shader =
+    "#version 130\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "uniform sampler2D plane0;\n"
+    "uniform sampler2D plane1;\n"
+    "uniform sampler2D plane2;\n"
+    "uniform int semi_planar;\n"
+    "uniform mat3 matrix;\n"
+    "uniform vec3 offset;\n"
+    "uniform vec3 scale;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 src;\n"
+    "    if (semi_planar != 0)\n"
+    "        src = vec3(texture(plane0, uv).r, texture(plane1, uv).rg);\n"
+    "    else\n"
+    "        src = vec3(texture(plane0, uv).r, texture(plane1, uv).r, texture(plane2, uv).r);\n"
+    "    color = vec4(clamp(matrix * ((src - offset) * scale), 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+static const char *compare_fragment_shader =
+    "#version 130\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "uniform sampler2D texa;\n"
+    "uniform sampler2D texb;\n"
+    "uniform int mode;\n"
+    "uniform float split;\n"
+    "uniform float gain;\n"
+    "uniform int flipped;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 a = texture(texa, uv).rgb;\n"
+    "    vec3 b = texture(texb, uv).rgb;\n"
+    "    if (mode == 0) {\n"
+    "        color = vec4(uv.x < split ? a : b, 1.0);\n"
+    "    } else if (mode == 1) {\n"
+    "        color = vec4(flipped != 0 ? b : a, 1.0);\n"
+    "    } else if (mode == 2) {\n"
+    "        color = vec4(clamp(abs(a - b) * gain, 0.0, 1.0), 1.0);\n"
+    "    } else {\n"
+    "        vec3 d = a - b;\n"
+    "        float mse = dot(d, d) / 3.0;\n"
+    "        float psnr = mse > 0.0 ? -10.0 * log(mse) / log(10.0) : 100.0;\n"
+    "        float t = clamp((psnr - 20.0) / 30.0, 0.0, 1.0);\n"
+    "        vec3 hot = mix(vec3(1.0, 0.0, 0.0), vec3(1.0, 1.0, 0.0), clamp(t * 2.0, 0.0, 1.0));\n"
+    "        color = vec4(mix(hot, vec3(0.0, 0.0, 1.0), clamp(t * 2.0 - 1.0, 0.0, 1.0)), 1.0);\n"
+    "    }\n"
+    "}\n";
+
+// one texel per 8x8 block: (sum of squared error, sum of block ssim, pixel count)
+static const char *compare_stats_fragment_shader =
+    "#version 130\n"
+    "out vec4 color;\n"
+    "uniform sampler2D texa;\n"
+    "uniform sampler2D texb;\n"
+    "uniform ivec2 size;\n"
+    "void main()\n"
+    "{\n"
+    "    const vec3 luma = vec3(0.299, 0.587, 0.114);\n"
+    "    ivec2 base = ivec2(gl_FragCoord.xy) * 8;\n"
+    "    float se = 0.0, sa = 0.0, sb = 0.0, saa = 0.0, sbb = 0.0, sab = 0.0, n = 0.0;\n"
+    "    for (int y = 0; y < 8; y++) {\n"
+    "        for (int x = 0; x < 8; x++) {\n"
+    "            ivec2 pos = base + ivec2(x, y);\n"
+    "            if (pos.x >= size.x || pos.y >= size.y)\n"
+    "                continue;\n"
+    "            vec3 a = texelFetch(texa, pos, 0).rgb;\n"
+    "            vec3 b = texelFetch(texb, pos, 0).rgb;\n"
+    "            vec3 d = a - b;\n"
+    "            float la = dot(a, luma), lb = dot(b, luma);\n"
+    "            se += dot(d, d) / 3.0;\n"
+    "            sa += la; sb += lb;\n"
+    "            saa += la * la; sbb += lb * lb; sab += la * lb;\n"
+    "            n += 1.0;\n"
+    "        }\n"
+    "    }\n"
+    "    float ma = sa / n, mb = sb / n;\n"
+    "    float va = saa / n - ma * ma, vb = sbb / n - mb * mb, cov = sab / n - ma * mb;\n"
+    "    const float c1 = 0.0001, c2 = 0.0009;\n"
+    "    float ssim = ((2.0 * ma * mb + c1) * (2.0 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));\n"
+    "    color = vec4(se, ssim * n, n, 0.0);\n"
+    "}\n";
+
+// sums up to 2x2 stats texels, skipping those past the odd right and bottom edges
+static const char *compare_reduce_fragment_shader =
+    "#version 130\n"
+    "out vec4 color;\n"
+    "uniform sampler2D stats;\n"
+    "uniform ivec2 size;\n"
+    "void main()\n"
+    "{\n"
+    "    ivec2 base = ivec2(gl_FragCoord.xy) * 2;\n"
+    "    vec4 sum = vec4(0.0);\n"
+    "    for (int y = 0; y < 2; y++) {\n"
+    "        for (int x = 0; x < 2; x++) {\n"
+    "            ivec2 pos = base + ivec2(x, y);\n"
+    "            if (pos.x < size.x && pos.y < size.y)\n"
+    "                sum += texelFetch(stats, pos, 0);\n"
+    "        }\n"
+    "    }\n"
+    "    color = sum;\n"
+    "}\n";
+
+// one point per channel and sampled pixel, accumulated with additive blending
+static const char *scope_vertex_shader =
+    "#version 130\n"
+    "out vec4 mask;\n"
+    "uniform sampler2D frame;\n"
+    "uniform ivec2 size;\n"
+    "uniform int columns;\n"
+    "uniform int step;\n"
+    "uniform int mode;\n"
+    "void main()\n"
+    "{\n"
+    "    int ch = gl_VertexID % 3;\n"
+    "    int p = gl_VertexID / 3;\n"
+    "    ivec2 pos = ivec2(p % columns, p / columns) * step;\n"
+    "    vec3 rgb = texelFetch(frame, min(pos, size - 1), 0).rgb;\n"
+    "    vec2 xy;\n"
+    "    mask = vec4(equal(ivec4(ch), ivec4(0, 1, 2, 3)));\n"
+    "    float value = (floor(dot(rgb, mask.rgb) * 255.0) + 0.5) / 256.0;\n"
+    "    if (mode == 1) {\n"
+    "        xy = vec2(value, 0.5);\n"
+    "    } else if (mode == 2) {\n"
+    "        xy = vec2((float(pos.x) + 0.5) / float(size.x), value);\n"
+    "    } else {\n"
+    "        float cb = dot(rgb, vec3(-0.1146, -0.3854, 0.5));\n"
+    "        float cr = dot(rgb, vec3(0.5, -0.4542, -0.0458));\n"
+    "        xy = ch == 0 ? vec2(cb, cr) + 0.5 : vec2(2.0);\n"
+    "        mask = vec4(1.0);\n"
+    "    }\n"
+    "    gl_Position = vec4(xy * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *scope_point_fragment_shader =
+    "#version 130\n"
+    "in vec4 mask;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    color = mask;\n"
+    "}\n";
+
+static const char *scope_display_fragment_shader =
+    "#version 130\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "uniform sampler2D accum;\n"
+    "uniform int mode;\n"
+    "uniform float gain;\n"
+    "void main()\n"
+    "{\n"
+    "    if (mode == 1) {\n"
+    "        vec3 v = texelFetch(accum, ivec2(int(uv.x * 256.0), 0), 0).rgb * gain;\n"
+    "        vec3 on = vec3(lessThan(vec3(uv.y), v));\n"
+    "        color = vec4(on, max(max(on.r, on.g), on.b));\n"
+    "    } else {\n"
+    "        vec3 v = 1.0 - exp(-texelFetch(accum, ivec2(gl_FragCoord.xy), 0).rgb * gain);\n"
+    "        color = vec4(v, max(max(v.r, v.g), v.b));\n"
+    "    }\n"
+    "}\n";
+
+static void draw_fullscreen_quad()
+{
+    if (!empty_vao)
+        glGenVertexArrays(1, &empty_vao);
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+}
+
+static void get_color_matrix(const AVFrame *frame, float matrix[9], float offset[3], float scale[3])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    const int depth = desc->comp[0].depth;
+    const int container = depth + desc->comp[0].shift > 8 ? 16 : 8;
+    const float unit = (float)(1 << desc->comp[0].shift) / ((1 << container) - 1);
+    const float code_max = (1 << depth) - 1;
+    float kr, kb, kg;
+
+    if (desc->flags & AV_PIX_FMT_FLAG_RGB) {
+        const float gbr[9] = { 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 0.f };
+
+        memcpy(matrix, gbr, sizeof(gbr));
+        for (int i = 0; i < 3; i++) {
+            offset[i] = 0.f;
+            scale[i] = 1.f / (code_max * unit);
+        }
+        return;
+    }
+
+    switch (frame->colorspace) {
+    case AVCOL_SPC_BT709:
+        kr = 0.2126f; kb = 0.0722f;
+        break;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        kr = 0.2627f; kb = 0.0593f;
+        break;
+    case AVCOL_SPC_SMPTE240M:
+        kr = 0.212f; kb = 0.087f;
+        break;
+    case AVCOL_SPC_FCC:
+        kr = 0.30f; kb = 0.11f;
+        break;
+    default:
+        kr = 0.299f; kb = 0.114f;
+        break;
+    }
+    kg = 1.f - kr - kb;
+
+    // column-major: r, g, b rows applied to (y, cb, cr)
+    matrix[0] = 1.f; matrix[1] = 1.f;                              matrix[2] = 1.f;
+    matrix[3] = 0.f; matrix[4] = -2.f * kb * (1.f - kb) / kg;      matrix[5] = 2.f * (1.f - kb);
+    matrix[6] = 2.f * (1.f - kr); matrix[7] = -2.f * kr * (1.f - kr) / kg; matrix[8] = 0.f;
+
+    offset[0] = frame->color_range == AVCOL_RANGE_JPEG ? 0.f : (16 << (depth - 8)) * unit;
+    offset[1] = offset[2] = (128 << (depth - 8)) * unit;
+    if (frame->color_range == AVCOL_RANGE_JPEG) {
+        scale[0] = scale[1] = scale[2] = 1.f / (code_max * unit);
+    } else {
+        scale[0] = 1.f / ((219 << (depth - 8)) * unit);
+        scale[1] = scale[2] = 1.f / ((224 << (depth - 8)) * unit);
+    }
+}
+
+static bool is_gpu_converted_format(int format)
+{
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_P010:
+    case AV_PIX_FMT_GBRP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void upload_texture(BufferSink *sink, GLuint texture, bool alloc, GLint internal_format,
+                           GLenum format, GLenum type, int width, int height, int texel_size,
+                           const uint8_t *data, int linesize)
+{
+    const GLsizeiptr size = (GLsizeiptr)width * texel_size * height;
+    GLuint pixel_buffer = sink->pixel_buffers[sink->pixel_buffer_index];
+    void *dst;
+
+    sink->pixel_buffer_index = (sink->pixel_buffer_index + 1) % IM_ARRAYSIZE(sink->pixel_buffers);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (alloc)
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) {
+        av_image_copy_plane((uint8_t *)dst, width * texel_size, data, linesize, width * texel_size, height);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, NULL);
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / texel_size);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void upload_planes(const AVFrame *frame, BufferSink *sink)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    const bool semi_planar = av_pix_fmt_count_planes((enum AVPixelFormat)frame->format) == 2;
+    const bool high_depth = desc->comp[0].depth > 8;
+    const int nb_planes = semi_planar ? 2 : 3;
+    const bool alloc = sink->plane_width != frame->width || sink->plane_height != frame->height ||
+                       sink->plane_format != frame->format;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < nb_planes; i++) {
+        const int shift_w = i > 0 ? desc->log2_chroma_w : 0;
+        const int shift_h = i > 0 ? desc->log2_chroma_h : 0;
+        const int w = -((-frame->width)  >> shift_w);
+        const int h = -((-frame->height) >> shift_h);
+        const int components = semi_planar && i > 0 ? 2 : 1;
+        const int texel_size = components * (high_depth ? 2 : 1);
+        const GLint internal_format = components == 2 ? (high_depth ? GL_RG16 : GL_RG8) : (high_depth ? GL_R16 : GL_R8);
+
+        glActiveTexture(GL_TEXTURE0 + i);
+        upload_texture(sink, sink->plane_textures[i], alloc, internal_format,
+                       components == 2 ? GL_RG : GL_RED, high_depth ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+                       w, h, texel_size, frame->data[i], frame->linesize[i]);
+        if (alloc) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    sink->plane_width  = frame->width;
+    sink->plane_height = frame->height;
+    sink->plane_format = frame->format;
+}
+
+// converts into out_texture, or into whatever framebuffer already targets when out_texture is 0
+static void convert_frame(GLuint framebuffer, GLuint out_texture, int x, int y, int width, int height,
+                          const AVFrame *frame, BufferSink *sink)
+{
+    const bool semi_planar = av_pix_fmt_count_planes((enum AVPixelFormat)frame->format) == 2;
+    float matrix[9], offset[3], scale[3];
+    GLint old_framebuffer, old_viewport[4];
+
+    if (!yuv2rgb_program)
+        yuv2rgb_program = create_program(quad_vertex_shader, yuv2rgb_fragment_shader);
+    if (!yuv2rgb_program)
+        return;
+
+    upload_planes(frame, sink);
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (out_texture)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, out_texture, 0);
+    glViewport(x, y, width, height);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    get_color_matrix(frame, matrix, offset, scale);
+    glUseProgram(yuv2rgb_program);
+    glUniform1i(glGetUniformLocation(yuv2rgb_program, "plane0"), 0);
+    glUniform1i(glGetUniformLocation(yuv2rgb_program, "plane1"), 1);
+    glUniform1i(glGetUniformLocation(yuv2rgb_program, "plane2"), 2);
+    glUniform1i(glGetUniformLocation(yuv2rgb_program, "semi_planar"), semi_planar);
+    glUniformMatrix3fv(glGetUniformLocation(yuv2rgb_program, "matrix"), 1, GL_FALSE, matrix);
+    glUniform3fv(glGetUniformLocation(yuv2rgb_program, "offset"), 1, offset);
+    glUniform3fv(glGetUniformLocation(yuv2rgb_program, "scale"), 1, scale);
+    draw_fullscreen_quad();
+    glUseProgram(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+static void load_frame(GLuint *out_texture, int *width, int *height, AVFrame *frame,
+                       BufferSink *sink)
+{
+    const bool alloc = sink->texture_width != frame->width || sink->texture_height != frame->height ||
+                       sink->texture_format != frame->format;
+    int64_t trace_start;
+
+    *width  = frame->width;
+    *height = frame->height;
+
+    glBindTexture(GL_TEXTURE_2D, *out_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sink->downscale_interpolator);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sink->upscale_interpolator);
+
+    if (!alloc && sink->uploaded_frame == frame && sink->uploaded_pts == frame->pts)
+        return;
+
+    trace_start = trace_begin();
+    if (is_gpu_converted_format(frame->format)) {
+        if (alloc)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame->width, frame->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        convert_frame(sink->framebuffer, *out_texture, 0, 0, frame->width, frame->height, frame, sink);
+    } else {
+        upload_texture(sink, *out_texture, alloc, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE,
+                       frame->width, frame->height, 4, frame->data[0], frame->linesize[0]);
+    }
+
+    sink->texture_width  = frame->width;
+    sink->texture_height = frame->height;
+    sink->texture_format = frame->format;
+    sink->uploaded_frame = frame;
+    sink->uploaded_pts   = frame->pts;
+    trace_end("texture upload", trace_start, sink);
+}
+
+static void alloc_compare_texture(GLuint *texture, GLint internal_format, GLenum format, GLenum type,
+                                  int width, int height, GLint filter)
+{
+    if (!*texture)
+        glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static void compare_stats(const BufferSink *a, const BufferSink *b)
+{
+    int w = (a->texture_width + 7) / 8;
+    int h = (a->texture_height + 7) / 8;
+    float stats[4] = { 0.f };
+    int src = 0;
+
+    if (!compare_stats_program)
+        compare_stats_program = create_program(quad_vertex_shader, compare_stats_fragment_shader);
+    if (!compare_reduce_program)
+        compare_reduce_program = create_program(quad_vertex_shader, compare_reduce_fragment_shader);
+    if (!compare_stats_program || !compare_reduce_program)
+        return;
+
+    if (compare_stats_width != w || compare_stats_height != h) {
+        for (int i = 0; i < 2; i++)
+            alloc_compare_texture(&compare_stats_textures[i], GL_RGBA32F, GL_RGBA, GL_FLOAT, w, h, GL_NEAREST);
+        compare_stats_width = w;
+        compare_stats_height = h;
+    }
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compare_stats_textures[0], 0);
+    glViewport(0, 0, w, h);
+    glUseProgram(compare_stats_program);
+    glUniform1i(glGetUniformLocation(compare_stats_program, "texa"), 0);
+    glUniform1i(glGetUniformLocation(compare_stats_program, "texb"), 1);
+    glUniform2i(glGetUniformLocation(compare_stats_program, "size"), a->texture_width, a->texture_height);
+    draw_fullscreen_quad();
+
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(compare_reduce_program);
+    glUniform1i(glGetUniformLocation(compare_reduce_program, "stats"), 0);
+    while (w > 1 || h > 1) {
+        glUniform2i(glGetUniformLocation(compare_reduce_program, "size"), w, h);
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        glBindTexture(GL_TEXTURE_2D, compare_stats_textures[src]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compare_stats_textures[!src], 0);
+        glViewport(0, 0, w, h);
+        draw_fullscreen_quad();
+        src = !src;
+    }
+    glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, stats);
+
+    if (stats[2] > 0.f) {
+        const double mse = stats[0] / stats[2];
+
+        compare_psnr = mse > 0. ? -10. * log10(mse) : INFINITY;
+        compare_ssim = stats[1] / stats[2];
+    }
+}
+
+static void render_compare(const BufferSink *a, const BufferSink *b, bool update_stats)
+{
+    GLint old_framebuffer, old_viewport[4];
+
+    if (!compare_program)
+        compare_program = create_program(quad_vertex_shader, compare_fragment_shader);
+    if (!compare_program)
+        return;
+
+    if (!compare_framebuffer)
+        glGenFramebuffers(1, &compare_framebuffer);
+    if (compare_width != a->texture_width || compare_height != a->texture_height) {
+        alloc_compare_texture(&compare_texture, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE,
+                              a->texture_width, a->texture_height, GL_LINEAR);
+        compare_width = a->texture_width;
+        compare_height = a->texture_height;
+    }
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, compare_framebuffer);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, a->texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, b->texture);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compare_texture, 0);
+    glViewport(0, 0, compare_width, compare_height);
+    glUseProgram(compare_program);
+    glUniform1i(glGetUniformLocation(compare_program, "texa"), 0);
+    glUniform1i(glGetUniformLocation(compare_program, "texb"), 1);
+    glUniform1i(glGetUniformLocation(compare_program, "mode"), compare_mode);
+    glUniform1f(glGetUniformLocation(compare_program, "split"), compare_split);
+    glUniform1f(glGetUniformLocation(compare_program, "gain"), compare_gain);
+    glUniform1i(glGetUniformLocation(compare_program, "flipped"), compare_flipped);
+    draw_fullscreen_quad();
+
+    if (update_stats && a->texture_width == b->texture_width && a->texture_height == b->texture_height)
+        compare_stats(a, b);
+
+    glUseProgram(0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+}
+
+static void free_compare()
+{
+    glDeleteProgram(compare_program);
+    compare_program = 0;
+    glDeleteProgram(compare_stats_program);
+    compare_stats_program = 0;
+    glDeleteProgram(compare_reduce_program);
+    compare_reduce_program = 0;
+    glDeleteFramebuffers(1, &compare_framebuffer);
+    compare_framebuffer = 0;
+    glDeleteTextures(1, &compare_texture);
+    compare_texture = 0;
+    glDeleteTextures(2, compare_stats_textures);
+    compare_stats_textures[0] = compare_stats_textures[1] = 0;
+    compare_width = compare_height = 0;
+    compare_stats_width = compare_stats_height = 0;
+}
+
+static bool update_grid_layout(int count, int max_width, int max_height)
+{
+    GLint max_texture_size = 0, old_framebuffer;
+    int columns = 1, rows, cell_width, cell_height, size;
+    double scale;
+
+    while (columns * columns < count)
+        columns++;
+    rows = (count + columns - 1) / columns;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    size = std::min(grid_max_size, (int)max_texture_size);
+    scale = std::min(1., std::min((double)size / (columns * max_width), (double)size / (rows * max_height)));
+    cell_width  = std::max(1, (int)(max_width  * scale));
+    cell_height = std::max(1, (int)(max_height * scale));
+
+    if (grid_texture && columns == grid_columns && rows == grid_rows &&
+        cell_width == grid_cell_width && cell_height == grid_cell_height)
+        return false;
+
+    if (!grid_framebuffer)
+        glGenFramebuffers(1, &grid_framebuffer);
+    if (!grid_read_framebuffer)
+        glGenFramebuffers(1, &grid_read_framebuffer);
+    alloc_compare_texture(&grid_texture, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE,
+                          columns * cell_width, rows * cell_height, GL_LINEAR);
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, grid_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grid_texture, 0);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+
+    grid_columns = columns;
+    grid_rows = rows;
+    grid_cell_width = cell_width;
+    grid_cell_height = cell_height;
+
+    return true;
+}
+
+static void get_grid_tile(const AVFrame *frame, int index, int *x, int *y, int *w, int *h)
+{
+    const double scale = std::min((double)grid_cell_width  / frame->width,
+                                  (double)grid_cell_height / frame->height);
+
+    *w = std::max(1, (int)(frame->width  * scale));
+    *h = std::max(1, (int)(frame->height * scale));
+    *x = (index % grid_columns) * grid_cell_width  + (grid_cell_width  - *w) / 2;
+    *y = (index / grid_columns) * grid_cell_height + (grid_cell_height - *h) / 2;
+}
+
+static void clear_grid_cell(int index)
+{
+    glEnable(GL_SCISSOR_TEST);
+    glScissor((index % grid_columns) * grid_cell_width, (index / grid_columns) * grid_cell_height,
+              grid_cell_width, grid_cell_height);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+static void blit_grid_tile(BufferSink *sink, AVFrame *frame, int index)
+{
+    int width, height, x, y, w, h;
+
+    load_frame(&sink->texture, &width, &height, frame, sink);
+    get_grid_tile(frame, index, &x, &y, &w, &h);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, grid_read_framebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sink->texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, grid_framebuffer);
+    glBlitFramebuffer(0, 0, width, height, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+/* Video outputs are written straight into their grid cell: packed RGBA
+ * frames that fit 1:1 share one PBO and are copied with one glTexSubImage2D
+ * each, GPU converted formats run the YUV pass with the viewport set to the
+ * cell. Only RGBA frames that need scaling go through the sink texture. */
+static void update_grid_tiles(const std::vector<AVFrame *> &frames, bool relayout)
+{
+    std::vector<size_t> offsets(frames.size(), SIZE_MAX);
+    GLint old_draw_framebuffer, old_read_framebuffer;
+    size_t total = 0;
+    uint8_t *dst = NULL;
+
+    for (unsigned i = 0; i < frames.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+        const AVFrame *frame = frames[i];
+        int x, y, w, h;
+
+        if (!frame || (!relayout && sink->grid_frame == frame && sink->grid_pts == frame->pts))
+            continue;
+
+        get_grid_tile(frame, i, &x, &y, &w, &h);
+        if (!is_gpu_converted_format(frame->format) && w == frame->width && h == frame->height) {
+            offsets[i] = total;
+            total += (size_t)frame->width * 4 * frame->height;
+        }
+    }
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_draw_framebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &old_read_framebuffer);
+
+    if (total > 0) {
+        if (!grid_pixel_buffer)
+            glGenBuffers(1, &grid_pixel_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, grid_pixel_buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+        dst = (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total,
+                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        for (unsigned i = 0; dst && i < frames.size(); i++) {
+            const AVFrame *frame = frames[i];
+
+            if (offsets[i] != SIZE_MAX)
+                av_image_copy_plane(dst + offsets[i], frame->width * 4, frame->data[0], frame->linesize[0],
+                                    frame->width * 4, frame->height);
+        }
+        if (dst && !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            dst = NULL;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, grid_framebuffer);
+    glBindTexture(GL_TEXTURE_2D, grid_texture);
+    for (unsigned i = 0; i < frames.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+        AVFrame *frame = frames[i];
+        int x, y, w, h;
+
+        if (!frame || (!relayout && sink->grid_frame == frame && sink->grid_pts == frame->pts))
+            continue;
+
+        get_grid_tile(frame, i, &x, &y, &w, &h);
+        if (w < grid_cell_width || h < grid_cell_height)
+            clear_grid_cell(i);
+
+        if (offsets[i] != SIZE_MAX && dst) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, grid_pixel_buffer);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (const void *)offsets[i]);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        } else if (is_gpu_converted_format(frame->format)) {
+            convert_frame(grid_framebuffer, 0, x, y, w, h, frame, sink);
+            glBindTexture(GL_TEXTURE_2D, grid_texture);
+        } else {
+            blit_grid_tile(sink, frame, i);
+            glBindFramebuffer(GL_FRAMEBUFFER, grid_framebuffer);
+            glBindTexture(GL_TEXTURE_2D, grid_texture);
+        }
+
+        sink->grid_frame = frame;
+        sink->grid_pts = frame->pts;
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, old_draw_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, old_read_framebuffer);
+}
+
+static void free_grid()
+{
+    glDeleteFramebuffers(1, &grid_framebuffer);
+    grid_framebuffer = 0;
+    glDeleteFramebuffers(1, &grid_read_framebuffer);
+    grid_read_framebuffer = 0;
+    glDeleteTextures(1, &grid_texture);
+    grid_texture = 0;
+    glDeleteBuffers(1, &grid_pixel_buffer);
+    grid_pixel_buffer = 0;
+    grid_columns = grid_rows = 0;
+    grid_cell_width = grid_cell_height = 0;
+}
+
+static void render_scope(BufferSink *sink)
+{
+    const int step = std::max((int)ceil(sqrt((double)sink->texture_width * sink->texture_height / SCOPE_MAX_POINTS)), 1);
+    const int columns = (sink->texture_width + step - 1) / step;
+    const int rows = (sink->texture_height + step - 1) / step;
+    const int accum_height = sink->scope == SCOPE_HISTOGRAM ? 1 : SCOPE_SIZE;
+    const double points = (double)columns * rows;
+    GLint old_framebuffer, old_viewport[4];
+    float gain;
+
+    if (!scope_program)
+        scope_program = create_program(scope_vertex_shader, scope_point_fragment_shader);
+    if (!scope_display_program)
+        scope_display_program = create_program(quad_vertex_shader, scope_display_fragment_shader);
+    if (!scope_program || !scope_display_program)
+        return;
+
+    if (!scope_framebuffer)
+        glGenFramebuffers(1, &scope_framebuffer);
+    if (sink->scope_accum_height != accum_height) {
+        alloc_compare_texture(&sink->scope_accum, GL_RGBA32F, GL_RGBA, GL_FLOAT, SCOPE_SIZE, accum_height, GL_NEAREST);
+        sink->scope_accum_height = accum_height;
+    }
+    if (!sink->scope_texture)
+        alloc_compare_texture(&sink->scope_texture, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE, SCOPE_SIZE, SCOPE_SIZE, GL_LINEAR);
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scope_framebuffer);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sink->scope_accum, 0);
+    glViewport(0, 0, SCOPE_SIZE, accum_height);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sink->texture);
+    glUseProgram(scope_program);
+    glUniform1i(glGetUniformLocation(scope_program, "frame"), 0);
+    glUniform2i(glGetUniformLocation(scope_program, "size"), sink->texture_width, sink->texture_height);
+    glUniform1i(glGetUniformLocation(scope_program, "columns"), columns);
+    glUniform1i(glGetUniformLocation(scope_program, "step"), step);
+    glUniform1i(glGetUniformLocation(scope_program, "mode"), sink->scope);
+    if (!empty_vao)
+        glGenVertexArrays(1, &empty_vao);
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_POINTS, 0, columns * rows * 3);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+
+    if (sink->scope == SCOPE_HISTOGRAM)
+        gain = SCOPE_SIZE / points / 4.f;
+    else if (sink->scope == SCOPE_WAVEFORM)
+        gain = SCOPE_SIZE * SCOPE_SIZE / points / 4.f;
+    else
+        gain = SCOPE_SIZE * SCOPE_SIZE / points;
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sink->scope_texture, 0);
+    glViewport(0, 0, SCOPE_SIZE, SCOPE_SIZE);
+    glBindTexture(GL_TEXTURE_2D, sink->scope_accum);
+    glUseProgram(scope_display_program);
+    glUniform1i(glGetUniformLocation(scope_display_program, "accum"), 0);
+    glUniform1i(glGetUniformLocation(scope_display_program, "mode"), sink->scope);
+    glUniform1f(glGetUniformLocation(scope_display_program, "gain"), gain);
+    draw_fullscreen_quad();
+
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+}
+
+static void draw_scope(BufferSink *sink, ImVec2 image_min, ImVec2 image_max)
+{
+    const float size = std::min(std::min(image_max.x - image_min.x, image_max.y - image_min.y) * 0.45f, (float)SCOPE_SIZE);
+    const ImVec2 max = ImVec2(image_max.x - 8.f, image_min.y + 8.f + size);
+    const ImVec2 min = ImVec2(max.x - size, image_min.y + 8.f);
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+
+    if (sink->scope == SCOPE_NONE || !sink->texture_width)
+        return;
+
+    if (sink->scope_frame != sink->uploaded_frame || sink->scope_pts != sink->uploaded_pts ||
+        sink->scope_mode != sink->scope) {
+        render_scope(sink);
+        sink->scope_frame = sink->uploaded_frame;
+        sink->scope_pts = sink->uploaded_pts;
+        sink->scope_mode = sink->scope;
+    }
+
+    draw_list->AddRectFilled(min, max, IM_COL32(0, 0, 0, (int)(scope_opacity * 255)));
+    if (sink->scope == SCOPE_VECTORSCOPE) {
+        const ImVec2 center = ImVec2((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f);
+
+        draw_list->AddCircle(center, size * 0.5f, IM_COL32(128, 128, 128, 128), 64);
+        draw_list->AddLine(ImVec2(min.x, center.y), ImVec2(max.x, center.y), IM_COL32(128, 128, 128, 128));
+        draw_list->AddLine(ImVec2(center.x, min.y), ImVec2(center.x, max.y), IM_COL32(128, 128, 128, 128));
+    }
+    draw_list->AddImage((void*)(intptr_t)sink->scope_texture, min, max, ImVec2(0.f, 1.f), ImVec2(1.f, 0.f),
+                        IM_COL32(255, 255, 255, (int)(scope_opacity * 255)));
+    draw_list->AddRect(min, max, IM_COL32(128, 128, 128, 160));
+}
+
+static void free_scope_programs()
+{
+    glDeleteProgram(scope_program);
+    scope_program = 0;
+    glDeleteProgram(scope_display_program);
+    scope_display_program = 0;
+    glDeleteFramebuffers(1, &scope_framebuffer);
+    scope_framebuffer = 0;
+}
+
+static void draw_info(bool *p_open, FrameInfo *frame)
+{
+    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
+                                          ImGuiWindowFlags_AlwaysAutoResize |
+                                          ImGuiWindowFlags_NoSavedSettings |
+                                          ImGuiWindowFlags_NoNav |
+                                          ImGuiWindowFlags_NoMouseInputs |
+                                          ImGuiWindowFlags_NoFocusOnAppearing |
+                                          ImGuiWindowFlags_NoMove;
+
+    ImGui::SetNextWindowPos(ImVec2(display_w/2, display_h/2), 0, ImVec2(0.5, 0.5));
+    ImGui::SetNextWindowBgAlpha(0.7f);
+    ImGui::SetNextWindowFocus();
+
+    if (!ImGui::Begin("##Info", p_open, window_flags)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Separator();
+    if (frame->width && frame->height) {
+        ImGui::Text("SIZE: %dx%d", frame->width, frame->height);
+        ImGui::Separator();
+        ImGui::Text("KEY FRAME: %d", frame->key_frame);
+        ImGui::Separator();
+        ImGui::Text("PICTURE TYPE: %c", av_get_picture_type_char(frame->pict_type));
+        ImGui::Separator();
+        ImGui::Text("SAR: %dx%d", frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den);
+        ImGui::Separator();
+        ImGui::Text("COLOR RANGE: %s", av_color_range_name(frame->color_range));
+        ImGui::Separator();
+        ImGui::Text("COLOR PRIMARIES: %s", av_color_primaries_name(frame->color_primaries));
+        ImGui::Separator();
+        ImGui::Text("COLOR TRC: %s", av_color_transfer_name(frame->color_trc));
+        ImGui::Separator();
+        ImGui::Text("COLOR SPACE: %s", av_color_space_name(frame->colorspace));
+        ImGui::Separator();
+        ImGui::Text("CHROMA LOCATION: %s", av_chroma_location_name(frame->chroma_location));
+        ImGui::Separator();
+        ImGui::Text("PIXEL FORMAT: %s", av_get_pix_fmt_name((enum AVPixelFormat)frame->format));
+        ImGui::Separator();
+    } else if (frame->nb_samples) {
+        ImGui::Text("SAMPLES: %d", frame->nb_samples);
+        ImGui::Separator();
+        ImGui::Text("SAMPLE RATE: %d", frame->sample_rate);
+        ImGui::Separator();
+        ImGui::Text("SAMPLE FORMAT: %s", av_get_sample_fmt_name((enum AVSampleFormat)frame->format));
+        ImGui::Separator();
+    }
+    ImGui::Text("PTS: %ld", frame->pts);
+    ImGui::Separator();
+    ImGui::Text("TIME BASE: %d/%d", frame->time_base.num, frame->time_base.den);
+    ImGui::Separator();
+    ImGui::Text("PACKET POSITION: %ld", frame->pkt_pos);
+    ImGui::Separator();
+    ImGui::Text("PACKET SIZE: %d", frame->pkt_size);
+    ImGui::Separator();
+    ImGui::Text("PACKET DURATION: %ld", frame->pkt_duration);
+    ImGui::End();
+}
+
+static void draw_help(bool *p_open)
+{
+    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
+                                          ImGuiWindowFlags_AlwaysAutoResize |
+                                          ImGuiWindowFlags_NoSavedSettings |
+                                          ImGuiWindowFlags_NoNav |
+                                          ImGuiWindowFlags_NoMouseInputs |
+                                          ImGuiWindowFlags_NoFocusOnAppearing |
+                                          ImGuiWindowFlags_NoMove;
+    const int align = 555;
+
+    ImGui::SetNextWindowPos(ImVec2(display_w/2, display_h/2), 0, ImVec2(0.5, 0.5));
+    ImGui::SetNextWindowBgAlpha(0.5f);
+    ImGui::SetNextWindowFocus();
+
+    if (!ImGui::Begin("##Help", p_open, window_flags)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Separator();
+    ImGui::Separator();
+    ImGui::Text("Global Keys:");
+    ImGui::Separator();
+    ImGui::Text("Show Help:");
+    ImGui::SameLine(align);
+    ImGui::Text("F1");
+    ImGui::Separator();
+    ImGui::Text("Jump to FilterGraph Editor:");
+    ImGui::SameLine(align);
+    ImGui::Text("F2");
+    ImGui::Separator();
+    ImGui::Text("Jump to FilterGraph Commands Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F3");
+    ImGui::Separator();
+    ImGui::Text("Jump to FilterGraph Dump Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F4");
+    ImGui::Separator();
+    ImGui::Text("Jump to FilterGraph Log Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F5");
+    ImGui::Separator();
+    ImGui::Text("Jump to FilterGraph Profile Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F6");
+    ImGui::Separator();
+    ImGui::Text("Jump to Render to File Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F7");
+    ImGui::Separator();
+    ImGui::Text("Jump to Frame Memory Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F8");
+    ImGui::Separator();
+    ImGui::Text("Jump to Compare Outputs Window:");
+    ImGui::SameLine(align);
+    ImGui::Text("F9");
+    ImGui::Separator();
+    ImGui::Text("Toggle Console:");
+    ImGui::SameLine(align);
+    ImGui::Text("Escape");
+    ImGui::Separator();
+    ImGui::Separator();
+    ImGui::Separator();
+    ImGui::Text("FilterGraph Editor Keys:");
+    ImGui::Separator();
+    ImGui::Text("Add New Filter:");
+    ImGui::SameLine(align);
+    ImGui::Text("A");
+    ImGui::Separator();
+    ImGui::Text("Auto Connect Filter Outputs to Sinks:");
+    ImGui::SameLine(align);
+    ImGui::Text("Shift + A");
+    ImGui::Separator();
+    ImGui::Text("Remove Selected Filters:");
+    ImGui::SameLine(align);
+    ImGui::Text("Shift + X");
+    ImGui::Separator();
+    ImGui::Text("Remove Selected Links:");
+    ImGui::SameLine(align);
+    ImGui::Text("X");
+    ImGui::Separator();
+    ImGui::Text("Clone Selected Filters:");
+    ImGui::SameLine(align);
+    ImGui::Text("Shift + C");
+    ImGui::Separator();
+    ImGui::Text("Configure Graph:");
+    ImGui::SameLine(align);
+    ImGui::Text("Ctrl + Enter");
+    ImGui::Separator();
+    ImGui::Separator();
+    ImGui::Separator();
+    ImGui::Text("Video/Audio FilterGraph Outputs:");
+    ImGui::Separator();
+    ImGui::Text("Pause playback:");
+    ImGui::SameLine(align);
+    ImGui::Text("Space");
+    ImGui::Separator();
+    ImGui::Text("Toggle fullscreen:");
+    ImGui::SameLine(align);
+    ImGui::Text("F");
+    ImGui::Separator();
+    ImGui::Text("Toggle zooming:");
+    ImGui::SameLine(align);
+    ImGui::Text("Z");
+    ImGui::Separator();
+    ImGui::Text("Framestep forward:");
+    ImGui::SameLine(align);
+    ImGui::Text("'.'");
+    ImGui::Separator();
+    ImGui::Text("Framestep backward through cached frames:");
+    ImGui::SameLine(align);
+    ImGui::Text("','");
+    ImGui::Separator();
+    ImGui::Text("Toggle OSD:");
+    ImGui::SameLine(align);
+    ImGui::Text("O");
+    ImGui::Separator();
+    ImGui::Text("Toggle Video outputs grid:");
+    ImGui::SameLine(align);
+    ImGui::Text("G");
+    ImGui::Separator();
+    ImGui::Text("Jump to #numbered Video output:");
+    ImGui::SameLine(align);
+    ImGui::Text("Ctrl + <number>");
+    ImGui::Separator();
+    ImGui::Text("Jump to #numbered Audio output:");
+    ImGui::SameLine(align);
+    ImGui::Text("Alt + <number>");
+    ImGui::Separator();
+    ImGui::Text("Toggle Audio output mute:");
+    ImGui::SameLine(align);
+    ImGui::Text("M");
+    ImGui::Separator();
+    ImGui::Text("Show Extended Info:");
+    ImGui::SameLine(align);
+    ImGui::Text("I");
+    ImGui::Separator();
+    ImGui::Text("Exit from output:");
+    ImGui::SameLine(align);
+    ImGui::Text("Shift + Q");
+    ImGui::Separator();
+    ImGui::End();
+}
+
+static void add_filter_node(const AVFilter *filter, ImVec2 pos)
+{
+    FilterNode node;
+
+    node.edge = editor_edge++;
+    node.filter = filter;
+    node.id = filter_nodes.size();
+    node.filter_name = av_strdup(filter->name);
+    node.filter_label = av_asprintf("%s%d", filter->name, node.id);
+    node.filter_options = NULL;
+    node.ctx_options = NULL;
+    node.probe = NULL;
+    node.ctx = NULL;
+    node.pos = pos;
+    node.colapsed = false;
+    node.set_pos = true;
+    node.tap_pad = -1;
+
+    filter_nodes.push_back(node);
+}
+
+static void draw_console(bool *p_open)
+{
+    char input_line[4096] = { 0 };
+    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration |
+                                          ImGuiWindowFlags_NoSavedSettings |
+                                          ImGuiWindowFlags_NoNav |
+                                          ImGuiWindowFlags_NoMove;
+
+    ImGui::SetNextWindowPos(ImVec2(0, display_h - 35));
+    ImGui::SetNextWindowSize(ImVec2(display_w, 30));
+    ImGui::SetNextWindowBgAlpha(0.5f);
+    ImGui::SetNextWindowFocus();
+
+    if (!ImGui::Begin("##Console", p_open, window_flags)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGuiInputTextFlags input_text_flags = ImGuiInputTextFlags_EnterReturnsTrue;
+
+    ImGui::SetKeyboardFocusHere();
+    ImGui::PushStyleColor(ImGuiCol_FrameBg, IM_COL32(0,   0, 0, 200));
+    ImGui::PushStyleColor(ImGuiCol_Text,    IM_COL32(0, 255, 0, 200));
+    if (ImGui::InputText("##>", input_line, IM_ARRAYSIZE(input_line), input_text_flags)) {
+        if (!strncmp(input_line, "a ", 2) && filter_graph_is_valid == false) {
+            const AVFilter *filter = avfilter_get_by_name(input_line + 2);
+
+            if (filter)
+                add_filter_node(filter, ImVec2(0, 0));
+        }
+    }
+    ImGui::PopStyleColor();
+    ImGui::PopStyleColor();
+
+    ImGui::End();
+}
+
+static void draw_osd(BufferSink *sink, int width, int height, int64_t pos)
+{
+    char osd_text[1024];
+
+    snprintf(osd_text, sizeof(osd_text), "FRAME: %ld | SIZE: %dx%d | TIME: %.5f | SPEED: %011.5f | AHEAD: %u/%d (%.1f MiB) | FPS: %d/%d (%.5f) | POS: %ld",
+             sink->frame_number - 1,
+             width, height,
+             av_q2d(sink->time_base) * sink->pts,
+             sink->speed,
+             ring_buffer_num_items(&sink->consume_frames), sink->readahead_frames,
+             __atomic_load_n(&sink->consume_bytes, __ATOMIC_RELAXED) / (1024. * 1024.),
+             sink->frame_rate.num, sink->frame_rate.den, av_q2d(sink->frame_rate), pos);
+    av_strlcatf(osd_text, sizeof(osd_text), " | MEM: %.1f MiB", get_sink_bytes(sink) / (1024. * 1024.));
+    if (present_by_clock)
+        av_strlcatf(osd_text, sizeof(osd_text), " | LATE: %ld | DROPPED: %ld | DRIFT: %+.3f",
+                    sink->frames_late, sink->frames_dropped, sink->drift / 1000000.);
+
+    if (sink->fullscreen) {
+        ImVec2 max_size = ImGui::GetIO().DisplaySize;
+        ImVec2 tsize = ImGui::CalcTextSize(osd_text);
+        ImVec2 start_pos = ImVec2(std::min(max_size.x * osd_fullscreen_pos[0], max_size.x - tsize.x - 25), std::min(max_size.y * osd_fullscreen_pos[1], max_size.y - tsize.y - 25));
+        ImVec2 stop_pos = ImVec2(std::min(start_pos.x + tsize.x + 25, max_size.x), std::min(start_pos.y + tsize.y + 25, max_size.y));
+        ImGui::GetWindowDrawList()->AddRectFilled(start_pos, stop_pos,
+                                                  ImGui::GetColorU32(ImGuiCol_WindowBg, osd_transparency));
+        ImGui::SetCursorPos(ImVec2(std::min(start_pos.x + 12, max_size.x - tsize.x - 12), std::min(start_pos.y + 12, max_size.y - tsize.y - 12)));
+        ImGui::Text(osd_text);
+    } else {
+        ImGui::TextWrapped(osd_text);
+    }
+}
+
+static void draw_readahead_options(BufferSink *sink)
+{
+    const int max_frames = std::max(sink->consume_frames.capacity, 1U);
+
+    ImGui::DragInt("Read-ahead Frames", &sink->readahead_frames, 0.1f, 1, max_frames, "%d", ImGuiSliderFlags_AlwaysClamp);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", "Maximum number of frames decoded ahead of presentation");
+    ImGui::DragInt("Read-ahead Budget", &sink->readahead_mb, 1.f, 0, 65536, sink->readahead_mb ? "%d MiB" : "unlimited", ImGuiSliderFlags_AlwaysClamp);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", "Maximum memory held by frames decoded ahead of presentation");
+}
+
+static void draw_shm_export_option(BufferSink *sink)
+{
+#ifndef _WIN32
+    bool shm_export = __atomic_load_n(&sink->shm_export, __ATOMIC_RELAXED);
+
+    if (ImGui::Checkbox("Shared Memory Export", &shm_export))
+        __atomic_store_n(&sink->shm_export, shm_export, __ATOMIC_RELAXED);
+    if (shm_export) {
+        char name[128];
+
+        get_shm_export_name(sink, __atomic_load_n(&sink->shm_generation, __ATOMIC_RELAXED), name, sizeof(name));
+        ImGui::SameLine();
+        ImGui::TextDisabled("%s", name);
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", "Copy every frame of this output into a POSIX shared memory ring for external readers");
+#endif
+}
+
+static void draw_frame_cache_slider(BufferSink *sink)
+{
+    const int last = sink->frame_cache.size() - 1;
+    int index = sink->cache_index >= 0 ? sink->cache_index : last;
+    char time[64];
+
+    snprintf(time, sizeof(time), "%.3f s", av_q2d(sink->time_base) * sink->frame_cache[index].frame->pts);
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.7f);
+    if (ImGui::SliderInt("Cached Frames", &index, 0, last, time, ImGuiSliderFlags_AlwaysClamp)) {
+        paused = true;
+        sink->cache_index = index;
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%d frames, %.1f MiB cached%s", last + 1, sink->frame_cache_bytes / (1024. * 1024.),
+                          sink->cache_index >= 0 ? "\nUnpause or step past the end to resume live output" : "");
+}
+
+static void update_frame_info(FrameInfo *frame_info, const AVFrame *frame)
+{
+    if (!ImGui::IsKeyDown(ImGuiKey_I))
+        return;
+
+    frame_info->width = frame->width;
+    frame_info->height = frame->height;
+    frame_info->nb_samples = frame->nb_samples;
+    frame_info->format = frame->format;
+    frame_info->key_frame = frame->key_frame;
+    frame_info->pict_type = frame->pict_type;
+    frame_info->sample_aspect_ratio = frame->sample_aspect_ratio;
+    frame_info->pts = frame->pts;
+    frame_info->pkt_dts = frame->pkt_dts;
+    frame_info->time_base = frame->time_base;
+    frame_info->coded_picture_number = frame->coded_picture_number;
+    frame_info->display_picture_number = frame->display_picture_number;
+    frame_info->interlaced_frame = frame->interlaced_frame;
+    frame_info->top_field_first = frame->top_field_first;
+    frame_info->sample_rate = frame->sample_rate;
+    frame_info->color_range = frame->color_range;
+    frame_info->color_primaries = frame->color_primaries;
+    frame_info->color_trc = frame->color_trc;
+    frame_info->colorspace = frame->colorspace;
+    frame_info->chroma_location = frame->chroma_location;
+    frame_info->pkt_pos = frame->pkt_pos;
+    frame_info->pkt_duration = frame->pkt_duration;
+    frame_info->pkt_size = frame->pkt_size;
+    frame_info->crop_top = frame->crop_top;
+    frame_info->crop_bottom = frame->crop_bottom;
+    frame_info->crop_left = frame->crop_left;
+    frame_info->crop_right = frame->crop_right;
+}
+
+static void draw_pixel_values(const AVFrame *frame, BufferSink *sink, GLuint texture, float fx, float fy)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    const int x = av_clip((int)fx, 0, frame->width - 1);
+    const int y = av_clip((int)fy, 0, frame->height - 1);
+    GLint old_framebuffer;
+    uint8_t rgba[4] = { 0 };
+    char raw[128] = { 0 };
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, sink->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glReadPixels(x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+
+    if (desc && !(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))) {
+        for (int c = 0; c < desc->nb_components; c++) {
+            const bool chroma = (c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+            uint16_t value = 0;
+
+            av_read_image_line2(&value, (const uint8_t **)frame->data, frame->linesize, desc,
+                                chroma ? x >> desc->log2_chroma_w : x,
+                                chroma ? y >> desc->log2_chroma_h : y, c, 1, 0, 2);
+            av_strlcatf(raw, sizeof(raw), "%s%u", c ? " " : "", value);
+        }
+    }
+
+    ImGui::Text("X: %d Y: %d", x, y);
+    ImGui::Text("RGBA: %u %u %u %u", rgba[0], rgba[1], rgba[2], rgba[3]);
+    if (raw[0])
+        ImGui::Text("%s: %s", desc->name, raw);
+}
+
+static AVFrame *select_frame(BufferSink *sink, AVFrame *new_frame)
+{
+    AVFrame *frame = new_frame;
+
+    if (!paused)
+        sink->cache_index = -1;
+    if (sink->cache_index < 0) {
+        cache_frame(sink, new_frame);
+    } else {
+        frame = sink->frame_cache[sink->cache_index].frame;
+        sink->frame_cache[sink->cache_index].last_used = ++sink->frame_cache_clock;
+    }
+
+    update_frame_info(&frame_info, frame);
+    sink->pts = frame->pts;
+
+    return frame;
+}
+
+static void mark_frame_shown(BufferSink *sink, AVFrame *new_frame)
+{
+    if (new_frame && new_frame->nb_samples == 0) {
+        sink->frame_number++;
+        new_frame->nb_samples = 1;
+    }
+}
+
+static void draw_frame(GLuint *texture, bool *p_open, AVFrame *new_frame,
+                       BufferSink *sink)
+{
+    ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
+    AVFrame *frame = new_frame;
+    ImVec2 image_min, image_max;
+    int width, height;
+    bool style = false;
+
+    if (!*p_open || !new_frame)
+        goto end;
+
+    frame = select_frame(sink, new_frame);
+
+    load_frame(texture, &width, &height, frame, sink);
+    if (sink->fullscreen) {
+        const ImGuiViewport *viewport = ImGui::GetMainViewport();
+
+        sink->have_window_pos = true;
+
+        ImGui::SetNextWindowPos(viewport->Pos);
+        ImGui::SetNextWindowSize(viewport->Size);
+
+        flags |= ImGuiWindowFlags_NoDecoration;
+        flags |= ImGuiWindowFlags_NoTitleBar;
+        flags |= ImGuiWindowFlags_NoMove;
+        flags |= ImGuiWindowFlags_NoResize;
+
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
+        style = true;
+    } else {
+        ImGui::SetNextWindowSizeConstraints(ImVec2(width + 20, height), ImVec2(width + 20, height + 200));
+        if (sink->have_window_pos == true) {
+            ImGui::SetNextWindowPos(sink->window_pos);
+            sink->have_window_pos = false;
+        }
+    }
+
+    if (focus_buffersink_window == sink->id) {
+        ImGui::SetNextWindowFocus();
+        focus_buffersink_window = -1;
+    }
+
+    if (!ImGui::Begin(sink->label, p_open, flags)) {
+        ImGui::End();
+        goto end;
+    }
+
+    if (sink->fullscreen == false)
+        sink->window_pos = ImGui::GetWindowPos();
+
+    if (ImGui::IsWindowFocused()) {
+        if (ImGui::IsKeyReleased(ImGuiKey_F))
+            sink->fullscreen = !sink->fullscreen;
+        if (ImGui::IsKeyReleased(ImGuiKey_Space))
+            paused = !paused;
+        framestep = ImGui::IsKeyPressed(ImGuiKey_Period, true);
+        if (framestep) {
+            paused = true;
+            if (sink->cache_index >= 0) {
+                framestep = false;
+                step_frame_cache(sink, 1);
+            }
+        }
+        if (ImGui::IsKeyPressed(ImGuiKey_Comma, true)) {
+            paused = true;
+            step_frame_cache(sink, -1);
+        }
+        if (ImGui::IsKeyDown(ImGuiKey_Q) && ImGui::GetIO().KeyShift) {
+            show_abuffersink_window = false;
+            show_buffersink_window = false;
+            filter_graph_is_valid = false;
+        }
+        if (ImGui::IsKeyReleased(ImGuiKey_O))
+            sink->show_osd = !sink->show_osd;
+        if (ImGui::IsKeyReleased(ImGuiKey_G))
+            grid_presentation = true;
+    }
+
+    if (ImGui::IsKeyDown((ImGuiKey)(ImGuiKey_0 + sink->id)) && ImGui::GetIO().KeyCtrl)
+        focus_buffersink_window = sink->id;
+
+    if (sink->fullscreen) {
+        image_min = ImVec2(0.f, 0.f);
+        image_max = ImGui::GetWindowSize();
+        ImGui::GetWindowDrawList()->AddImage((void*)(intptr_t)*texture, image_min, image_max,
+                                             ImVec2(0.f, 0.f), ImVec2(1.f, 1.f), IM_COL32_WHITE);
+    } else {
+        ImGui::Image((void*)(intptr_t)*texture, ImVec2(width, height));
+        image_min = ImGui::GetItemRectMin();
+        image_max = ImGui::GetItemRectMax();
+    }
+    draw_scope(sink, image_min, image_max);
+
+    if ((ImGui::IsItemHovered() || sink->fullscreen) && ImGui::IsKeyDown(ImGuiKey_Z)) {
+        ImGuiIO& io = ImGui::GetIO();
+        ImVec2 size = ImGui::GetWindowSize();
+        ImVec2 pos = ImGui::GetWindowPos();
+        ImGui::BeginTooltip();
+        float my_tex_w = (float)width;
+        float my_tex_h = (float)height;
+        ImVec4 tint_col   = ImVec4(1.0f, 1.0f, 1.0f, 1.0f); // No tint
+        ImVec4 border_col = ImVec4(1.0f, 1.0f, 1.0f, 0.5f); // 50% opaque white
+        float region_sz = 32.0f;
+        float region_x = (io.MousePos.x - pos.x - region_sz * 0.5f) * width  / size.x;
+        float region_y = (io.MousePos.y - pos.y - region_sz * 0.5f) * height / size.y;
+        static float zoom = 4.f;
+        zoom = av_clipf(zoom + io.MouseWheel * 0.3f, 1.5f, 12.f);
+        if (region_x < 0.0f) { region_x = 0.0f; }
+        else if (region_x > my_tex_w - region_sz) { region_x = my_tex_w - region_sz; }
+        if (region_y < 0.0f) { region_y = 0.0f; }
+        else if (region_y > my_tex_h - region_sz) { region_y = my_tex_h - region_sz; }
+        ImVec2 uv0 = ImVec2((region_x) / my_tex_w, (region_y) / my_tex_h);
+        ImVec2 uv1 = ImVec2((region_x + region_sz) / my_tex_w, (region_y + region_sz) / my_tex_h);
+        ImGui::Image((void*)(intptr_t)*texture, ImVec2(region_sz * zoom, region_sz * zoom), uv0, uv1, tint_col, border_col);
+        draw_pixel_values(frame, sink, *texture,
+                          (io.MousePos.x - image_min.x) * width  / std::max(image_max.x - image_min.x, 1.f),
+                          (io.MousePos.y - image_min.y) * height / std::max(image_max.y - image_min.y, 1.f));
+        ImGui::EndTooltip();
+    }
+
+    if (sink->show_osd)
+        draw_osd(sink, width, height, frame->pkt_pos);
+
+    if (sink->show_osd && !sink->fullscreen) {
+        draw_readahead_options(sink);
+        draw_shm_export_option(sink);
+        ImGui::Combo("Scope", &sink->scope, "None\0Histogram\0Waveform\0Vectorscope\0");
+    }
+
+    if (!sink->fullscreen && sink->frame_cache.size() > 1)
+        draw_frame_cache_slider(sink);
+
+    if (style) {
+        ImGui::PopStyleVar();
+        ImGui::PopStyleVar();
+    }
+
+    ImGui::End();
+
+end:
+
+    mark_frame_shown(sink, new_frame);
+}
+
+static void draw_grid(bool *p_open)
+{
+    std::vector<AVFrame *> new_frames(buffer_sinks.size(), NULL);
+    std::vector<AVFrame *> frames(buffer_sinks.size(), NULL);
+    int max_width = 0, max_height = 0;
+    int grid_width, grid_height;
+    ImVec2 image_min, avail, size;
+    float scale;
+    bool relayout;
+
+    if (!*p_open)
+        goto end;
+
+    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+
+        ring_buffer_peek(&sink->render_frames, &new_frames[i], 0);
+        if (!new_frames[i])
+            continue;
+
+        frames[i] = select_frame(sink, new_frames[i]);
+        max_width  = std::max(max_width, frames[i]->width);
+        max_height = std::max(max_height, frames[i]->height);
+    }
+
+    if (!max_width || !max_height)
+        goto end;
+
+    relayout = update_grid_layout(buffer_sinks.size(), max_width, max_height);
+    update_grid_tiles(frames, relayout);
+
+    glBindTexture(GL_TEXTURE_2D, grid_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, global_downscale_interpolation);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, global_upscale_interpolation);
+
+    grid_width  = grid_columns * grid_cell_width;
+    grid_height = grid_rows * grid_cell_height;
+    ImGui::SetNextWindowSize(ImVec2(std::min(grid_width + 20, display_w * 4 / 5),
+                                    std::min(grid_height + 40, display_h * 4 / 5)), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Video Outputs Grid", p_open)) {
+        ImGui::End();
+        goto end;
+    }
+
+    if (ImGui::IsWindowFocused()) {
+        if (ImGui::IsKeyReleased(ImGuiKey_G))
+            grid_presentation = false;
+        if (ImGui::IsKeyReleased(ImGuiKey_Space))
+            paused = !paused;
+        framestep = ImGui::IsKeyPressed(ImGuiKey_Period, true);
+        if (framestep) {
+            paused = true;
+            for (unsigned i = 0; i < buffer_sinks.size(); i++)
+                buffer_sinks[i].cache_index = -1;
+        }
+        if (ImGui::IsKeyDown(ImGuiKey_Q) && ImGui::GetIO().KeyShift) {
+            show_abuffersink_window = false;
+            show_buffersink_window = false;
+            filter_graph_is_valid = false;
+        }
+    }
+
+    avail = ImGui::GetContentRegionAvail();
+    scale = std::max(std::min(avail.x / grid_width, avail.y / grid_height), 0.01f);
+    size = ImVec2(grid_width * scale, grid_height * scale);
+    ImGui::Image((void*)(intptr_t)grid_texture, size);
+    image_min = ImGui::GetItemRectMin();
+
+    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+        const ImVec2 pos(image_min.x + (i % grid_columns) * grid_cell_width  * scale + 4.f,
+                         image_min.y + (i / grid_columns) * grid_cell_height * scale + 2.f);
+
+        ImGui::GetWindowDrawList()->AddText(pos, IM_COL32_WHITE, buffer_sinks[i].label);
+    }
+
+    if (ImGui::IsItemHovered()) {
+        const ImVec2 mouse = ImGui::GetIO().MousePos;
+        const int column = (int)((mouse.x - image_min.x) / (grid_cell_width  * scale));
+        const int row    = (int)((mouse.y - image_min.y) / (grid_cell_height * scale));
+        const unsigned index = row * grid_columns + column;
+
+        if (column >= 0 && column < grid_columns && row >= 0 && index < buffer_sinks.size()) {
+            BufferSink *sink = &buffer_sinks[index];
+
+            ImGui::BeginTooltip();
+            ImGui::Text("%s", sink->label);
+            ImGui::Text("FRAME: %ld", sink->frame_number);
+            ImGui::Text("PTS: %ld", sink->pts);
+            if (frames[index])
+                ImGui::Text("SIZE: %dx%d", frames[index]->width, frames[index]->height);
+            ImGui::EndTooltip();
+
+            if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+                grid_presentation = false;
+                focus_buffersink_window = sink->id;
+            }
+        }
+    }
+
+    ImGui::End();
+
+end:
+
+    for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+        BufferSink *sink = &buffer_sinks[i];
+
+        mark_frame_shown(sink, new_frames[i]);
+        if (ImGui::IsKeyDown((ImGuiKey)(ImGuiKey_0 + sink->id)) && ImGui::GetIO().KeyCtrl) {
+            grid_presentation = false;
+            focus_buffersink_window = sink->id;
+        }
+    }
+}
+
+static void draw_spectrogram(BufferSink *sink, ImVec2 size)
+{
+    if (!sink->spectrogram_texture) {
+        glGenTextures(1, &sink->spectrogram_texture);
+        glBindTexture(GL_TEXTURE_2D, sink->spectrogram_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SPECTRUM_SIZE / 2, SPECTROGRAM_ROWS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        sink->spectrogram_row = 0;
+    }
+
+    if (sink->new_spectrum) {
+        uint8_t row[SPECTRUM_SIZE / 2][4];
+
+        for (int n = 0; n < SPECTRUM_SIZE / 2; n++) {
+            const float v = av_clipf((sink->spectrum[n] + 120.f) / 120.f, 0.f, 1.f);
+
+            row[n][0] = av_clip_uint8(lrintf(v * 3.f * 255.f));
+            row[n][1] = av_clip_uint8(lrintf((v * 3.f - 1.f) * 255.f));
+            row[n][2] = av_clip_uint8(lrintf((v * 3.f - 2.f) * 255.f));
+            row[n][3] = 255;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, sink->spectrogram_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, sink->spectrogram_row, SPECTRUM_SIZE / 2, 1, GL_RGBA, GL_UNSIGNED_BYTE, row);
+        sink->spectrogram_row = (sink->spectrogram_row + 1) % SPECTROGRAM_ROWS;
+    }
+
+    if (size.x <= 0.f)
+        size.x = ImGui::CalcItemWidth();
+    ImGui::Image((void*)(intptr_t)sink->spectrogram_texture, size,
+                 ImVec2(0.f, (float)sink->spectrogram_row / SPECTROGRAM_ROWS),
+                 ImVec2(1.f, (float)sink->spectrogram_row / SPECTROGRAM_ROWS + 1.f));
+}
+
+static void draw_aframe(bool *p_open, BufferSink *sink)
+{
+    ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
+    ALint queued;
+
+    if (!*p_open)
+        return;
+
+    if (focus_abuffersink_window == sink->id) {
+        ImGui::SetNextWindowFocus();
+        focus_abuffersink_window = -1;
+    }
+
+    if (!ImGui::Begin(sink->label, p_open, flags)) {
+        ImGui::End();
+        return;
+    }
+
+    if (ImGui::IsWindowFocused()) {
+        if (ImGui::IsKeyReleased(ImGuiKey_Space))
+            paused = !paused;
+        if (ImGui::IsKeyReleased(ImGuiKey_M))
+            sink->muted = !sink->muted;
+        framestep = ImGui::IsKeyPressed(ImGuiKey_Period, true);
+        if (framestep)
+            paused = true;
+        if (ImGui::IsKeyDown(ImGuiKey_Q) && ImGui::GetIO().KeyShift) {
+            show_abuffersink_window = false;
+            show_buffersink_window = false;
+            filter_graph_is_valid = false;
+        }
+        if (ImGui::IsKeyReleased(ImGuiKey_O))
+            sink->show_osd = !sink->show_osd;
+    }
+
+    if (ImGui::IsKeyDown((ImGuiKey)(ImGuiKey_0 + sink->id)) && ImGui::GetIO().KeyAlt)
+        focus_abuffersink_window = sink->id;
+
+    ImVec2 window_size = { audio_window_size[0], audio_window_size[1] };
+    if (sink->audio_view == AUDIO_VIEW_SPECTRUM && sink->spectrum) {
+        ImGui::PlotLines("##Audio Spectrum", sink->spectrum, SPECTRUM_SIZE / 2, 0, NULL, -120.f, 0.f, window_size);
+    } else if (sink->audio_view == AUDIO_VIEW_SPECTROGRAM && sink->spectrum) {
+        draw_spectrogram(sink, window_size);
+    } else {
+        ImGui::PlotLines("##Audio Samples", sink->samples, sink->nb_samples, 0, NULL, -audio_sample_range[0], audio_sample_range[1], window_size);
+    }
+    sink->new_spectrum = false;
+    if (sink->show_osd) {
+        ImGui::Text("FRAME: %ld", sink->frame_number);
+        ImGui::Text("SIZE:  %d", sink->frame_nb_samples);
+        ImGui::Text("TIME:  %.5f", sink->pts != AV_NOPTS_VALUE ? av_q2d(sink->time_base) * sink->pts : NAN);
+        ImGui::Text("SPEED: %011.5f", sink->speed);
+        ImGui::Text("AHEAD: %u/%d (%.1f MiB)", ring_buffer_num_items(&sink->consume_frames), sink->readahead_frames,
+                    __atomic_load_n(&sink->consume_bytes, __ATOMIC_RELAXED) / (1024. * 1024.));
+        ImGui::Text("MEM:   %.1f MiB", get_sink_bytes(sink) / (1024. * 1024.));
+        alGetSourcei(sink->source, AL_BUFFERS_QUEUED, &queued);
+        ImGui::Text("POS:   %ld", sink->pos);
+        ImGui::Text("QUEUE: %d/%d (%.1f ms, %ld underruns)", queued, sink->queue_target,
+                    sink->frame_rate.num > 0 ? 1000. * queued * sink->frame_nb_samples / sink->frame_rate.num : 0.,
+                    sink->underruns);
+        for (int c = 0; c < sink->nb_channels; c++)
+            ImGui::Text("CH%d:   PEAK %6.1f dB | RMS %6.1f dB", c,
+                        20.f * log10f(sink->peak[c] + 1e-9f), 20.f * log10f(sink->rms[c] + 1e-9f));
+    }
+    ImGui::Combo("View", &sink->audio_view, "Waveform\0Spectrum\0Spectrogram\0");
+    if (ImGui::DragFloat("Gain", &sink->gain, 0.01f, 0.f, 2.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
+        alSourcef(sink->source, AL_GAIN, sink->gain);
+    if (ImGui::DragFloat3("Position", sink->position, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
+        alSource3f(sink->source, AL_POSITION, sink->position[0], sink->position[1], sink->position[2]);
+    draw_readahead_options(sink);
+    draw_shm_export_option(sink);
+
+    ImGui::End();
+}
+
+static void queue_sound(AVFrame *frame, BufferSink *sink)
+{
+    const ALsizei size = (ALsizei)frame->nb_samples * frame->ch_layout.nb_channels * sizeof(float);
+    ALint processed = 0;
+    ALint state = 0;
+    int64_t trace_start;
+    ALuint bufid;
+
+    alSourcef(sink->source, AL_GAIN, sink->gain * !sink->muted);
+
+    alGetSourcei(sink->source, AL_BUFFERS_PROCESSED, &processed);
+    while (processed > 0 && (!paused || framestep)) {
+        alSourceUnqueueBuffers(sink->source, 1, &bufid);
+        processed--;
+
+        sink->processed_bufids.push_back(bufid);
+    }
+
+    if (frame->nb_samples <= 0)
+        return;
+
+    if (sink->processed_bufids.size() > 0) {
+        bufid = sink->processed_bufids.back();
+        sink->processed_bufids.pop_back();
+    } else if (sink->unprocessed_bufids.size() > 0) {
+        bufid = sink->unprocessed_bufids.back();
+        sink->unprocessed_bufids.pop_back();
+    } else {
+        return;
+    }
+
+    trace_start = trace_begin();
+    alBufferData(bufid, sink->format, frame->extended_data[0], size, frame->sample_rate);
+    alSourceQueueBuffers(sink->source, 1, &bufid);
+    trace_end("alBufferData", trace_start, sink);
+    frame->nb_samples = 0;
+
+    alGetSourcei(sink->source, AL_SOURCE_STATE, &state);
+    if (state == AL_STOPPED && !paused && sink->queued_buffers > 0) {
+        sink->underruns++;
+        sink->queue_target = std::min(sink->queue_target + 2, AL_BUFFERS);
+        sink->queued_buffers = 0;
+        alSourcePlay(sink->source);
+    } else if (++sink->queued_buffers % 1024 == 0 && sink->queue_target > 2) {
+        sink->queue_target--;
+    }
+}
+
+static bool query_ranges(void *obj, const AVOption *opt,
+                         double *min, double *max)
+{
+    switch (opt->type) {
+        case AV_OPT_TYPE_INT:
+        case AV_OPT_TYPE_INT64:
+        case AV_OPT_TYPE_UINT64:
+        case AV_OPT_TYPE_DOUBLE:
+        case AV_OPT_TYPE_FLOAT:
+        case AV_OPT_TYPE_RATIONAL:
+        case AV_OPT_TYPE_BOOL:
+        case AV_OPT_TYPE_FLAGS:
+        case AV_OPT_TYPE_DURATION:
+            *min = opt->min;
+            *max = opt->max;
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+static bool is_simple_filter(const AVFilter *filter)
+{
+    if (avfilter_filter_pad_count(filter, 0) == 1 &&
+        avfilter_filter_pad_count(filter, 1) == 1)
+        return true;
+    return false;
+}
+
+static bool is_simple_audio_filter(const AVFilter *filter)
+{
+    if (is_simple_filter(filter) &&
+        avfilter_pad_get_type(filter->inputs,  0) == AVMEDIA_TYPE_AUDIO &&
+        avfilter_pad_get_type(filter->outputs, 0) == AVMEDIA_TYPE_AUDIO) {
+        return true;
+    }
+    return false;
+}
+
+static bool is_simple_video_filter(const AVFilter *filter)
+{
+    if (is_simple_filter(filter) &&
+        avfilter_pad_get_type(filter->inputs,  0) == AVMEDIA_TYPE_VIDEO &&
+        avfilter_pad_get_type(filter->outputs, 0) == AVMEDIA_TYPE_VIDEO) {
+        return true;
+    }
+    return false;
+}
+
+static bool is_source_filter(const AVFilter *filter)
+{
+    if ((avfilter_filter_pad_count(filter, 0)  > 0  ||  (filter->flags & AVFILTER_FLAG_DYNAMIC_INPUTS)) ||
+        (avfilter_filter_pad_count(filter, 1) == 0  && !(filter->flags & AVFILTER_FLAG_DYNAMIC_OUTPUTS))) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool is_sink_filter(const AVFilter *filter)
+{
+    if ((avfilter_filter_pad_count(filter, 0)  > 0  ||  (filter->flags & AVFILTER_FLAG_DYNAMIC_INPUTS)) &&
+        (avfilter_filter_pad_count(filter, 1) == 0  && !(filter->flags & AVFILTER_FLAG_DYNAMIC_OUTPUTS))) {
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_source_audio_filter(const AVFilter *filter)
+{
+    if (is_source_filter(filter)) {
+        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 1); i++) {
+            if (avfilter_pad_get_type(filter->outputs, i) != AVMEDIA_TYPE_AUDIO)
+                return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_source_video_filter(const AVFilter *filter)
+{
+    if (is_source_filter(filter)) {
+        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 1); i++) {
+            if (avfilter_pad_get_type(filter->outputs, i) != AVMEDIA_TYPE_VIDEO)
+                return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_source_media_filter(const AVFilter *filter)
+{
+    if (is_source_filter(filter) && !is_source_audio_filter(filter) && !is_source_video_filter(filter))
+        return true;
+    return false;
+}
+
+static bool is_sink_audio_filter(const AVFilter *filter)
+{
+    if (is_sink_filter(filter)) {
+        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 0); i++) {
+            if (avfilter_pad_get_type(filter->inputs, i) != AVMEDIA_TYPE_AUDIO)
+                return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_sink_video_filter(const AVFilter *filter)
+{
+    if (is_sink_filter(filter)) {
+        for (unsigned i = 0; i < avfilter_filter_pad_count(filter, 0); i++) {
+            if (avfilter_pad_get_type(filter->inputs, i) != AVMEDIA_TYPE_VIDEO)
+                return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_media_filter(const AVFilter *filter)
+{
+    if (is_simple_filter(filter) &&
+        avfilter_pad_get_type(filter->inputs, 0) !=
+        avfilter_pad_get_type(filter->outputs, 0)) {
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_complex_filter(const AVFilter *filter)
+{
+    if (!is_sink_filter(filter) && !is_source_filter(filter) && !is_simple_filter(filter))
+        return true;
+    return false;
+}
+
+static void handle_nodeitem(const AVFilter *filter, ImVec2 click_pos)
+{
+    if (ImGui::MenuItem(filter->name))
+        add_filter_node(filter, click_pos);
+
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", filter->description);
+}
+
+static int get_option_rows(const AVOption *opt)
+{
+    switch (opt->type) {
+        case AV_OPT_TYPE_FLAGS:
+        case AV_OPT_TYPE_BOOL:
+        case AV_OPT_TYPE_INT:
+            return opt->unit ? 2 : 1;
+        case AV_OPT_TYPE_INT64:
+        case AV_OPT_TYPE_UINT64:
+        case AV_OPT_TYPE_DURATION:
+        case AV_OPT_TYPE_DOUBLE:
+        case AV_OPT_TYPE_FLOAT:
+        case AV_OPT_TYPE_STRING:
+        case AV_OPT_TYPE_RATIONAL:
+        case AV_OPT_TYPE_IMAGE_SIZE:
+        case AV_OPT_TYPE_VIDEO_RATE:
+        case AV_OPT_TYPE_PIXEL_FMT:
+        case AV_OPT_TYPE_COLOR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static const std::vector<OptionInfo> &get_option_info(const void *obj)
+{
+    const AVClass *av_class = *(const AVClass **)obj;
+    auto it = option_info_cache.find(av_class);
+    const AVOption *opt = NULL;
+    int last_offset = -1;
+
+    if (it != option_info_cache.end())
+        return it->second;
+
+    std::vector<OptionInfo> &options = option_info_cache[av_class];
+    while ((opt = av_opt_next(obj, opt))) {
+        OptionInfo info;
+
+        info.opt = opt;
+        info.min = info.max = 0.;
+        info.alias = last_offset == opt->offset;
+        info.rows = get_option_rows(opt);
+        last_offset = opt->offset;
+        if (!query_ranges((void *)obj, opt, &info.min, &info.max))
+            info.rows = 0;
+
+        if (opt->unit && info.rows == 2) {
+            const AVOption *copt = NULL;
+
+            while ((copt = av_opt_next(obj, copt))) {
+                if (copt->unit && copt->type == AV_OPT_TYPE_CONST && !strcmp(copt->unit, opt->unit))
+                    info.consts.push_back(copt);
+            }
+        }
+
+        options.push_back(info);
+    }
+
+    return options;
+}
+
+static void draw_options(FilterNode *node, void *av_class)
+{
+    const std::vector<OptionInfo> &options = get_option_info(av_class);
+    const float row_height = ImGui::GetFrameHeightWithSpacing();
+    const float spacing = ImGui::GetStyle().ItemSpacing.y;
+    int index = 0;
+
+    for (unsigned i = 0; i < options.size(); i++) {
+        const OptionInfo *info = &options[i];
+        const AVOption *opt = info->opt;
+        uint8_t *field = (uint8_t *)av_class + opt->offset;
+        double min = info->min;
+        double max = info->max;
+
+        if (info->alias || !info->rows)
+            continue;
+        if (!ImGui::IsRectVisible(ImVec2(1.f, info->rows * row_height))) {
+            ImGui::Dummy(ImVec2(1.f, info->rows * row_height - spacing));
+            if (opt->type == AV_OPT_TYPE_COLOR)
+                index++;
+            continue;
+        }
+
+        switch (opt->type) {
+            case AV_OPT_TYPE_INT64:
+                {
+                    int64_t value = *(int64_t *)field;
+                    int64_t smin = min;
+                    int64_t smax = max;
+                    if (ImGui::DragScalar(opt->name, ImGuiDataType_S64, &value, 1, &smin, &smax, "%ld", ImGuiSliderFlags_AlwaysClamp)) {
+                        av_opt_set_int(av_class, opt->name, value, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_UINT64:
+                {
+                    uint64_t uvalue = *(uint64_t *)field;
+                    uint64_t umin = min;
+                    uint64_t umax = max;
+                    if (ImGui::DragScalar(opt->name, ImGuiDataType_U64, &uvalue, 1, &umin, &umax, "%lu", ImGuiSliderFlags_AlwaysClamp)) {
+                        av_opt_set_int(av_class, opt->name, uvalue, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_DURATION:
+                {
+                    int64_t value = *(int64_t *)field;
+                    double dvalue = value / 1000000.0;
+                    if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &dvalue, 0.1f, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
+                        value = dvalue * 1000000.0;
+                        av_opt_set_int(av_class, opt->name, value, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_FLAGS:
+            case AV_OPT_TYPE_BOOL:
+            case AV_OPT_TYPE_INT:
+                {
+                    int64_t value = opt->type == AV_OPT_TYPE_FLAGS ? *(unsigned *)field : *(int *)field;
+                    int ivalue = value;
+                    int imin = min;
+                    int imax = max;
+                    if (imax < INT_MAX/2 && imin > INT_MIN/2) {
+                        if (ImGui::SliderInt(opt->name, &ivalue, imin, imax)) {
+                            value = ivalue;
+                            av_opt_set_int(av_class, opt->name, value, 0);
+                        }
+                    } else {
+                        if (ImGui::DragInt(opt->name, &ivalue, imin, imax, ImGuiSliderFlags_AlwaysClamp)) {
+                            value = ivalue;
+                            av_opt_set_int(av_class, opt->name, value, 0);
+                        }
+                    }
+
+                    if (opt->unit) {
+                        char combo_name[20];
+
+                        snprintf(combo_name, sizeof(combo_name), "##%s", opt->unit);
+                        if (ImGui::BeginCombo(combo_name, 0, 0)) {
+                            for (unsigned j = 0; j < info->consts.size(); j++) {
+                                const AVOption *copt = info->consts[j];
+                                const bool is_selected = value == copt->default_val.i64;
+
+                                if (ImGui::Selectable(copt->name, is_selected))
+                                    av_opt_set_int(av_class, opt->name, copt->default_val.i64, 0);
+                                ImGui::SameLine();
+                                ImGui::Text("\t\t%s", copt->help);
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+
+                            ImGui::EndCombo();
+                        }
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_DOUBLE:
+                {
+                    double value = *(double *)field;
+
+                    if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &value, 1.0, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
+                        av_opt_set_double(av_class, opt->name, value, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_FLOAT:
+                {
+                    float fvalue = *(float *)field;
+                    float fmin = min;
+                    float fmax = max;
+
+                    if (ImGui::DragFloat(opt->name, &fvalue, 1.f, fmin, fmax, "%f", ImGuiSliderFlags_AlwaysClamp)) {
+                        av_opt_set_double(av_class, opt->name, fvalue, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_STRING:
+                {
+                    const char *str = *(const char **)field;
+                    char new_str[1024] = {0};
+
+                    if (str)
+                        av_strlcpy(new_str, str, sizeof(new_str));
+                    if (ImGui::InputText(opt->name, new_str, IM_ARRAYSIZE(new_str))) {
+                        av_opt_set(av_class, opt->name, new_str, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_RATIONAL:
+            case AV_OPT_TYPE_VIDEO_RATE:
+                {
+                    AVRational rate = *(AVRational *)field;
+                    int irate[2] = { rate.num, rate.den };
+
+                    if (ImGui::DragInt2(opt->name, irate, 1, -8192, 8192)) {
+                        rate.num = irate[0];
+                        rate.den = irate[1];
+                        if (opt->type == AV_OPT_TYPE_VIDEO_RATE)
+                            av_opt_set_video_rate(av_class, opt->name, rate, 0);
+                        else
+                            av_opt_set_q(av_class, opt->name, rate, 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_IMAGE_SIZE:
+                {
+                    int size[2] = { ((int *)field)[0], ((int *)field)[1] };
+
+                    if (ImGui::DragInt2(opt->name, size, 1, 1, 4096)) {
+                        av_opt_set_image_size(av_class, opt->name, size[0], size[1], 0);
+                    }
+                }
+                break;
+            case AV_OPT_TYPE_PIXEL_FMT:
+                if (ImGui::BeginCombo("pixel format", 0, 0)) {
+                    const AVPixFmtDescriptor *pix_desc = NULL;
+                    const enum AVPixelFormat fmt = *(enum AVPixelFormat *)field;
+
+                    while ((pix_desc = av_pix_fmt_desc_next(pix_desc))) {
+                        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(pix_desc);
+                        const bool is_selected = pix_fmt == fmt;
+
+                        if (ImGui::Selectable(pix_desc->name, is_selected))
+                            av_opt_set_pixel_fmt(av_class, opt->name, pix_fmt, 0);
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+                break;
+            case AV_OPT_TYPE_COLOR:
+                {
+                    const uint8_t *rgba = field;
+                    float col[4] = { rgba[0] / 255.f, rgba[1] / 255.f, rgba[2] / 255.f, rgba[3] / 255.f };
+                    char new_str[16] = { 0 };
+
+                    ImGui::PushID(index++);
+                    if (ImGui::ColorEdit4("color", col, ImGuiColorEditFlags_NoDragDrop)) {
+                        snprintf(new_str, sizeof(new_str), "0x%02x%02x%02x%02x",
+                                 (unsigned)(col[0] * 255.f), (unsigned)(col[1] * 255.f),
+                                 (unsigned)(col[2] * 255.f), (unsigned)(col[3] * 255.f));
+                        av_opt_set(av_class, opt->name, new_str, 0);
+                    }
+                    ImGui::PopID();
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (ImNodes::IsNodeSelected(node->edge) && ImGui::IsItemHovered())
+            ImGui::SetTooltip("%s", opt->help);
+    }
+}
+
+static AVFilterContext *get_node_probe(FilterNode *node)
+{
+    if (node->probe)
+        return node->probe;
+
+    if (!probe_graph)
+        probe_graph = avfilter_graph_alloc();
+    if (!probe_graph)
+        return NULL;
+    probe_graph->nb_threads = 1;
+
+    node->probe = avfilter_graph_alloc_filter(probe_graph, node->filter, "probe");
+    if (!node->probe)
+        return NULL;
+
+    if (av_opt_set_from_string(node->probe, node->ctx_options, NULL, "=", ":") < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error setting probe filter ctx options.\n");
+    if (av_opt_set_from_string(node->probe->priv, node->filter_options, NULL, "=", ":") < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error setting probe filter private options.\n");
+
+    return node->probe;
+}
+
+static void draw_filter_commands(const AVFilterContext *ctx, unsigned n, unsigned *toggle_filter,
+                                 bool is_opened, bool *clean_storage, bool tree)
+{
+    if (ctx->filter->process_command) {
+        if (tree == false) {
+            if (filter_nodes[n].colapsed == false && !ImGui::Button("Commands"))
+                return;
+            filter_nodes[n].colapsed = true;
+            if (filter_nodes[n].colapsed == true && ImGui::Button("Close"))
+                filter_nodes[n].colapsed = false;
+        }
+
+        if (tree ? ImGui::TreeNode("Commands") : ImGui::BeginListBox("##Commands", ImVec2(200, 100))) {
+            const std::vector<OptionInfo> &options = get_option_info(ctx->priv);
+            std::vector<OptStorage> &opt_storage = filter_nodes[n].opt_storage;
+            unsigned opt_index = 0;
+
+            if (is_opened && *clean_storage) {
+                opt_storage.clear();
+                *clean_storage = false;
+            }
+
+            for (unsigned i = 0; i < options.size(); i++) {
+                const AVOption *opt = options[i].opt;
+                const double min = options[i].min;
+                const double max = options[i].max;
+                bool send = false, changed = false;
+                void *ptr;
+
+                if (!(opt->flags & AV_OPT_FLAG_RUNTIME_PARAM))
+                    continue;
+
+                ptr = (uint8_t *)ctx->priv + opt->offset;
+
+                ImGui::PushID(opt_index);
+                switch (opt->type) {
+                    case AV_OPT_TYPE_FLAGS:
+                    case AV_OPT_TYPE_BOOL:
+                    case AV_OPT_TYPE_INT:
+                    case AV_OPT_TYPE_DOUBLE:
+                    case AV_OPT_TYPE_FLOAT:
+                    case AV_OPT_TYPE_INT64:
+                    case AV_OPT_TYPE_UINT64:
+                    case AV_OPT_TYPE_STRING:
+                        send = ImGui::Button("Send");
+                        ImGui::SameLine();
+                    default:
+                        break;
+                }
+
+                switch (opt->type) {
+                    case AV_OPT_TYPE_FLAGS:
+                    case AV_OPT_TYPE_BOOL:
+                        {
+                            int value = *(int *)ptr;
+                            int imin = min;
+                            int imax = max;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.i32 = *(int *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+
+                            value = opt_storage[opt_index].u.i32;
+                            if (ImGui::SliderInt(opt->name, &value, imin, imax)) {
+                                opt_storage[opt_index].u.i32 = value;
+                                changed = true;
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_INT:
+                        {
+                            int value = *(int *)ptr;
+                            int imin = min;
+                            int imax = max;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.i32 = *(int *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+                            value = opt_storage[opt_index].u.i32;
+                            if (imax < INT_MAX/2 && imin > INT_MIN/2) {
+                                if (ImGui::SliderInt(opt->name, &value, imin, imax)) {
+                                    opt_storage[opt_index].u.i32 = value;
+                                    changed = true;
+                                }
+                            } else {
+                                if (ImGui::DragInt(opt->name, &value, imin, imax, ImGuiSliderFlags_AlwaysClamp)) {
+                                    opt_storage[opt_index].u.i32 = value;
+                                    changed = true;
+                                }
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_INT64:
+                        {
+                            int64_t value = *(int64_t *)ptr;
+                            int64_t imin = min;
+                            int64_t imax = max;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.i64 = *(int64_t *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+                            value = opt_storage[opt_index].u.i64;
+                            if (ImGui::DragScalar(opt->name, ImGuiDataType_S64, &value, 1, &imin, &imax, "%ld", ImGuiSliderFlags_AlwaysClamp)) {
+                                opt_storage[opt_index].u.i64 = value;
+                                changed = true;
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_UINT64:
+                        {
+                            uint64_t value = *(uint64_t *)ptr;
+                            uint64_t umin = min;
+                            uint64_t umax = max;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.u64 = *(uint64_t *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+                            value = opt_storage[opt_index].u.u64;
+                            if (ImGui::DragScalar(opt->name, ImGuiDataType_U64, &value, 1, &umin, &umax, "%lu", ImGuiSliderFlags_AlwaysClamp)) {
+                                opt_storage[opt_index].u.u64 = value;
+                                changed = true;
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_DOUBLE:
+                        {
+                            double value = *(double *)ptr;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.dbl = *(double *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+                            value = opt_storage[opt_index].u.dbl;
+                            if (ImGui::DragScalar(opt->name, ImGuiDataType_Double, &value, 1.0, &min, &max, "%f", ImGuiSliderFlags_AlwaysClamp)) {
+                                opt_storage[opt_index].u.dbl = value;
+                                changed = true;
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_FLOAT:
+                        {
+                            float fmax = max;
+                            float fmin = min;
+                            float value;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                new_opt.u.flt = *(float *)ptr;
+                                opt_storage.push_back(new_opt);
+                            }
+                            value = opt_storage[opt_index].u.flt;
+                            if (ImGui::DragFloat(opt->name, &value, 1.f, fmin, fmax, "%f", ImGuiSliderFlags_AlwaysClamp)) {
+                                opt_storage[opt_index].u.flt = value;
+                                changed = true;
+                            }
+                        }
+                        break;
+                    case AV_OPT_TYPE_STRING:
+                        {
+                            char string[1024] = { 0 };
+                            uint8_t *str = NULL;
+
+                            if (opt_storage.size() <= opt_index) {
+                                OptStorage new_opt;
+
+                                av_opt_get(ctx->priv, opt->name, 0, &str);
+                                new_opt.u.str = (char *)str;
+                                opt_storage.push_back(new_opt);
+                            }
+
+                            if (opt_storage[opt_index].u.str)
+                                memcpy(string, opt_storage[opt_index].u.str, std::min(sizeof(string) - 1, strlen(opt_storage[opt_index].u.str)));
                             if (ImGui::InputText(opt->name, string, sizeof(string) - 1)) {
                                 av_freep(&opt_storage[opt_index].u.str);
                                 opt_storage[opt_index].u.str = av_strdup(string);
+                                changed = true;
                             }
                         }
-                        break;
-                    default:
-                        break;
+                        break;
+                    default:
+                        break;
+                }
+
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", opt->help);
+
+                if (send || (changed && live_filter_commands)) {
+                    char arg[1024] = { 0 };
+                    int ret;
+
+                    switch (opt->type) {
+                        case AV_OPT_TYPE_FLAGS:
+                        case AV_OPT_TYPE_BOOL:
+                        case AV_OPT_TYPE_INT:
+                            snprintf(arg, sizeof(arg) - 1, "%d", opt_storage[opt_index].u.i32);
+                            break;
+                        case AV_OPT_TYPE_INT64:
+                            snprintf(arg, sizeof(arg) - 1, "%ld", opt_storage[opt_index].u.i64);
+                            break;
+                        case AV_OPT_TYPE_UINT64:
+                            snprintf(arg, sizeof(arg) - 1, "%lu", opt_storage[opt_index].u.u64);
+                            break;
+                        case AV_OPT_TYPE_DOUBLE:
+                            snprintf(arg, sizeof(arg) - 1, "%f", opt_storage[opt_index].u.dbl);
+                            break;
+                        case AV_OPT_TYPE_FLOAT:
+                            snprintf(arg, sizeof(arg) - 1, "%f", opt_storage[opt_index].u.flt);
+                            break;
+                        case AV_OPT_TYPE_STRING:
+                            snprintf(arg, strlen(opt_storage[opt_index].u.str) + 1, "%s", opt_storage[opt_index].u.str);
+                            break;
+                        default:
+                            break;
+                    }
+
+                    filtergraph_mutex.lock();
+                    ret = avfilter_graph_send_command(filter_graph, ctx->name, opt->name, arg, NULL, 0, 0);
+                    filtergraph_mutex.unlock();
+                    if (ret >= 0 && get_node_probe(&filter_nodes[n]))
+                        av_opt_set(filter_nodes[n].probe->priv, opt->name, arg, 0);
+                }
+
+                opt_index++;
+
+                ImGui::PopID();
+            }
+
+            tree ? ImGui::TreePop() : ImGui::EndListBox();
+        }
+    }
+
+    if (ctx->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE) {
+        if (tree ? ImGui::TreeNode("Timeline") : ImGui::BeginListBox("##Timeline", ImVec2(80, 30))) {
+            ImGui::PushID(0);
+            if (ImGui::Button(ctx->is_disabled ? "Enable" : "Disable"))
+                *toggle_filter = n;
+            ImGui::PopID();
+            tree ? ImGui::TreePop() : ImGui::EndListBox();
+        }
+    }
+}
+
+static void draw_node_options(FilterNode *node)
+{
+    AVFilterContext *probe_ctx;
+    void *av_class_priv;
+    void *av_class;
+
+    if (filter_graph_is_valid && node->ctx) {
+        static unsigned toggle_filter = UINT_MAX;
+        static bool clean_storage = true;
+
+        draw_filter_commands(node->ctx, node->id, &toggle_filter, true, &clean_storage, false);
+
+        if (toggle_filter < UINT_MAX) {
+            const AVFilterContext *filter_ctx = node->ctx;
+            const int flag = !filter_ctx->is_disabled;
+
+            avfilter_graph_send_command(filter_graph, filter_ctx->name, "enable", flag ? "0" : "1", NULL, 0, 0);
+            toggle_filter = UINT_MAX;
+        }
+
+        return;
+    }
+
+    if (!node->colapsed && !ImGui::Button("Options"))
+        return;
+
+    probe_ctx = get_node_probe(node);
+    if (!probe_ctx)
+        return;
+    av_class_priv = probe_ctx->priv;
+    av_class = probe_ctx;
+
+    node->colapsed = true;
+    if (node->colapsed && ImGui::Button("Close")) {
+        node->colapsed = false;
+        return;
+    }
+
+    ImGui::SameLine();
+    if (node->colapsed) {
+        for (unsigned i = 0; i < video_sink_threads.size(); i++) {
+            if (video_sink_threads[i].joinable())
+                return;
+        }
+
+        for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
+            if (audio_sink_threads[i].joinable())
+                return;
+        }
+
+        if (graph_driver_thread.joinable())
+            return;
+
+        if (ImGui::Button("Remove")) {
+            av_freep(&node->filter_name);
+            av_freep(&node->filter_label);
+            av_freep(&node->filter_options);
+            av_freep(&node->ctx_options);
+            avfilter_free(node->probe);
+            node->probe = NULL;
+            avfilter_free(node->ctx);
+            node->ctx = NULL;
+            node->colapsed = false;
+            edge2pad[node->edge].is_output = false;
+            edge2pad[node->edge].removed = true;
+            filter_nodes.erase(filter_nodes.begin() + node->id);
+            return;
+        }
+    }
+
+    if (!ImGui::BeginListBox("##List of Filter Options"))
+        return;
+    draw_options(node, av_class_priv);
+    ImGui::NewLine();
+    draw_options(node, av_class);
+
+    ImGui::EndListBox();
+}
+
+static ImVec2 find_node_spot(ImVec2 start);
+
+typedef std::map<std::string, std::vector<int>> ImportLabels;
+
+static int import_add_node(const char *name, const char *label, char *filter_opts, char *ctx_opts,
+                           unsigned nb_inputs, unsigned nb_outputs)
+{
+    const AVFilter *filter = avfilter_get_by_name(name);
+    FilterNode node;
+
+    if (!filter) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot get filter by name: %s.\n", name);
+        av_freep(&filter_opts);
+        av_freep(&ctx_opts);
+        return -1;
+    }
+
+    node.id = filter_nodes.size();
+    node.edge = editor_edge++;
+    edge2pad.push_back(Edge2Pad { node.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
+    for (unsigned j = 0; j < nb_inputs; j++) {
+        node.inpad_edges.push_back(editor_edge++);
+        edge2pad.push_back(Edge2Pad { node.id, false, false, j, AVMEDIA_TYPE_UNKNOWN });
+    }
+
+    for (unsigned j = 0; j < nb_outputs; j++) {
+        node.outpad_edges.push_back(editor_edge++);
+        edge2pad.push_back(Edge2Pad { node.id, false, true, j, AVMEDIA_TYPE_UNKNOWN });
+    }
+
+    node.filter = filter;
+    node.filter_name = av_strdup(name);
+    node.filter_label = label ? av_strdup(label) : av_asprintf("%s%d", name, node.id);
+    node.filter_options = filter_opts;
+    node.ctx_options = ctx_opts;
+    node.probe = NULL;
+    node.ctx = NULL;
+    node.pos = ImVec2(0, 0);
+    node.colapsed = false;
+    node.set_pos = true;
+    node.tap_pad = -1;
+
+    filter_nodes.push_back(node);
+
+    return node.id;
+}
+
+static void import_link_labels(const ImportLabels &inputs, const ImportLabels &outputs)
+{
+    for (const auto &output : outputs) {
+        const auto input = inputs.find(output.first);
+
+        if (input == inputs.end())
+            continue;
+
+        for (unsigned i = 0; i < output.second.size(); i++) {
+            for (unsigned j = 0; j < input->second.size(); j++)
+                filter_links.push_back(std::make_pair(output.second[i], input->second[j]));
+        }
+    }
+}
+
+static void import_layout_nodes()
+{
+    const unsigned nb_nodes = filter_nodes.size();
+    std::vector<std::vector<unsigned>> next(nb_nodes);
+    std::vector<unsigned> in_degree(nb_nodes);
+    std::vector<unsigned> depth(nb_nodes);
+    std::vector<unsigned> rows;
+    std::vector<unsigned> queue;
+
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const Edge2Pad &a = edge2pad[filter_links[i].first];
+        const Edge2Pad &b = edge2pad[filter_links[i].second];
+        const unsigned src = a.is_output ? a.node : b.node;
+        const unsigned dst = a.is_output ? b.node : a.node;
+
+        next[src].push_back(dst);
+        in_degree[dst]++;
+    }
+
+    for (unsigned i = 0; i < nb_nodes; i++) {
+        if (in_degree[i] == 0)
+            queue.push_back(i);
+    }
+
+    for (unsigned q = 0; q < queue.size(); q++) {
+        const unsigned node = queue[q];
+
+        for (unsigned i = 0; i < next[node].size(); i++) {
+            const unsigned dst = next[node][i];
+
+            depth[dst] = std::max(depth[dst], depth[node] + 1);
+            if (--in_degree[dst] == 0)
+                queue.push_back(dst);
+        }
+    }
+
+    for (unsigned i = 0; i < nb_nodes; i++) {
+        const unsigned d = depth[i];
+
+        if (d >= rows.size())
+            rows.resize(d + 1);
+        filter_nodes[i].pos = ImVec2(100 + d * 250, 100 + rows[d]++ * 150);
+    }
+}
+
+#if LIBAVFILTER_VERSION_INT >= AV_VERSION_INT(9, 1, 100)
+static char *import_serialize_options(const AVFilter *filter, AVDictionary *opts, bool ctx_options)
+{
+    const AVClass *ctx_class = avfilter_get_class();
+    const AVDictionaryEntry *e = NULL;
+    AVBPrint buf;
+    char *str;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    while ((e = av_dict_get(opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
+        const bool is_priv = filter->priv_class &&
+                             av_opt_find((void *)&filter->priv_class, e->key, NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+        const bool is_ctx = !is_priv && av_opt_find((void *)&ctx_class, e->key, NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+
+        if (is_ctx != ctx_options)
+            continue;
+        if (buf.len > 0)
+            av_bprint_chars(&buf, ':', 1);
+        av_bprintf(&buf, "%s=", e->key);
+        av_bprint_escape(&buf, e->value, ":=", AV_ESCAPE_MODE_BACKSLASH, 0);
+    }
+
+    if (!buf.len || !av_bprint_is_complete(&buf)) {
+        av_bprint_finalize(&buf, NULL);
+        return NULL;
+    }
+    av_bprint_finalize(&buf, &str);
+
+    return str;
+}
+
+static int import_segment(const char *script, ImportLabels &inputs, ImportLabels &outputs)
+{
+    AVFilterGraphSegment *seg = NULL;
+    int ret;
+
+    ret = avfilter_graph_segment_parse(probe_graph, script, 0, &seg);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot parse filtergraph script.\n");
+        return ret;
+    }
+
+    for (size_t c = 0; c < seg->nb_chains; c++) {
+        const AVFilterChain *chain = seg->chains[c];
+        int prev = -1;
+
+        for (size_t k = 0; k < chain->nb_filters; k++) {
+            const AVFilterParams *params = chain->filters[k];
+            const unsigned linked_in = k > 0;
+            const unsigned linked_out = k + 1 < chain->nb_filters;
+            const AVFilter *filter = avfilter_get_by_name(params->filter_name);
+            unsigned nb_inputs = 0, nb_outputs = 0;
+            int id;
+
+            for (unsigned i = 0; i < params->nb_inputs; i++)
+                nb_inputs += params->inputs[i]->label != NULL;
+            for (unsigned i = 0; i < params->nb_outputs; i++)
+                nb_outputs += params->outputs[i]->label != NULL;
+
+            id = import_add_node(params->filter_name, params->instance_name,
+                                 filter ? import_serialize_options(filter, params->opts, false) : NULL,
+                                 filter ? import_serialize_options(filter, params->opts, true) : NULL,
+                                 nb_inputs + linked_in, nb_outputs + linked_out);
+            if (id < 0) {
+                prev = -1;
+                continue;
+            }
+
+            const FilterNode &node = filter_nodes[id];
+            unsigned pad = 0;
+
+            for (unsigned i = 0; i < params->nb_inputs; i++) {
+                if (params->inputs[i]->label)
+                    inputs[params->inputs[i]->label].push_back(node.inpad_edges[pad++]);
+            }
+
+            pad = 0;
+            for (unsigned i = 0; i < params->nb_outputs; i++) {
+                if (params->outputs[i]->label)
+                    outputs[params->outputs[i]->label].push_back(node.outpad_edges[pad++]);
+            }
+
+            if (linked_in && prev >= 0)
+                filter_links.push_back(std::make_pair(filter_nodes[prev].outpad_edges.back(), node.inpad_edges[nb_inputs]));
+            prev = id;
+        }
+    }
+
+    avfilter_graph_segment_free(&seg);
+
+    return 0;
+}
+#else
+static int import_segment(const char *script, ImportLabels &inputs, ImportLabels &outputs)
+{
+    std::vector<std::pair <int, int>> labels;
+    std::vector<std::pair <int, int>> filters;
+    std::vector<std::pair <unsigned, unsigned>> pads;
+    std::vector<int> separators;
+    std::vector<int> label2edge;
+    const int size = strlen(script);
+    int filter_start = -1;
+    int filter_stop = 0;
+    int label_start = 0;
+    int label_stop = 0;
+    int in_pad_count = -1;
+    int out_pad_count = -1;
+
+    for (int pos = 0; pos <= size; pos++) {
+        const int c = pos < size ? script[pos] : EOF;
+
+        if (c == ';' || c == EOF)
+            separators.push_back(pos);
+
+        if (c == '[' && label_start == 0 && label_stop == 0) {
+            if (filter_start >= 0) {
+                filter_stop = pos;
+                if (filter_stop - filter_start > 1)
+                    filters.push_back(std::make_pair(filter_start, filter_stop));
+                filter_start = -1;
+                filter_stop = 0;
+            }
+            label_start = pos + 1;
+        } else if (c == ']' && label_start > 0 && label_stop == 0) {
+            label_stop = pos;
+            labels.push_back(std::make_pair(label_start, label_stop));
+            label_start = label_stop = 0;
+        } else if ((c == ';' || c == EOF) && filter_start >= 0) {
+            filter_stop = pos - (c == EOF);
+            if (filter_stop - filter_start > 1)
+                filters.push_back(std::make_pair(filter_start, filter_stop));
+            filter_start = -1;
+            filter_stop = 0;
+        } else if (filter_start >= 0) {
+        } else if (label_stop == 0 && label_start == 0) {
+            filter_start = pos + (c == ';');
+        }
+    }
+
+    unsigned cur_label = 0;
+    unsigned cur_filter_idx = 0;
+    int label, filter = 0, separator = 0;
+
+    if (separators.size() != filters.size()) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot parse filtergraph script.\n");
+        return AVERROR(EINVAL);
+    }
+
+    while (cur_label < labels.size()) {
+        label = labels[cur_label].second;
+
+        if (in_pad_count == -1 && out_pad_count == -1) {
+            filter = filters[cur_filter_idx].first;
+            separator = separators[cur_filter_idx++];
+            in_pad_count = out_pad_count = 0;
+        }
+
+        if (label > separator) {
+            pads.push_back(std::make_pair(in_pad_count, out_pad_count));
+            in_pad_count = out_pad_count = -1;
+        } else if (label < filter) {
+            in_pad_count++;
+            cur_label++;
+        } else if (label < separator) {
+            out_pad_count++;
+            cur_label++;
+        }
+    }
+
+    if (in_pad_count >= 0 && out_pad_count >= 0)
+        pads.push_back(std::make_pair(in_pad_count, out_pad_count));
+    pads.resize(filters.size());
+
+    for (unsigned i = 0; i < filters.size(); i++) {
+        std::pair <int, int> p = filters[i];
+        char *name, *opts = NULL;
+        int id;
+
+        for (int j = p.first; j < p.second; j++) {
+            if (script[j] == '=') {
+                opts = av_strndup(script + j + 1, p.second - j - 1);
+                p.second = j;
+                break;
+            }
+        }
+
+        name = av_strndup(script + p.first, p.second - p.first);
+        id = name ? import_add_node(name, NULL, opts, NULL, pads[i].first, pads[i].second) : -1;
+        av_freep(&name);
+
+        for (unsigned j = 0; j < pads[i].first; j++)
+            label2edge.push_back(id < 0 ? -1 : filter_nodes[id].inpad_edges[j]);
+        for (unsigned j = 0; j < pads[i].second; j++)
+            label2edge.push_back(id < 0 ? -1 : filter_nodes[id].outpad_edges[j]);
+    }
+
+    for (unsigned i = 0; i < labels.size() && i < label2edge.size(); i++) {
+        const std::string name(script + labels[i].first, labels[i].second - labels[i].first);
+        const int edge = label2edge[i];
+
+        if (edge < 0)
+            continue;
+        if (edge2pad[edge].is_output)
+            outputs[name].push_back(edge);
+        else
+            inputs[name].push_back(edge);
+    }
+
+    return 0;
+}
+#endif
+
+static void import_filter_graph(const char *file_name)
+{
+    ImportLabels inputs, outputs;
+    uint8_t *data = NULL;
+    char *script = NULL;
+    size_t size = 0;
+    int ret;
+
+    ret = av_file_map(file_name, &data, &size, 0, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open '%s' script.\n", file_name);
+        return;
+    }
+
+    script = av_strndup((const char *)data, size);
+    av_file_unmap(data, size);
+    if (!script)
+        return;
+
+    if (!probe_graph)
+        probe_graph = avfilter_graph_alloc();
+    if (!probe_graph)
+        goto error;
+
+    editor_edge = 0;
+    edge2pad.clear();
+    filter_links.clear();
+    filter_nodes.clear();
+
+    ret = import_segment(script, inputs, outputs);
+    if (ret < 0)
+        goto error;
+
+    import_link_labels(inputs, outputs);
+    import_layout_nodes();
+
+error:
+    av_freep(&script);
+
+    need_filters_reinit = true;
+}
+
+static void export_filter_graph(char **out, size_t *out_size)
+{
+    std::vector<bool> visited;
+    std::vector<unsigned> to_visit;
+    AVBPrint buf;
+    bool first = true;
+
+    av_bprint_init(&buf, 512, AV_BPRINT_SIZE_UNLIMITED);
+
+    build_graph_index(&graph_index);
+    visited.resize(filter_nodes.size());
+
+    for (unsigned start = 0; start < filter_nodes.size(); start++) {
+        if (visited[start])
+            continue;
+
+        to_visit.push_back(start);
+
+        while (to_visit.size() > 0) {
+            unsigned node = to_visit.back();
+
+            to_visit.pop_back();
+
+            if (visited[node] == true)
+                continue;
+
+            std::vector<unsigned> node_links = graph_index.node_links[node];
+
+            std::sort(node_links.begin(), node_links.end(), [node](unsigned a, unsigned b) {
+                const std::pair<int, int> pa = filter_links[a];
+                const std::pair<int, int> pb = filter_links[b];
+                const Edge2Pad &ea = edge2pad[edge2pad[pa.first].node == node ? pa.first : pa.second];
+                const Edge2Pad &eb = edge2pad[edge2pad[pb.first].node == node ? pb.first : pb.second];
+
+                return ea.pad_index < eb.pad_index;
+            });
+            visited[node] = true;
+
+            if (first)
+                first = false;
+            else
+                av_bprintf(&buf, ";");
+
+            for (unsigned l = 0; l < node_links.size(); l++) {
+                const unsigned i = node_links[l];
+                const std::pair<int, int> p = filter_links[i];
+                const bool is_output = edge2pad[p.first].node == node ? edge2pad[p.first].is_output : edge2pad[p.second].is_output;
+
+                if (!is_output)
+                    av_bprintf(&buf, "[e%d]", i);
+            }
+
+            av_bprintf(&buf, "%s", filter_nodes[node].filter_name);
+            if (filter_nodes[node].filter_options && strlen(filter_nodes[node].filter_options) > 0)
+                av_bprintf(&buf, "=%s", filter_nodes[node].filter_options);
+
+            for (unsigned l = 0; l < node_links.size(); l++) {
+                const unsigned i = node_links[l];
+                const std::pair<int, int> p = filter_links[i];
+                const bool is_output = edge2pad[p.first].node == node ? edge2pad[p.first].is_output : edge2pad[p.second].is_output;
+
+                if (is_output)
+                    av_bprintf(&buf, "[e%d]", i);
+            }
+
+            for (unsigned l = 0; l < node_links.size(); l++) {
+                const std::pair<int, int> p = filter_links[node_links[l]];
+                unsigned a = edge2pad[p.first].node;
+                unsigned b = edge2pad[p.second].node;
+
+                to_visit.push_back(node != a ? a : b);
+            }
+        }
+    }
+
+    av_bprintf(&buf, "\n");
+
+    av_bprint_finalize(&buf, out);
+    if (av_bprint_is_complete(&buf))
+        *out_size = buf.len;
+    else
+        *out_size = buf.size;
+    av_bprint_finalize(&buf, NULL);
+}
+
+static ImVec2 find_node_spot(ImVec2 start)
+{
+    ImVec2 pos = ImVec2(start.x + 80, start.y);
+    bool got_pos = false;
+
+    while (got_pos == false) {
+        got_pos = true;
+
+        for (unsigned i = 0; i < filter_nodes.size(); i++) {
+            FilterNode node = filter_nodes[i];
+
+            if (std::abs(pos.x - node.pos.x) <= 80 &&
+                std::abs(pos.y - node.pos.y) <= 80) {
+                got_pos = false;
+                break;
+            }
+        }
+
+        if (got_pos == true)
+            break;
+
+        pos.x += ((std::rand() % 3) - 1) * 100;
+        pos.y += ((std::rand() % 3) - 1) * 100;
+    }
+
+    return pos;
+}
+
+typedef struct FilterStats {
+    int64_t time;
+    int64_t calls;
+} FilterStats;
+
+static void get_filter_stats(const FilterNode *node, FilterStats *stats)
+{
+    const AVFilterContext *ctx = node->ctx;
+    const ProfileCounter *counter;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!ctx)
+        return;
+
+    counter = find_profile_counter(profile_counters, ctx);
+    if (counter) {
+        stats->time  = __atomic_load_n(&counter->time, __ATOMIC_RELAXED);
+        stats->calls = __atomic_load_n(&counter->calls, __ATOMIC_RELAXED);
+    }
+}
+
+static void start_autotune();
+
+static void upload_tap_preview(TapPreview *tap, const AVFrame *frame)
+{
+    if (!tap->texture)
+        glGenTextures(1, &tap->texture);
+
+    glBindTexture(GL_TEXTURE_2D, tap->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[0] / 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame->width, frame->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame->data[0]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tap->width = frame->width;
+    tap->height = frame->height;
+}
+
+static void update_tap_previews()
+{
+    const int64_t now = av_gettime_relative();
+    const double rate = std::max(tap_updates_per_second, 1);
+
+    tap_budget = std::min(tap_budget + (now - tap_budget_time) * rate / 1000000., rate);
+    tap_budget_time = now;
+
+    while (tap_budget >= 1.) {
+        TapPreview *next = NULL;
+        AVFrame *frame = NULL;
+
+        {
+            std::lock_guard lk(tap_mutex);
+
+            for (unsigned i = 0; i < tap_previews.size(); i++) {
+                TapPreview *tap = &tap_previews[i];
+
+                if (tap->pending && (!next || tap->last_update < next->last_update))
+                    next = tap;
+            }
+            if (next)
+                std::swap(next->pending, frame);
+        }
+        if (!next)
+            break;
+        if (frame) {
+            upload_tap_preview(next, frame);
+            av_frame_free(&frame);
+        }
+        next->last_update = now;
+        tap_budget -= 1.;
+    }
+}
+
+static void draw_tap_preview(unsigned node)
+{
+    for (unsigned i = 0; i < tap_previews.size(); i++) {
+        const TapPreview *tap = &tap_previews[i];
+
+        if (tap->node != node || !tap->texture || !tap->width)
+            continue;
+
+        ImGui::Image((void*)(intptr_t)tap->texture, ImVec2(tap_width, tap_width * tap->height / (float)tap->width));
+        break;
+    }
+}
+
+static bool can_idle()
+{
+    if (!idle_when_paused)
+        return false;
+
+    if (need_filters_reinit || graph_build_running || render_running || autotune_running ||
+        import_script_file_name || restart_display)
+        return false;
+
+    return !filter_graph_is_valid || (paused && !framestep);
+}
+
+static void show_filtergraph_editor(bool *p_open, bool focused)
+{
+    bool erased = false;
+    int edge;
+
+    if (focused)
+        ImGui::SetNextWindowFocus();
+    ImGui::SetNextWindowSize(ImVec2(600, 500), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("FilterGraph Editor", p_open, 0)) {
+        ImGui::End();
+        return;
+    }
+
+    ImNodes::EditorContextSet(node_editor_context);
+
+    ImNodes::BeginNodeEditor();
+
+    if (ImGui::IsKeyReleased(ImGuiKey_Enter) && ImGui::GetIO().KeyCtrl)
+        need_filters_reinit = true;
+
+    const bool open_popup = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) &&
+        ImNodes::IsEditorHovered() && ((ImGui::IsKeyReleased(ImGuiKey_A) && !ImGui::GetIO().KeyShift) ||
+        ImGui::IsMouseReleased(ImGuiMouseButton_Right));
+
+    static ImVec2 click_pos;
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(8.f, 8.f));
+    if (!ImGui::IsAnyItemHovered() && open_popup) {
+        ImGui::OpenPopup("Add Filter");
+
+        click_pos = ImGui::GetMousePosOnOpeningCurrentPopup();
+        click_pos.x -= ImGui::GetWindowPos().x;
+        click_pos.y -= ImGui::GetWindowPos().y;
+    }
+
+    if (ImGui::BeginPopup("Add Filter")) {
+        if (ImGui::BeginMenu("Source Filters", filter_graph_is_valid == false)) {
+            if (ImGui::BeginMenu("Video")) {
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Video Source Filters");
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_source_video_filter(filter))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Audio")) {
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Audio Source Filters");
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_source_audio_filter(filter))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Media")) {
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Media Source Filters");
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_source_media_filter(filter))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
+        }
+        if (ImGui::BeginMenu("Simple Filters", filter_graph_is_valid == false)) {
+            if (ImGui::BeginMenu("Video")) {
+                static ImGuiTextFilter imgui_filter;
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Simple Video Filters");
+                imgui_filter.Draw();
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_simple_video_filter(filter))
+                        continue;
+
+                    if (!imgui_filter.PassFilter(filter->name))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Audio")) {
+                static ImGuiTextFilter imgui_filter;
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Simple Audio Filters");
+                imgui_filter.Draw();
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_simple_audio_filter(filter))
+                        continue;
+
+                    if (!imgui_filter.PassFilter(filter->name))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Complex Filters", filter_graph_is_valid == false)) {
+            static ImGuiTextFilter imgui_filter;
+            const AVFilter *filter = NULL;
+            void *iterator = NULL;
+
+            imgui_filter.Draw();
+            while ((filter = av_filter_iterate(&iterator))) {
+                if (!is_complex_filter(filter))
+                    continue;
+
+                if (!imgui_filter.PassFilter(filter->name))
+                    continue;
+
+                handle_nodeitem(filter, click_pos);
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Media Filters", filter_graph_is_valid == false)) {
+            const AVFilter *filter = NULL;
+            void *iterator = NULL;
+
+            while ((filter = av_filter_iterate(&iterator))) {
+                if (!is_media_filter(filter))
+                    continue;
+
+                handle_nodeitem(filter, click_pos);
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Sink Filters", filter_graph_is_valid == false)) {
+            if (ImGui::BeginMenu("Video")) {
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Sink Video Filters");
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_sink_video_filter(filter))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Audio")) {
+                const AVFilter *filter = NULL;
+                void *iterator = NULL;
+
+                ImGui::SetTooltip("%s", "Sink Audio Filters");
+                while ((filter = av_filter_iterate(&iterator))) {
+                    if (!is_sink_audio_filter(filter))
+                        continue;
+
+                    handle_nodeitem(filter, click_pos);
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Options")) {
+            if (ImGui::BeginMenu("FilterGraph", filter_graph_is_valid == false)) {
+                const char *items[] = { "quiet", "panic", "fatal", "error", "warning", "info", "verbose", "debug" };
+                const int values[] = { AV_LOG_QUIET, AV_LOG_PANIC, AV_LOG_FATAL, AV_LOG_ERROR, AV_LOG_WARNING, AV_LOG_INFO, AV_LOG_VERBOSE, AV_LOG_DEBUG };
+                static int item_current_idx = 5;
+
+                ImGui::InputInt("Max Number of FilterGraph Threads", &filter_graph_nb_threads);
+                if (autotune_running) {
+                    ImGui::Text("Auto-Tuning: %u/%zu", autotune_index + 1, autotune_threads.size());
+                } else if (ImGui::Button("Auto-Tune FilterGraph Threads") && filter_nodes.size() > 0) {
+                    start_autotune();
+                }
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Benchmarks the graph for %.1f s per thread count and keeps the fastest", AUTOTUNE_WINDOW / 1000000.);
+                ImGui::InputInt("Auto Conversion Type for FilterGraph", &filter_graph_auto_convert_flags);
+                if (ImGui::InputInt("Max Queued Frames per FilterGraph Output", &sink_queue_size))
+                    sink_queue_size = av_clip(sink_queue_size, 2, 1024);
+                ImGui::DragInt("Tap Preview Updates per Second", &tap_updates_per_second, 0.1f, 1, 120, "%d", ImGuiSliderFlags_AlwaysClamp);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Shared by all tap previews, applied on next FilterGraph configure");
+                ImGui::DragInt("Tap Preview Width", &tap_width, 1.f, 32, 640, "%d", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::Checkbox("Drive FilterGraph from Single Thread", &filter_graph_driver_mode);
+                ImGui::Checkbox("Send Filter Commands on Every Change", &live_filter_commands);
+                ImGui::Checkbox("Profile FilterGraph Filters", &filter_graph_profiling);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Runs slice threaded jobs serially to time each filter");
+                if (ImGui::BeginCombo("Hardware Device Type", hw_device_type == AV_HWDEVICE_TYPE_NONE ? "none" :
+                                      av_hwdevice_get_type_name((enum AVHWDeviceType)hw_device_type), 0)) {
+                    enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+
+                    if (ImGui::Selectable("none", hw_device_type == AV_HWDEVICE_TYPE_NONE))
+                        hw_device_type = AV_HWDEVICE_TYPE_NONE;
+                    while ((type = av_hwdevice_iterate_types(type)) != AV_HWDEVICE_TYPE_NONE) {
+                        const bool is_selected = hw_device_type == type;
+
+                        if (ImGui::Selectable(av_hwdevice_get_type_name(type), is_selected))
+                            hw_device_type = type;
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::InputText("Hardware Device Name", hw_device_name, IM_ARRAYSIZE(hw_device_name));
+                if (ImGui::BeginCombo("Log Message Level", items[item_current_idx], 0)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
+                        const bool is_selected = (item_current_idx == n);
+
+                        if (ImGui::Selectable(items[n], is_selected)) {
+                            item_current_idx = n;
+                            log_level = values[n];
+                        }
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Video Outputs")) {
+                const char *items[] = { "nearest", "linear" };
+                const GLint values[] = { GL_NEAREST, GL_LINEAR };
+                static int item_current_idx[2] = { 0, 0 };
+                const int flags = 0;
+
+                ImGui::DragFloat2("OSD Fullscreen Position", osd_fullscreen_pos, 0.01f, 0.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
+                ImGui::DragFloat("OSD Fullscreen Transparency", &osd_transparency, 0.01f, 0.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
+                if (ImGui::BeginCombo("Upscaler", items[item_current_idx[0]], flags)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
+                        const bool is_selected = (item_current_idx[0] == n);
+
+                        if (ImGui::Selectable(items[n], is_selected)) {
+                            item_current_idx[0] = n;
+                            global_upscale_interpolation = values[n];
+                        }
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+
+                ImGui::Checkbox("Native YUV Output with GPU Color Conversion", &gpu_color_conversion);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Takes effect on next FilterGraph configuration");
+                ImGui::Checkbox("Present Frames by Timestamps", &present_by_clock);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Show each frame when its pts is reached on the audio or wall clock, dropping late frames");
+                ImGui::Checkbox("Sleep While Paused", &idle_when_paused);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Wait for input or new frames instead of redrawing every vsync while paused");
+                ImGui::Checkbox("Show Outputs in Grid", &grid_presentation);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Draw all Video outputs into one shared texture and window");
+                ImGui::DragInt("Grid Texture Size", &grid_max_size, 16.f, 256, 16384, "%d", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::DragFloat("Scope Opacity", &scope_opacity, 0.01f, 0.1f, 1.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::DragInt("Frame Cache Budget", &frame_cache_mb, 1.f, 0, 65536, frame_cache_mb ? "%d MiB" : "off", ImGuiSliderFlags_AlwaysClamp);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", "Memory per Video output kept for stepping back through already shown frames");
+
+                if (ImGui::BeginCombo("Downscaler", items[item_current_idx[1]], flags)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
+                        const bool is_selected = (item_current_idx[1] == n);
+
+                        if (ImGui::Selectable(items[n], is_selected)) {
+                            item_current_idx[1] = n;
+                            global_downscale_interpolation = values[n];
+                        }
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Audio Outputs")) {
+                ImGui::DragFloat2("Sample Range", audio_sample_range, 0.01f, 1.f, 8.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
+                ImGui::InputFloat2("Window Size", audio_window_size);
+                ImGui::Checkbox("Resample Outputs to Device Rate", &resample_audio_outputs);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Device rate: %d Hz\nTakes effect on next FilterGraph configuration", output_sample_rate);
+                if (ImGui::DragFloat3("Listener Position", listener_position, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
+                    alListenerfv(AL_POSITION, listener_position);
+                if (ImGui::DragFloat3("Listener Direction At", listener_direction, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
+                    alListenerfv(AL_ORIENTATION, listener_direction);
+                if (ImGui::DragFloat3("Listener Direction Up", &listener_direction[3], 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
+                    alListenerfv(AL_ORIENTATION, listener_direction);
+
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("MiniMap")) {
+                const char *items[] = { "Off", "On" };
+                const bool values[] = { false, true };
+                const int positions[] = {
+                    ImNodesMiniMapLocation_BottomLeft,
+                    ImNodesMiniMapLocation_BottomRight,
+                    ImNodesMiniMapLocation_TopLeft,
+                    ImNodesMiniMapLocation_TopRight,
+                };
+                const char *positions_name[] = {
+                    "Bottom Left",
+                    "Bottom Right",
+                    "Top Left",
+                    "Top Right",
+                };
+                const int flags = 0;
+
+                if (ImGui::BeginCombo("Toggle Display", items[show_mini_map], flags)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
+                        const bool is_selected = values[n] == show_mini_map;
+
+                        if (ImGui::Selectable(items[n], is_selected))
+                            show_mini_map = values[n];
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+
+                if (ImGui::BeginCombo("Corner Position", positions_name[mini_map_location], flags)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(positions); n++) {
+                        const bool is_selected = mini_map_location == positions[n];
+
+                        if (ImGui::Selectable(positions_name[n], is_selected))
+                            mini_map_location = positions[n];
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Display", filter_graph_is_valid == false)) {
+                const char *items[] = { "Windowed", "Fullscreen" };
+                const bool values[] = { false, true };
+                const bool old_display = full_screen;
+
+                if (ImGui::BeginCombo("Screen mode", items[full_screen], 0)) {
+                    for (int n = 0; n < IM_ARRAYSIZE(values); n++) {
+                        const bool is_selected = full_screen == values[n];
+
+                        if (ImGui::Selectable(items[n], is_selected))
+                            full_screen = values[n];
+
+                        if (is_selected)
+                            ImGui::SetItemDefaultFocus();
+                    }
+                    ImGui::EndCombo();
+                }
+
+                if (old_display != full_screen)
+                    restart_display = true;
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Visual Color Style")) {
+                if (ImGui::MenuItem("Classic")) {
+                    ImGui::StyleColorsClassic();
+                    ImNodes::StyleColorsClassic();
+                }
+                if (ImGui::MenuItem("Dark")) {
+                    ImGui::StyleColorsDark();
+                    ImNodes::StyleColorsDark();
+                }
+                if (ImGui::MenuItem("Light")) {
+                    ImGui::StyleColorsLight();
+                    ImNodes::StyleColorsLight();
                 }
+                ImGui::EndMenu();
+            }
+
+            ImGui::EndMenu();
+        }
 
-                if (ImGui::IsItemHovered())
-                    ImGui::SetTooltip("%s", opt->help);
+        if (ImGui::BeginMenu("Export FilterGraph", filter_graph_is_valid == true)) {
+            if (ImGui::MenuItem("Render to File", "F7"))
+                show_render_window = true;
+            if (ImGui::BeginMenu("Save as Script")) {
+                static char file_name[1024] = { 0 };
+                size_t out_size = 0;
+                char *out = NULL;
 
-                opt_index++;
+                ImGui::InputText("File name:", file_name, sizeof(file_name) - 1);
+                if (strlen(file_name) > 0 && ImGui::Button("Save")) {
+                    export_filter_graph(&out, &out_size);
 
-                ImGui::PopID();
+                    if (out && out_size > 0) {
+                        FILE *script_file = fopen(file_name, "w");
+
+                        if (script_file) {
+                            fwrite(out, 1, out_size, script_file);
+                            fclose(script_file);
+                        }
+                        av_freep(&out);
+                        out_size = 0;
+                        memset(file_name, 0, sizeof(file_name));
+                    }
+                }
+                ImGui::EndMenu();
             }
+            ImGui::EndMenu();
+        }
 
-            filter_nodes[n].opt_storage = opt_storage;
+        if (ImGui::BeginMenu("Import FilterGraph", filter_graph_is_valid == false &&
+                             filter_links.size() == 0 &&
+                             filter_nodes.size() == 0)) {
+            if (ImGui::BeginMenu("Load Script")) {
+                static char file_name[1024] = { 0 };
 
-            tree ? ImGui::TreePop() : ImGui::EndListBox();
+                ImGui::InputText("File name:", file_name, sizeof(file_name) - 1);
+                if (strlen(file_name) > 0 && ImGui::Button("Load")) {
+                    av_freep(&import_script_file_name);
+                    import_script_file_name = av_asprintf("%s", file_name);
+                    memset(file_name, 0, sizeof(file_name));
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
         }
+
+        ImGui::EndPopup();
     }
+    ImGui::PopStyleVar();
 
-    if (ctx->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE) {
-        if (tree ? ImGui::TreeNode("Timeline") : ImGui::BeginListBox("##Timeline", ImVec2(80, 30))) {
-            ImGui::PushID(0);
-            if (ImGui::Button(ctx->is_disabled ? "Enable" : "Disable"))
-                *toggle_filter = n;
-            ImGui::PopID();
-            tree ? ImGui::TreePop() : ImGui::EndListBox();
+    edge2pad.resize(editor_edge);
+
+    std::vector<bool> hw_nodes;
+    find_hw_frame_nodes(hw_nodes);
+
+    int64_t max_profile_time = 0;
+    if (profiling_active && filter_graph_is_valid) {
+        for (unsigned i = 0; i < filter_nodes.size(); i++) {
+            const ProfileCounter *counter = find_profile_counter(profile_counters, filter_nodes[i].ctx);
+
+            if (counter)
+                max_profile_time = std::max(max_profile_time, __atomic_load_n(&counter->time, __ATOMIC_RELAXED));
         }
     }
-}
 
-static void draw_node_options(FilterNode *node)
-{
-    AVFilterContext *probe_ctx;
-    void *av_class_priv;
-    void *av_class;
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        FilterNode *filter_node = &filter_nodes[i];
+        FilterStats stats;
+        bool heat = false;
 
-    if (!probe_graph)
-        probe_graph = avfilter_graph_alloc();
-    if (!probe_graph)
-        return;
-    probe_graph->nb_threads = 1;
+        filter_node->id = i;
+        edge = filter_node->edge;
+        edge2pad[edge] = (Edge2Pad { i, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
+        get_filter_stats(filter_node, &stats);
+        if (max_profile_time > 0) {
+            const float t = (float)stats.time / max_profile_time;
+            const ImU32 color = IM_COL32(41 + (int)(t * 179), 74 - (int)(t * 44), 122 - (int)(t * 92), 255);
+
+            ImNodes::PushColorStyle(ImNodesCol_TitleBar, color);
+            ImNodes::PushColorStyle(ImNodesCol_TitleBarHovered, color);
+            ImNodes::PushColorStyle(ImNodesCol_TitleBarSelected, color);
+            heat = true;
+        }
+        ImNodes::BeginNode(filter_node->edge);
+        if (filter_node->set_pos) {
+            ImNodes::SetNodeEditorSpacePos(filter_node->edge, filter_node->pos);
+            filter_node->set_pos = false;
+        } else {
+            filter_node->pos = ImNodes::GetNodeEditorSpacePos(filter_node->edge);
+        }
+        ImNodes::BeginNodeTitleBar();
+        ImGui::TextUnformatted(filter_node->filter_name);
+        if (ImGui::IsItemHovered()) {
+            if (filter_graph_is_valid && filter_node->ctx && profiling_active && !stats.calls)
+                ImGui::SetTooltip("%s\n%s\nNot timed, only slice threaded filters are measured",
+                                  filter_node->filter_label, filter_node->filter->description);
+            else if (filter_graph_is_valid && filter_node->ctx)
+                ImGui::SetTooltip("%s\n%s\nTime: %.3f ms in %ld jobs",
+                                  filter_node->filter_label, filter_node->filter->description,
+                                  stats.time / 1000.0, stats.calls);
+            else
+                ImGui::SetTooltip("%s\n%s", filter_node->filter_label, filter_node->filter->description);
+        }
+        ImNodes::EndNodeTitleBar();
+        draw_node_options(filter_node);
 
-    if (!node->probe)
-        node->probe = avfilter_graph_alloc_filter(probe_graph, node->filter, "probe");
-    probe_ctx = node->probe;
-    if (!probe_ctx)
-        return;
+        AVFilterContext *filter_ctx = filter_node->ctx ? filter_node->ctx : filter_node->probe;
+        if (!filter_ctx && (filter_node->filter->flags & (AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_DYNAMIC_OUTPUTS)))
+            filter_ctx = get_node_probe(filter_node);
+        if (!filter_ctx && (filter_node->filter->flags & (AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_DYNAMIC_OUTPUTS))) {
+            ImNodes::EndNode();
+            if (heat) {
+                ImNodes::PopColorStyle();
+                ImNodes::PopColorStyle();
+                ImNodes::PopColorStyle();
+            }
+            continue;
+        }
 
-    if (filter_graph_is_valid) {
-        static unsigned toggle_filter = UINT_MAX;
-        static bool clean_storage = true;
+        const unsigned nb_inputs = filter_ctx ? filter_ctx->nb_inputs : avfilter_filter_pad_count(filter_node->filter, 0);
+        const unsigned nb_outputs = filter_ctx ? filter_ctx->nb_outputs : avfilter_filter_pad_count(filter_node->filter, 1);
+        const AVFilterPad *input_pads = filter_ctx ? filter_ctx->input_pads : filter_node->filter->inputs;
+        const AVFilterPad *output_pads = filter_ctx ? filter_ctx->output_pads : filter_node->filter->outputs;
 
-        draw_filter_commands(node->ctx, node->id, &toggle_filter, true, &clean_storage, false);
+        for (unsigned j = 0; j < filter_node->inpad_edges.size(); j++) {
+            const int edge = filter_node->inpad_edges[j];
 
-        if (toggle_filter < UINT_MAX) {
-            const AVFilterContext *filter_ctx = node->ctx;
-            const int flag = !filter_ctx->is_disabled;
+            edge2pad[edge].removed = true;
+        }
+        filter_node->inpad_edges.resize(static_cast<size_t>(nb_inputs));
 
-            avfilter_graph_send_command(filter_graph, filter_ctx->name, "enable", flag ? "0" : "1", NULL, 0, 0);
-            toggle_filter = UINT_MAX;
+        for (unsigned j = 0; j < filter_node->outpad_edges.size(); j++) {
+            const int edge = filter_node->outpad_edges[j];
+
+            edge2pad[edge].removed = true;
         }
+        filter_node->outpad_edges.resize(static_cast<size_t>(nb_outputs));
 
-        return;
-    }
+        for (unsigned j = 0; j < nb_inputs; j++) {
+            enum AVMediaType media_type;
 
-    av_class_priv = probe_ctx->priv;
-    av_class = probe_ctx;
-    if (!node->colapsed && !ImGui::Button("Options"))
-        return;
+            edge = filter_node->inpad_edges[j];
+            if (edge == 0) {
+                edge = editor_edge++;
+                filter_node->inpad_edges[j] = edge;
+                edge2pad.resize(editor_edge);
+            }
+            media_type = avfilter_pad_get_type(input_pads, j);
+            if (media_type == AVMEDIA_TYPE_VIDEO) {
+                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(  0, 255, 255, 255));
+            } else {
+                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(255, 255,   0, 255));
+            }
+            edge2pad[edge] = (Edge2Pad { i, false, false, j, media_type });
+            filter_node->inpad_edges[j] = edge;
+            ImNodes::BeginInputAttribute(edge);
+            ImGui::Text("%s", avfilter_pad_get_name(input_pads, j));
+            ImNodes::EndInputAttribute();
+            ImNodes::PopColorStyle();
+        }
 
-    node->colapsed = true;
-    if (node->colapsed && ImGui::Button("Close")) {
-        node->colapsed = false;
-        return;
-    }
+        int video_pad = -1;
+        for (unsigned j = 0; j < nb_outputs; j++) {
+            enum AVMediaType media_type;
 
-    ImGui::SameLine();
-    if (node->colapsed) {
-        for (unsigned i = 0; i < video_sink_threads.size(); i++) {
-            if (video_sink_threads[i].joinable())
-                return;
+            edge = filter_node->outpad_edges[j];
+            if (edge == 0) {
+                edge = editor_edge++;
+                filter_node->outpad_edges[j] = edge;
+                edge2pad.resize(editor_edge);
+            }
+            media_type = avfilter_pad_get_type(output_pads, j);
+            if (media_type == AVMEDIA_TYPE_VIDEO) {
+                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(  0, 255, 255, 255));
+                if (video_pad < 0)
+                    video_pad = j;
+            } else {
+                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(255, 255,   0, 255));
+            }
+            edge2pad[edge] = (Edge2Pad { i, false, true, j, media_type });
+            filter_node->outpad_edges[j] = edge;
+            ImNodes::BeginOutputAttribute(edge);
+            ImGui::Text("%s", avfilter_pad_get_name(output_pads, j));
+            ImNodes::EndOutputAttribute();
+            ImNodes::PopColorStyle();
         }
 
-        for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
-            if (audio_sink_threads[i].joinable())
-                return;
+        if (video_pad >= 0 && !hw_nodes[i]) {
+            bool tap = filter_node->tap_pad >= 0;
+
+            ImGui::PushID(filter_node->edge);
+            if (ImGui::Checkbox("Tap", &tap)) {
+                filter_node->tap_pad = tap ? video_pad : -1;
+                need_filters_reinit = true;
+            }
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("%s", "Show a small live preview of this filter's first video output");
+            ImGui::PopID();
+            if (tap && filter_graph_is_valid)
+                draw_tap_preview(i);
         }
 
-        if (ImGui::Button("Remove")) {
-            av_freep(&node->filter_name);
-            av_freep(&node->filter_label);
-            av_freep(&node->filter_options);
-            av_freep(&node->ctx_options);
-            avfilter_free(node->probe);
-            node->probe = NULL;
-            avfilter_free(node->ctx);
-            node->ctx = NULL;
-            node->colapsed = false;
-            edge2pad[node->edge].is_output = false;
-            edge2pad[node->edge].removed = true;
-            filter_nodes.erase(filter_nodes.begin() + node->id);
-            return;
+        ImNodes::EndNode();
+        if (heat) {
+            ImNodes::PopColorStyle();
+            ImNodes::PopColorStyle();
+            ImNodes::PopColorStyle();
         }
+        ImNodes::SetNodeDraggable(filter_node->edge, true);
     }
 
-    if (!ImGui::BeginListBox("##List of Filter Options"))
-        return;
-    draw_options(node, av_class_priv);
-    ImGui::NewLine();
-    draw_options(node, av_class);
-
-    ImGui::EndListBox();
-}
-
-static ImVec2 find_node_spot(ImVec2 start);
+    std::vector<bool> dead_links(filter_links.size());
+    bool have_dead_links = false;
 
-static void import_filter_graph(const char *file_name)
-{
-    FILE *file = av_fopen_utf8(file_name, "r");
-    std::vector<char *> filter_opts;
-    std::vector<std::pair <int, int>> labels;
-    std::vector<std::pair <int, int>> filters;
-    std::vector<std::pair <unsigned, unsigned>> pads;
-    std::vector<int> separators;
-    std::vector<int> filter2edge;
-    std::vector<int> label2edge;
-    int filter_start = -1;
-    int filter_stop = 0;
-    int label_start = 0;
-    int label_stop = 0;
-    int in_pad_count = -1;
-    int out_pad_count = -1;
-    int pos = 0;
-    AVBPrint buf;
-    char c;
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const std::pair<int, int> p = filter_links[i];
 
-    if (!file) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot open '%s' script.\n", file_name);
-        return;
+        dead_links[i] = edge2pad[p.first].removed  == true ||
+                        edge2pad[p.second].removed == true ||
+                        edge2pad[p.first].type  == AVMEDIA_TYPE_UNKNOWN ||
+                        edge2pad[p.second].type == AVMEDIA_TYPE_UNKNOWN ||
+                        edge2pad[p.first].is_output == edge2pad[p.second].is_output;
+        have_dead_links |= dead_links[i];
     }
 
-    if (!probe_graph)
-        probe_graph = avfilter_graph_alloc();
-    if (!probe_graph)
-        return;
+    if (have_dead_links)
+        erase_links(dead_links);
 
-    av_bprint_init(&buf, 512, AV_BPRINT_SIZE_UNLIMITED);
+    for (unsigned i = 0; i < filter_links.size(); i++)
+        ImNodes::Link(i, filter_links[i].first, filter_links[i].second);
 
-    while ((c = fgetc(file))) {
-        if (c != EOF)
-            av_bprintf(&buf, "%c", c);
+    if (show_mini_map == true)
+        ImNodes::MiniMap(0.2f, mini_map_location);
+    ImNodes::EndNodeEditor();
 
-        if (c == ';' || c == EOF)
-            separators.push_back(pos);
+    for (unsigned i = 0; i < video_sink_threads.size(); i++) {
+        if (video_sink_threads[i].joinable()) {
+            ImGui::End();
+            return;
+        }
+    }
 
-        if (c == '[' && label_start == 0 && label_stop == 0) {
-            if (filter_start >= 0) {
-                filter_stop = pos;
-                if (filter_stop - filter_start > 1)
-                    filters.push_back(std::make_pair(filter_start, filter_stop));
-                filter_start = -1;
-                filter_stop = 0;
-            }
-            label_start = pos + 1;
-        } else if (c == ']' && label_start > 0 && label_stop == 0) {
-            label_stop = pos;
-            labels.push_back(std::make_pair(label_start, label_stop));
-            label_start = label_stop = 0;
-        } else if ((c == ';' || c == EOF) && filter_start >= 0) {
-            filter_stop = pos - (c == EOF);
-            if (filter_stop - filter_start > 1)
-                filters.push_back(std::make_pair(filter_start, filter_stop));
-            filter_start = -1;
-            filter_stop = 0;
-        } else if (filter_start >= 0) {
-        } else if (label_stop == 0 && label_start == 0) {
-            filter_start = pos + (c == ';');
+    for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
+        if (audio_sink_threads[i].joinable()) {
+            ImGui::End();
+            return;
         }
+    }
 
-        pos++;
-        if (c == EOF)
-            break;
+    if (graph_driver_thread.joinable()) {
+        ImGui::End();
+        return;
     }
 
-    unsigned cur_label = 0;
-    unsigned cur_filter_idx = 0;
-    int label, filter, separator;
+    int link_id;
+    if (ImNodes::IsLinkDestroyed(&link_id) && (unsigned)link_id < filter_links.size()) {
+        std::vector<bool> dead_links(filter_links.size());
 
-    if (separators.size() != filters.size())
-        goto error;
+        dead_links[link_id] = true;
+        erase_links(dead_links);
+    }
 
-    while (cur_label < labels.size()) {
-        label = labels[cur_label].second;
+    const int links_selected = ImNodes::NumSelectedLinks();
+    if (!ImGui::IsItemHovered() && links_selected > 0 && ImGui::IsKeyReleased(ImGuiKey_X) && filter_links.size() > 0) {
+        std::vector<bool> dead_links(filter_links.size());
+        std::vector<int> selected_links;
 
-        if (in_pad_count == -1 && out_pad_count == -1) {
-            filter = filters[cur_filter_idx].first;
-            separator = separators[cur_filter_idx++];
-            in_pad_count = out_pad_count = 0;
-        }
+        selected_links.resize(static_cast<size_t>(links_selected));
+        ImNodes::GetSelectedLinks(selected_links.data());
 
-        if (label > separator) {
-            pads.push_back(std::make_pair(in_pad_count, out_pad_count));
-            in_pad_count = out_pad_count = -1;
-        } else if (label < filter) {
-            in_pad_count++;
-            cur_label++;
-        } else if (label < separator) {
-            out_pad_count++;
-            cur_label++;
+        for (const int link_id : selected_links) {
+            if ((unsigned)link_id < filter_links.size())
+                dead_links[link_id] = true;
         }
+        erase_links(dead_links);
     }
 
-    if (in_pad_count >= 0 && out_pad_count >= 0)
-        pads.push_back(std::make_pair(in_pad_count, out_pad_count));
+    const unsigned nodes_selected = ImNodes::NumSelectedNodes();
+    if (nodes_selected > 0 && nodes_selected <= filter_nodes.size() && !ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_X) && ImGui::GetIO().KeyShift) {
+        std::vector<bool> dead_edges(editor_edge);
+        std::vector<int> selected_nodes;
 
-    editor_edge = 0;
-    edge2pad.clear();
-    filter_links.clear();
-    filter_nodes.clear();
+        selected_nodes.resize(static_cast<size_t>(nodes_selected));
+        ImNodes::GetSelectedNodes(selected_nodes.data());
 
-    for (unsigned i = 0; i < filters.size(); i++) {
-        FilterNode node;
-        std::pair <int, int> p = filters[i];
-        char *opts = NULL;
-        int ret;
+        for (unsigned node_id = 0; node_id < selected_nodes.size(); node_id++) {
+            const int edge = selected_nodes[node_id];
+            if (edge < 0)
+                continue;
+            const unsigned node = edge2pad[edge].node;
+            std::vector<int> removed_edges;
 
-        for (int j = p.first; j < p.second; j++) {
-            if (buf.str[j] == '=') {
-                opts = av_asprintf("%.*s", p.second - j-1, buf.str + j+1);
-                p.second = j;
-                break;
-            }
-        }
+            edge2pad[edge].removed = true;
+            edge2pad[edge].is_output = false;
+            filter_nodes[node].filter = NULL;
+            avfilter_free(filter_nodes[node].ctx);
+            filter_nodes[node].ctx = NULL;
+            av_freep(&filter_nodes[node].filter_name);
+            av_freep(&filter_nodes[node].filter_label);
+            av_freep(&filter_nodes[node].filter_options);
+            av_freep(&filter_nodes[node].ctx_options);
+            avfilter_free(filter_nodes[node].probe);
+            filter_nodes[node].probe = NULL;
+
+            removed_edges.push_back(filter_nodes[node].edge);
+            for (unsigned j = 0; j < filter_nodes[node].inpad_edges.size(); j++)
+                removed_edges.push_back(filter_nodes[node].inpad_edges[j]);
 
-        filter_opts.push_back(opts);
+            for (unsigned j = 0; j < filter_nodes[node].outpad_edges.size(); j++)
+                removed_edges.push_back(filter_nodes[node].outpad_edges[j]);
 
-        filter2edge.push_back(editor_edge++);
-        edge2pad.push_back(Edge2Pad { i, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
-        for (unsigned j = 0; j < pads[i].first; j++) {
-            node.inpad_edges.push_back(editor_edge);
-            label2edge.push_back(editor_edge++);
-            edge2pad.push_back(Edge2Pad { i, false, false, j, AVMEDIA_TYPE_UNKNOWN });
-        }
-
-        for (unsigned j = 0; j < pads[i].second; j++) {
-            node.outpad_edges.push_back(editor_edge);
-            label2edge.push_back(editor_edge++);
-            edge2pad.push_back(Edge2Pad { i, false, true, j, AVMEDIA_TYPE_UNKNOWN });
-        }
-
-        node.id = filter_nodes.size();
-        node.edge = filter2edge[i];
-        node.filter_name = av_asprintf("%.*s", p.second - p.first, buf.str + p.first);
-        node.filter = avfilter_get_by_name(node.filter_name);
-        node.filter_label = av_asprintf("%s%d", node.filter_name, node.id);
-        node.filter_options = opts;
-        node.ctx_options = NULL;
-        node.probe = avfilter_graph_alloc_filter(probe_graph, node.filter, "probe");
-        node.ctx = NULL;
-        node.pos = find_node_spot(ImVec2(300, 300));
-        node.colapsed = false;
-        node.set_pos = true;
-
-        ret = av_opt_set_from_string(node.probe->priv, node.filter_options, NULL, "=", ":");
-        if (ret < 0)
-            av_log(NULL, AV_LOG_ERROR, "Error setting probe filter private options.\n");
+            erased = true;
 
-        filter_nodes.push_back(node);
-    }
+            for (unsigned r = 0; r < removed_edges.size(); r++) {
+                const int removed_edge = removed_edges[r];
 
-    for (unsigned i = 0; i < labels.size(); i++) {
-        std::pair <int, int> p = labels[i];
+                if (removed_edge < 0 || removed_edge >= editor_edge)
+                    continue;
+                edge2pad[removed_edge].type = AVMEDIA_TYPE_UNKNOWN;
+                edge2pad[removed_edge].is_output = false;
+                edge2pad[removed_edge].removed = true;
+                dead_edges[removed_edge] = true;
+            }
+        }
 
-        for (unsigned j = i + 1; j < labels.size(); j++) {
-            std::pair <int, int> r = labels[j];
+        if (filter_links.size() > 0) {
+            std::vector<bool> dead_links(filter_links.size());
 
-            if ((p.second - p.first) != (r.second - r.first))
-                continue;
+            for (unsigned l = 0; l < filter_links.size(); l++)
+                dead_links[l] = dead_edges[filter_links[l].first] || dead_edges[filter_links[l].second];
+            erase_links(dead_links);
+        }
+    }
 
-            if (memcmp(buf.str + p.first, buf.str + r.first, p.second - p.first))
-                continue;
+    if (erased && filter_nodes.size() > 0) {
+        unsigned nb_nodes = 0;
 
-            if (edge2pad[label2edge[i]].is_output == edge2pad[label2edge[j]].is_output)
+        for (unsigned i = 0; i < filter_nodes.size(); i++) {
+            if (!filter_nodes[i].filter)
                 continue;
-
-            filter_links.push_back(std::make_pair(label2edge[i], label2edge[j]));
+            filter_nodes[i].set_pos = true;
+            filter_nodes[i].id = nb_nodes;
+            if (i != nb_nodes)
+                filter_nodes[nb_nodes] = std::move(filter_nodes[i]);
+            nb_nodes++;
         }
+        filter_nodes.resize(nb_nodes);
     }
 
-error:
-    av_bprint_finalize(&buf, NULL);
+    const unsigned copy_nodes_selected = ImNodes::NumSelectedNodes();
+    if (copy_nodes_selected > 0 && copy_nodes_selected <= filter_nodes.size() && !ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_C) && ImGui::GetIO().KeyShift) {
+        std::vector<int> selected_nodes;
 
-    fclose(file);
+        selected_nodes.resize(static_cast<size_t>(copy_nodes_selected));
+        ImNodes::GetSelectedNodes(selected_nodes.data());
 
-    need_filters_reinit = true;
-}
+        for (unsigned i = 0; i < selected_nodes.size(); i++) {
+            const int e = selected_nodes[i];
+            if (e < 0)
+                continue;
+            FilterNode orig = filter_nodes[edge2pad[e].node];
+            FilterNode copy;
 
-static void export_filter_graph(char **out, size_t *out_size)
-{
-    std::vector<bool> visited;
-    std::vector<unsigned> to_visit;
-    AVBPrint buf;
-    bool first = true;
+            copy.filter = orig.filter;
+            copy.id = filter_nodes.size();
+            copy.filter_name = av_strdup(orig.filter->name);
+            copy.filter_label = av_asprintf("%s%d", copy.filter->name, copy.id);
+            copy.filter_options = NULL;
+            copy.ctx_options = NULL;
+            copy.probe = NULL;
+            copy.ctx = NULL;
+            copy.pos = find_node_spot(orig.pos);
+            copy.colapsed = false;
+            copy.set_pos = true;
+            copy.tap_pad = -1;
+            copy.edge = editor_edge++;
 
-    av_bprint_init(&buf, 512, AV_BPRINT_SIZE_UNLIMITED);
+            if (orig.probe && get_node_probe(&copy)) {
+                av_opt_copy(copy.probe, orig.probe);
+                av_opt_copy(copy.probe->priv, orig.probe->priv);
+            } else {
+                copy.filter_options = orig.filter_options ? av_strdup(orig.filter_options) : NULL;
+                copy.ctx_options = orig.ctx_options ? av_strdup(orig.ctx_options) : NULL;
+            }
 
-    visited.resize(filter_nodes.size());
+            edge2pad.push_back(Edge2Pad { copy.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
 
-    to_visit.push_back(0);
+            for (unsigned j = 0; j < orig.inpad_edges.size(); j++) {
+                copy.inpad_edges.push_back(editor_edge++);
+                edge2pad.push_back(Edge2Pad { copy.id, false, false, j, AVMEDIA_TYPE_UNKNOWN });
+            }
 
-    while (to_visit.size() > 0) {
-        unsigned node = to_visit.back();
+            for (unsigned j = 0; j < orig.outpad_edges.size(); j++) {
+                copy.outpad_edges.push_back(editor_edge++);
+                edge2pad.push_back(Edge2Pad { copy.id, false, true, j, AVMEDIA_TYPE_UNKNOWN });
+            }
 
-        to_visit.pop_back();
+            filter_nodes.push_back(copy);
+        }
+    }
 
-        if (visited[node] == false) {
-            visited[node] = true;
+    if (!ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_A) && ImGui::GetIO().KeyShift) {
+        const AVFilter *buffersink  = avfilter_get_by_name("buffersink");
+        const AVFilter *abuffersink = avfilter_get_by_name("abuffersink");
+        std::vector<int> unconnected_edges;
 
-            if (first)
-                first = false;
-            else
-                av_bprintf(&buf, ";");
+        build_graph_index(&graph_index);
 
-            for (unsigned i = 0; i < filter_links.size(); i++) {
-                const std::pair<int, int> p = filter_links[i];
-                const int a = p.first;
-                const int b = p.second;
-                unsigned na  = edge2pad[a].node;
-                bool nat = edge2pad[a].is_output;
-                unsigned nb  = edge2pad[b].node;
-                bool nbt = edge2pad[b].is_output;
-
-                if (node != na && node != nb)
-                    continue;
-                if (node == na && nat == 1)
-                    continue;
-                if (node == nb && nbt == 1)
-                    continue;
-                av_bprintf(&buf, "[e%d]", i);
+        for (int e = 0; e < editor_edge; e++) {
+            if (graph_index.edge2link.find(e) == graph_index.edge2link.end() &&
+                edge2pad[e].type != AVMEDIA_TYPE_UNKNOWN &&
+                edge2pad[e].is_output == true &&
+                edge2pad[e].removed == false) {
+                unconnected_edges.push_back(e);
             }
+        }
 
-            av_bprintf(&buf, "%s", filter_nodes[node].filter_name);
-            if (strlen(filter_nodes[node].filter_options) > 0)
-                av_bprintf(&buf, "=%s", filter_nodes[node].filter_options);
-
-            for (unsigned i = 0; i < filter_links.size(); i++) {
-                const std::pair<int, int> p = filter_links[i];
-                const int a = p.first;
-                const int b = p.second;
-                unsigned na  = edge2pad[a].node;
-                bool nat = edge2pad[a].is_output;
-                unsigned nb  = edge2pad[b].node;
-                bool nbt = edge2pad[b].is_output;
-
-                if (node != na && node != nb)
-                    continue;
-                if (node == na && nat == 0)
-                    continue;
-                if (node == nb && nbt == 0)
-                    continue;
-                av_bprintf(&buf, "[e%d]", i);
-            }
+        for (unsigned i = 0; i < unconnected_edges.size(); i++) {
+            const int e = unconnected_edges[i];
+            if (e < 0)
+                continue;
+            enum AVMediaType type = edge2pad[e].type;
+            FilterNode src = filter_nodes[edge2pad[e].node];
+            FilterNode node;
 
-            for (unsigned i = 0; i < filter_links.size(); i++) {
-                const std::pair<int, int> p = filter_links[i];
-                unsigned a = edge2pad[p.first].node;
-                unsigned b = edge2pad[p.second].node;
+            node.filter = type == AVMEDIA_TYPE_AUDIO ? abuffersink : buffersink;
+            node.id = filter_nodes.size();
+            node.filter_name = av_strdup(node.filter->name);
+            node.filter_label = av_asprintf("%s%d", node.filter->name, node.id);
+            node.filter_options = NULL;
+            node.ctx_options = NULL;
+            node.probe = NULL;
+            node.ctx = NULL;
+            node.pos = find_node_spot(src.pos);
+            node.colapsed = false;
+            node.set_pos = true;
+            node.tap_pad = -1;
+            node.edge = editor_edge++;
+            node.inpad_edges.push_back(editor_edge);
+            edge2pad.push_back(Edge2Pad { node.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
+            edge2pad.push_back(Edge2Pad { node.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
 
-                if (node != a && node != b)
-                    continue;
-                if (node != a)
-                    to_visit.push_back(a);
-                else
-                    to_visit.push_back(b);
-            }
+            filter_nodes.push_back(node);
+            filter_links.push_back(std::make_pair(e, editor_edge++));
         }
     }
 
-    av_bprintf(&buf, "\n");
+    int start_attr, end_attr;
+    if (ImNodes::IsLinkCreated(&start_attr, &end_attr)) {
+        const enum AVMediaType first  = edge2pad[start_attr].type;
+        const enum AVMediaType second = edge2pad[end_attr].type;
 
-    av_bprint_finalize(&buf, out);
-    if (av_bprint_is_complete(&buf))
-        *out_size = buf.len;
-    else
-        *out_size = buf.size;
-    av_bprint_finalize(&buf, NULL);
+        if (first == second && first != AVMEDIA_TYPE_UNKNOWN)
+            filter_links.push_back(std::make_pair(start_attr, end_attr));
+    }
+
+    ImGui::End();
 }
 
-static ImVec2 find_node_spot(ImVec2 start)
+static void draw_filters_commands(unsigned *toggle_filter)
 {
-    ImVec2 pos = ImVec2(start.x + 80, start.y);
-    bool got_pos = false;
+    static unsigned selected_filter = -1;
 
-    while (got_pos == false) {
-        got_pos = true;
+    if (ImGui::BeginListBox("##Commands Box", ImVec2(-1, -1))) {
+        static ImGuiTextFilter imgui_filter;
 
-        for (unsigned i = 0; i < filter_nodes.size(); i++) {
-            FilterNode node = filter_nodes[i];
+        imgui_filter.Draw();
+        for (unsigned n = 0; n < filter_nodes.size(); n++) {
+            const AVFilterContext *ctx = filter_nodes[n].ctx;
+            const bool is_selected = selected_filter == n;
+            static bool is_opened = false;
+            static bool clean_storage = true;
 
-            if (std::abs(pos.x - node.pos.x) <= 80 &&
-                std::abs(pos.y - node.pos.y) <= 80) {
-                got_pos = false;
-                break;
+            if (!ctx)
+                continue;
+
+            if (!ctx->filter)
+                continue;
+
+            if (!imgui_filter.PassFilter(ctx->filter->name))
+                continue;
+
+            if (ImGui::Selectable(ctx->filter->name, is_selected)) {
+                selected_filter = n;
+            }
+
+            if (ImGui::IsItemActive() || ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", ctx->name);
+            }
+
+            if (ImGui::IsItemClicked() && ImGui::IsItemActive()) {
+                selected_filter = n;
+                is_opened = true;
             }
-        }
 
-        if (got_pos == true)
-            break;
+            if (is_opened && selected_filter == n)
+                draw_filter_commands(ctx, n, toggle_filter, is_opened, &clean_storage, true);
+        }
 
-        pos.x += ((std::rand() % 3) - 1) * 100;
-        pos.y += ((std::rand() % 3) - 1) * 100;
+        ImGui::EndListBox();
     }
-
-    return pos;
 }
 
-static void show_filtergraph_editor(bool *p_open, bool focused)
+static void show_commands(bool *p_open, bool focused)
 {
-    bool erased = false;
-    int edge;
+    static unsigned toggle_filter = UINT_MAX;
+
+    if (filter_graph_is_valid == false || (
+        ((buffer_sinks.size() != mutexes.size() ||
+          buffer_sinks.size() == 0)) &&
+        ((abuffer_sinks.size() != amutexes.size() ||
+          abuffer_sinks.size() == 0))))
+        return;
 
     if (focused)
         ImGui::SetNextWindowFocus();
-    ImGui::SetNextWindowSize(ImVec2(600, 500), ImGuiCond_FirstUseEver);
-    if (!ImGui::Begin("FilterGraph Editor", p_open, 0)) {
+    if (!ImGui::Begin("Filter Commands", p_open, 0)) {
         ImGui::End();
         return;
     }
 
-    ImNodes::EditorContextSet(node_editor_context);
-
-    ImNodes::BeginNodeEditor();
-
-    if (ImGui::IsKeyReleased(ImGuiKey_Enter) && ImGui::GetIO().KeyCtrl)
-        need_filters_reinit = true;
+    draw_filters_commands(&toggle_filter);
 
-    const bool open_popup = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) &&
-        ImNodes::IsEditorHovered() && ((ImGui::IsKeyReleased(ImGuiKey_A) && !ImGui::GetIO().KeyShift) ||
-        ImGui::IsMouseReleased(ImGuiMouseButton_Right));
+    ImGui::End();
 
-    static ImVec2 click_pos;
-    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(8.f, 8.f));
-    if (!ImGui::IsAnyItemHovered() && open_popup) {
-        ImGui::OpenPopup("Add Filter");
+    if (toggle_filter < UINT_MAX) {
+        const AVFilterContext *filter_ctx = filter_graph->filters[toggle_filter];
+        const int flag = !filter_ctx->is_disabled;
 
-        click_pos = ImGui::GetMousePosOnOpeningCurrentPopup();
-        click_pos.x -= ImGui::GetWindowPos().x;
-        click_pos.y -= ImGui::GetWindowPos().y;
+        avfilter_graph_send_command(filter_graph, filter_ctx->name, "enable", flag ? "0" : "1", NULL, 0, 0);
+        toggle_filter = UINT_MAX;
     }
+}
 
-    if (ImGui::BeginPopup("Add Filter")) {
-        if (ImGui::BeginMenu("Source Filters", filter_graph_is_valid == false)) {
-            if (ImGui::BeginMenu("Video")) {
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
-
-                ImGui::SetTooltip("%s", "Video Source Filters");
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_source_video_filter(filter))
-                        continue;
+static int pull_sink_frames(AVFilterGraph *graph, const std::vector<AVFilterContext *> &sinks,
+                            int64_t max_frames, int64_t max_time,
+                            std::vector<std::vector<int64_t>> &latencies, std::vector<int64_t> &frames,
+                            std::vector<int64_t> &durations)
+{
+    const int64_t start = av_gettime_relative();
+    std::vector<bool> eof(sinks.size(), false);
+    std::vector<bool> done(sinks.size(), false);
+    unsigned nb_active = sinks.size();
+    int ret;
 
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
-            }
-            if (ImGui::BeginMenu("Audio")) {
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
+    latencies.resize(sinks.size());
+    frames.assign(sinks.size(), 0);
+    durations.assign(sinks.size(), 0);
 
-                ImGui::SetTooltip("%s", "Audio Source Filters");
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_source_audio_filter(filter))
-                        continue;
+    while (nb_active > 0) {
+        bool got_frame = false;
 
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
-            }
-            if (ImGui::BeginMenu("Media")) {
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
+        for (unsigned i = 0; i < sinks.size(); i++) {
+            AVFrame *frame;
+            int64_t t0, t1;
 
-                ImGui::SetTooltip("%s", "Media Source Filters");
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_source_media_filter(filter))
-                        continue;
+            if (eof[i])
+                continue;
 
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
+            frame = av_frame_alloc();
+            if (!frame)
+                return AVERROR(ENOMEM);
+
+            /* Outputs that reached max_frames are still drained, so their
+             * queues do not grow while the other outputs keep running. */
+            t0 = av_gettime_relative();
+            ret = av_buffersink_get_frame_flags(sinks[i], frame, done[i] ? AV_BUFFERSINK_FLAG_NO_REQUEST : 0);
+            t1 = av_gettime_relative();
+            av_frame_free(&frame);
+            if (ret == AVERROR(EAGAIN))
+                continue;
+            if (ret < 0) {
+                eof[i] = true;
+                if (!done[i])
+                    nb_active--;
+                continue;
             }
-            ImGui::EndMenu();
-        }
-        if (ImGui::BeginMenu("Simple Filters", filter_graph_is_valid == false)) {
-            if (ImGui::BeginMenu("Video")) {
-                static ImGuiTextFilter imgui_filter;
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
-
-                ImGui::SetTooltip("%s", "Simple Video Filters");
-                imgui_filter.Draw();
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_simple_video_filter(filter))
-                        continue;
-
-                    if (!imgui_filter.PassFilter(filter->name))
-                        continue;
+            if (done[i])
+                continue;
 
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
+            got_frame = true;
+            latencies[i].push_back(t1 - t0);
+            frames[i]++;
+            durations[i] = t1 - start;
+            if (max_frames > 0 && frames[i] >= max_frames) {
+                done[i] = true;
+                nb_active--;
             }
-            if (ImGui::BeginMenu("Audio")) {
-                static ImGuiTextFilter imgui_filter;
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
-
-                ImGui::SetTooltip("%s", "Simple Audio Filters");
-                imgui_filter.Draw();
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_simple_audio_filter(filter))
-                        continue;
+        }
 
-                    if (!imgui_filter.PassFilter(filter->name))
-                        continue;
+        if (max_time > 0 && av_gettime_relative() - start >= max_time)
+            break;
 
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
+        if (!got_frame && nb_active > 0) {
+            ret = avfilter_graph_request_oldest(graph);
+            if (ret == AVERROR_EOF)
+                break;
+            if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot request frame from filtergraph.\n");
+                break;
             }
-            ImGui::EndMenu();
         }
+    }
 
-        if (ImGui::BeginMenu("Complex Filters", filter_graph_is_valid == false)) {
-            static ImGuiTextFilter imgui_filter;
-            const AVFilter *filter = NULL;
-            void *iterator = NULL;
+    return 0;
+}
 
-            imgui_filter.Draw();
-            while ((filter = av_filter_iterate(&iterator))) {
-                if (!is_complex_filter(filter))
-                    continue;
+static int alloc_node_filters(AVFilterGraph *graph)
+{
+    char *ctx_options = NULL;
+    char *filter_options = NULL;
+    int ret;
 
-                if (!imgui_filter.PassFilter(filter->name))
-                    continue;
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        FilterNode *node = &filter_nodes[i];
+        AVFilterContext *filter_ctx;
 
-                handle_nodeitem(filter, click_pos);
-            }
-            ImGui::EndMenu();
+        filter_ctx = avfilter_graph_alloc_filter(graph, node->filter, node->filter_label);
+        if (!filter_ctx) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot allocate filter context.\n");
+            return AVERROR(ENOMEM);
         }
 
-        if (ImGui::BeginMenu("Media Filters", filter_graph_is_valid == false)) {
-            const AVFilter *filter = NULL;
-            void *iterator = NULL;
-
-            while ((filter = av_filter_iterate(&iterator))) {
-                if (!is_media_filter(filter))
-                    continue;
-
-                handle_nodeitem(filter, click_pos);
-            }
-            ImGui::EndMenu();
+        av_opt_set_defaults(filter_ctx);
+        filter_ctx->nb_threads = get_nb_filter_threads(node->filter);
+        if (hw_device_ctx) {
+            filter_ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+            if (!filter_ctx->hw_device_ctx)
+                return AVERROR(ENOMEM);
         }
 
-        if (ImGui::BeginMenu("Sink Filters", filter_graph_is_valid == false)) {
-            if (ImGui::BeginMenu("Video")) {
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
-
-                ImGui::SetTooltip("%s", "Sink Video Filters");
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_sink_video_filter(filter))
-                        continue;
-
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
-            }
-            if (ImGui::BeginMenu("Audio")) {
-                const AVFilter *filter = NULL;
-                void *iterator = NULL;
-
-                ImGui::SetTooltip("%s", "Sink Audio Filters");
-                while ((filter = av_filter_iterate(&iterator))) {
-                    if (!is_sink_audio_filter(filter))
-                        continue;
-
-                    handle_nodeitem(filter, click_pos);
-                }
-                ImGui::EndMenu();
-            }
-            ImGui::EndMenu();
+        if (node->probe) {
+            av_opt_serialize(node->probe, 0, AV_OPT_SERIALIZE_SKIP_DEFAULTS, &ctx_options, '=', ':');
+            av_opt_serialize(node->probe->priv, AV_OPT_FLAG_FILTERING_PARAM, AV_OPT_SERIALIZE_SKIP_DEFAULTS,
+                             &filter_options, '=', ':');
         }
 
-        if (ImGui::BeginMenu("Options")) {
-            if (ImGui::BeginMenu("FilterGraph", filter_graph_is_valid == false)) {
-                const char *items[] = { "quiet", "panic", "fatal", "error", "warning", "info", "verbose", "debug" };
-                const int values[] = { AV_LOG_QUIET, AV_LOG_PANIC, AV_LOG_FATAL, AV_LOG_ERROR, AV_LOG_WARNING, AV_LOG_INFO, AV_LOG_VERBOSE, AV_LOG_DEBUG };
-                static int item_current_idx = 5;
-
-                ImGui::InputInt("Max Number of FilterGraph Threads", &filter_graph_nb_threads);
-                ImGui::InputInt("Auto Conversion Type for FilterGraph", &filter_graph_auto_convert_flags);
-                if (ImGui::BeginCombo("Log Message Level", items[item_current_idx], 0)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
-                        const bool is_selected = (item_current_idx == n);
-
-                        if (ImGui::Selectable(items[n], is_selected)) {
-                            item_current_idx = n;
-                            log_level = values[n];
-                        }
-
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
-                ImGui::EndMenu();
-            }
-
-            if (ImGui::BeginMenu("Video Outputs")) {
-                const char *items[] = { "nearest", "linear" };
-                const GLint values[] = { GL_NEAREST, GL_LINEAR };
-                static int item_current_idx[2] = { 0, 0 };
-                const int flags = 0;
+        ret = av_opt_set_from_string(filter_ctx, node->probe ? ctx_options : node->ctx_options, NULL, "=", ":");
+        if (ret >= 0)
+            ret = av_opt_set_from_string(filter_ctx->priv, node->probe ? filter_options : node->filter_options, NULL, "=", ":");
+        av_freep(&ctx_options);
+        av_freep(&filter_options);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error setting %s options.\n", node->filter_label);
+            return ret;
+        }
+    }
 
-                ImGui::DragFloat2("OSD Fullscreen Position", osd_fullscreen_pos, 0.01f, 0.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
-                ImGui::DragFloat("OSD Fullscreen Transparency", &osd_transparency, 0.01f, 0.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
-                if (ImGui::BeginCombo("Upscaler", items[item_current_idx[0]], flags)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
-                        const bool is_selected = (item_current_idx[0] == n);
+    return 0;
+}
 
-                        if (ImGui::Selectable(items[n], is_selected)) {
-                            item_current_idx[0] = n;
-                            global_upscale_interpolation = values[n];
-                        }
+static int init_node_filters(AVFilterGraph *graph)
+{
+    int ret;
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        ret = avfilter_init_str(graph->filters[i], NULL);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot init str for filter.\n");
+            return ret;
+        }
+    }
 
-                if (ImGui::BeginCombo("Downscaler", items[item_current_idx[1]], flags)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
-                        const bool is_selected = (item_current_idx[1] == n);
+    for (unsigned i = 0; i < filter_links.size(); i++) {
+        const std::pair<int, int> p = filter_links[i];
+        Edge2Pad x = edge2pad[p.first];
+        Edge2Pad y = edge2pad[p.second];
 
-                        if (ImGui::Selectable(items[n], is_selected)) {
-                            item_current_idx[1] = n;
-                            global_downscale_interpolation = values[n];
-                        }
+        if (y.is_output)
+            std::swap(x, y);
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
+        ret = avfilter_link(graph->filters[x.node], x.pad_index, graph->filters[y.node], y.pad_index);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link filters: %s(%d) <-> %s(%d)\n",
+                   graph->filters[x.node]->name, x.pad_index, graph->filters[y.node]->name, y.pad_index);
+            return ret;
+        }
+    }
 
-                ImGui::EndMenu();
-            }
+    ret = avfilter_graph_config(graph, NULL);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Cannot configure graph.\n");
 
-            if (ImGui::BeginMenu("Audio Outputs")) {
-                ImGui::DragFloat2("Sample Range", audio_sample_range, 0.01f, 1.f, 8.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput);
-                ImGui::InputFloat2("Window Size", audio_window_size);
-                if (ImGui::DragFloat3("Listener Position", listener_position, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
-                    alListenerfv(AL_POSITION, listener_position);
-                if (ImGui::DragFloat3("Listener Direction At", listener_direction, 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
-                    alListenerfv(AL_ORIENTATION, listener_direction);
-                if (ImGui::DragFloat3("Listener Direction Up", &listener_direction[3], 0.01f, -1.f, 1.f, "%f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoInput))
-                    alListenerfv(AL_ORIENTATION, listener_direction);
+    return ret;
+}
 
-                ImGui::EndMenu();
-            }
+static void autotune_worker(GraphBuild *build, double *score)
+{
+    std::vector<std::vector<int64_t>> latencies;
+    std::vector<AVFilterContext *> sinks;
+    std::vector<int64_t> durations;
+    std::vector<int64_t> frames;
+    int64_t start, total = 0;
+
+    graph_build_worker(build);
+    if (build->ret < 0)
+        goto end;
 
-            if (ImGui::BeginMenu("MiniMap")) {
-                const char *items[] = { "Off", "On" };
-                const bool values[] = { false, true };
-                const int positions[] = {
-                    ImNodesMiniMapLocation_BottomLeft,
-                    ImNodesMiniMapLocation_BottomRight,
-                    ImNodesMiniMapLocation_TopLeft,
-                    ImNodesMiniMapLocation_TopRight,
-                };
-                const char *positions_name[] = {
-                    "Bottom Left",
-                    "Bottom Right",
-                    "Top Left",
-                    "Top Right",
-                };
-                const int flags = 0;
+    for (unsigned i = 0; i < build->ctxs.size(); i++) {
+        AVFilterContext *filter_ctx = build->ctxs[i];
 
-                if (ImGui::BeginCombo("Toggle Display", items[show_mini_map], flags)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(items); n++) {
-                        const bool is_selected = values[n] == show_mini_map;
+        if (!strcmp(filter_ctx->filter->name, "buffersink") ||
+            !strcmp(filter_ctx->filter->name, "abuffersink"))
+            sinks.push_back(filter_ctx);
+    }
+    if (sinks.size() == 0)
+        goto end;
 
-                        if (ImGui::Selectable(items[n], is_selected))
-                            show_mini_map = values[n];
+    start = av_gettime_relative();
+    pull_sink_frames(build->graph, sinks, 0, AUTOTUNE_WINDOW, latencies, frames, durations);
+    for (unsigned i = 0; i < frames.size(); i++)
+        total += frames[i];
+    *score = total * 1000000. / std::max(av_gettime_relative() - start, INT64_C(1));
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
+end:
+    __atomic_store_n(&autotune_finished, true, __ATOMIC_RELEASE);
+}
 
-                if (ImGui::BeginCombo("Corner Position", positions_name[mini_map_location], flags)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(positions); n++) {
-                        const bool is_selected = mini_map_location == positions[n];
+static void start_autotune()
+{
+    const int max_threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+    autotune_threads.clear();
+    for (int n = 1; n < max_threads; n *= 2)
+        autotune_threads.push_back(n);
+    autotune_threads.push_back(max_threads);
+    autotune_scores.assign(autotune_threads.size(), 0.);
+    autotune_index = 0;
+    autotune_finished = false;
+    autotune_running = true;
+}
 
-                        if (ImGui::Selectable(positions_name[n], is_selected))
-                            mini_map_location = positions[n];
+static void update_autotune()
+{
+    unsigned best = 0;
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
+    if (!autotune_running)
+        return;
 
-                ImGui::EndMenu();
-            }
+    if (autotune_thread.joinable()) {
+        if (!__atomic_load_n(&autotune_finished, __ATOMIC_ACQUIRE))
+            return;
+        autotune_thread.join();
+        free_graph_build(&autotune_build);
+        av_log(NULL, AV_LOG_INFO, "Auto-tune: %d threads: %.1f frames/s.\n",
+               autotune_threads[autotune_index], autotune_scores[autotune_index]);
+        autotune_index++;
+    }
 
-            if (ImGui::BeginMenu("Display", filter_graph_is_valid == false)) {
-                const char *items[] = { "Windowed", "Fullscreen" };
-                const bool values[] = { false, true };
-                const bool old_display = full_screen;
+    if (graph_build_running)
+        return;
+    if (autotune_index == 0)
+        teardown_filter_graph();
 
-                if (ImGui::BeginCombo("Screen mode", items[full_screen], 0)) {
-                    for (int n = 0; n < IM_ARRAYSIZE(values); n++) {
-                        const bool is_selected = full_screen == values[n];
+    while (autotune_index < autotune_threads.size()) {
+        if (prepare_graph_build(&autotune_build, autotune_threads[autotune_index], false) >= 0) {
+            autotune_finished = false;
+            autotune_thread = std::thread(autotune_worker, &autotune_build, &autotune_scores[autotune_index]);
+            return;
+        }
 
-                        if (ImGui::Selectable(items[n], is_selected))
-                            full_screen = values[n];
+        free_graph_build(&autotune_build);
+        autotune_index++;
+    }
 
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
-                    }
-                    ImGui::EndCombo();
-                }
+    for (unsigned i = 1; i < autotune_scores.size(); i++) {
+        if (autotune_scores[i] > autotune_scores[best])
+            best = i;
+    }
 
-                if (old_display != full_screen)
-                    restart_display = true;
-                ImGui::EndMenu();
-            }
+    if (best < autotune_scores.size() && autotune_scores[best] > 0.) {
+        filter_graph_nb_threads = autotune_threads[best];
+        av_log(NULL, AV_LOG_INFO, "Auto-tune: using %d FilterGraph threads.\n", filter_graph_nb_threads);
+    } else {
+        av_log(NULL, AV_LOG_ERROR, "Auto-tune: cannot benchmark FilterGraph.\n");
+    }
+    autotune_running = false;
+    need_filters_reinit = true;
+}
 
-            if (ImGui::BeginMenu("Visual Color Style")) {
-                if (ImGui::MenuItem("Classic")) {
-                    ImGui::StyleColorsClassic();
-                    ImNodes::StyleColorsClassic();
-                }
-                if (ImGui::MenuItem("Dark")) {
-                    ImGui::StyleColorsDark();
-                    ImNodes::StyleColorsDark();
-                }
-                if (ImGui::MenuItem("Light")) {
-                    ImGui::StyleColorsLight();
-                    ImNodes::StyleColorsLight();
-                }
-                ImGui::EndMenu();
-            }
+static void stop_autotune()
+{
+    if (autotune_thread.joinable())
+        autotune_thread.join();
+    free_graph_build(&autotune_build);
+    autotune_running = false;
+}
 
-            ImGui::EndMenu();
-        }
+static void sync_render_outputs()
+{
+    std::vector<RenderOutput> outputs;
 
-        if (ImGui::BeginMenu("Export FilterGraph", filter_graph_is_valid == true)) {
-            if (ImGui::BeginMenu("Save as Script")) {
-                static char file_name[1024] = { 0 };
-                size_t out_size = 0;
-                char *out = NULL;
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        const FilterNode *node = &filter_nodes[i];
+        enum AVMediaType type;
+        RenderOutput output = { 0 };
+        unsigned j = 0;
 
-                ImGui::InputText("File name:", file_name, sizeof(file_name) - 1);
-                if (strlen(file_name) > 0 && ImGui::Button("Save")) {
-                    export_filter_graph(&out, &out_size);
+        if (!node->filter || !node->filter_label)
+            continue;
+        if (!strcmp(node->filter->name, "buffersink"))
+            type = AVMEDIA_TYPE_VIDEO;
+        else if (!strcmp(node->filter->name, "abuffersink"))
+            type = AVMEDIA_TYPE_AUDIO;
+        else
+            continue;
 
-                    if (out && out_size > 0) {
-                        FILE *script_file = fopen(file_name, "w");
+        for (; j < render_outputs.size(); j++) {
+            if (render_outputs[j].label && !strcmp(render_outputs[j].label, node->filter_label))
+                break;
+        }
 
-                        if (script_file) {
-                            fwrite(out, 1, out_size, script_file);
-                            fclose(script_file);
-                        }
-                        av_freep(&out);
-                        out_size = 0;
-                        memset(file_name, 0, sizeof(file_name));
-                    }
-                }
-                ImGui::EndMenu();
-            }
-            ImGui::EndMenu();
+        if (j < render_outputs.size()) {
+            output = render_outputs[j];
+            render_outputs[j].label = NULL;
+        } else {
+            output.label = av_strdup(node->filter_label);
+            output.type = type;
+            output.enabled = true;
+            snprintf(output.file_name, sizeof(output.file_name), "%s.%s", node->filter_label,
+                     type == AVMEDIA_TYPE_VIDEO ? "mkv" : "wav");
         }
+        outputs.push_back(output);
+    }
 
-        if (ImGui::BeginMenu("Import FilterGraph", filter_graph_is_valid == false &&
-                             filter_links.size() == 0 &&
-                             filter_nodes.size() == 0)) {
-            if (ImGui::BeginMenu("Load Script")) {
-                static char file_name[1024] = { 0 };
+    for (unsigned j = 0; j < render_outputs.size(); j++)
+        av_freep(&render_outputs[j].label);
+    render_outputs.swap(outputs);
+}
 
-                ImGui::InputText("File name:", file_name, sizeof(file_name) - 1);
-                if (strlen(file_name) > 0 && ImGui::Button("Load")) {
-                    av_freep(&import_script_file_name);
-                    import_script_file_name = av_asprintf("%s", file_name);
-                    memset(file_name, 0, sizeof(file_name));
-                }
-                ImGui::EndMenu();
+static void free_render_graph()
+{
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        RenderOutput *output = &render_outputs[i];
+
+        if (output->queue.buffer) {
+            while (!ring_buffer_is_empty(&output->queue)) {
+                AVFrame *frame = NULL;
+
+                ring_buffer_dequeue(&output->queue, &frame);
+                av_frame_free(&frame);
             }
-            ImGui::EndMenu();
+            ring_buffer_free(&output->queue);
         }
-
-        ImGui::EndPopup();
+        avcodec_free_context(&output->enc);
+        if (output->mux) {
+            if (!(output->mux->oformat->flags & AVFMT_NOFILE))
+                avio_closep(&output->mux->pb);
+            avformat_free_context(output->mux);
+            output->mux = NULL;
+        }
+        output->stream = NULL;
+        output->ctx = NULL;
+        output->codec = NULL;
+        output->header_written = false;
     }
-    ImGui::PopStyleVar();
 
-    edge2pad.resize(editor_edge);
+    avfilter_graph_free(&render_graph);
+}
 
-    for (unsigned i = 0; i < filter_nodes.size(); i++) {
-        FilterNode *filter_node = &filter_nodes[i];
+static void render_driver()
+{
+    AVFrame *frame = av_frame_alloc();
 
-        edge = filter_node->edge;
-        edge2pad[edge] = (Edge2Pad { i, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
-        ImNodes::BeginNode(filter_node->edge);
-        if (filter_node->set_pos) {
-            ImNodes::SetNodeEditorSpacePos(filter_node->edge, filter_node->pos);
-            filter_node->set_pos = false;
-        } else {
-            filter_node->pos = ImNodes::GetNodeEditorSpacePos(filter_node->edge);
+    while (frame) {
+        RenderOutput *output = NULL;
+        bool encoding = false;
+        AVFrame *queued;
+        double position;
+        int ret;
+
+        std::unique_lock<std::mutex> select_lock(render_mutex);
+        for (unsigned i = 0; i < render_outputs.size(); i++) {
+            RenderOutput *o = &render_outputs[i];
+
+            if (!o->ctx || o->eof || o->encoder_done)
+                continue;
+            encoding |= o->enc != NULL;
+            if (!output || o->position < output->position)
+                output = o;
         }
-        ImNodes::BeginNodeTitleBar();
-        ImGui::TextUnformatted(filter_node->filter_name);
-        if (ImGui::IsItemHovered())
-            ImGui::SetTooltip("%s\n%s", filter_node->filter_label, filter_node->filter->description);
-        ImNodes::EndNodeTitleBar();
-        draw_node_options(filter_node);
-        if (!filter_node->probe) {
-            ImNodes::EndNode();
+        select_lock.unlock();
+
+        if (!output || !encoding || __atomic_load_n(&render_stop, __ATOMIC_RELAXED))
+            break;
+
+        ret = av_buffersink_get_frame_flags(output->ctx, frame, 0);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF)
+                av_log(NULL, AV_LOG_ERROR, "Error while rendering %s.\n", output->label);
+            std::lock_guard<std::mutex> lock(render_mutex);
+            output->eof = true;
+            render_cv.notify_all();
             continue;
         }
 
-        AVFilterContext *filter_ctx = filter_node->ctx ? filter_node->ctx : filter_node->probe;
+        std::unique_lock<std::mutex> position_lock(render_mutex);
+        position = frame->pts == AV_NOPTS_VALUE ? output->position :
+                   frame->pts * av_q2d(av_buffersink_get_time_base(output->ctx));
+        output->position = position;
+        position_lock.unlock();
+        if ((render_duration > 0.f && position >= render_duration) || !output->enc) {
+            av_frame_unref(frame);
+            if (output->enc) {
+                std::lock_guard<std::mutex> lock(render_mutex);
+                output->eof = true;
+                render_cv.notify_all();
+            }
+            continue;
+        }
 
-        for (unsigned j = 0; j < filter_node->inpad_edges.size(); j++) {
-            const int edge = filter_node->inpad_edges[j];
+        queued = av_frame_alloc();
+        if (!queued) {
+            av_frame_unref(frame);
+            break;
+        }
+        av_frame_move_ref(queued, frame);
 
-            edge2pad[edge].removed = true;
+        std::unique_lock<std::mutex> lock(render_mutex);
+        render_cv.wait(lock, [output]{ return render_stop || output->encoder_done || !ring_buffer_is_full(&output->queue); });
+        if (render_stop) {
+            av_frame_free(&queued);
+            break;
+        }
+        if (output->encoder_done || ring_buffer_enqueue(&output->queue, queued) < 0) {
+            av_frame_free(&queued);
+            continue;
         }
-        filter_node->inpad_edges.resize(static_cast<size_t>(filter_ctx->nb_inputs));
+        lock.unlock();
+        render_cv.notify_all();
+    }
 
-        for (unsigned j = 0; j < filter_node->outpad_edges.size(); j++) {
-            const int edge = filter_node->outpad_edges[j];
+    av_frame_free(&frame);
 
-            edge2pad[edge].removed = true;
+    std::lock_guard<std::mutex> lock(render_mutex);
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        render_outputs[i].eof = true;
+    }
+    render_active--;
+    render_cv.notify_all();
+}
+
+static void render_encoder(RenderOutput *output)
+{
+    const AVRational sink_time_base = av_buffersink_get_time_base(output->ctx);
+    AVPacket *pkt = av_packet_alloc();
+    int ret = 0;
+
+    while (pkt) {
+        AVFrame *frame = NULL;
+        bool stopped;
+
+        std::unique_lock<std::mutex> lock(render_mutex);
+        render_cv.wait(lock, [output]{ return render_stop || output->eof || !ring_buffer_is_empty(&output->queue); });
+        stopped = render_stop;
+        if (!stopped && !ring_buffer_is_empty(&output->queue)) {
+            ring_buffer_dequeue(&output->queue, &frame);
+            output->frames++;
         }
-        filter_node->outpad_edges.resize(static_cast<size_t>(filter_ctx->nb_outputs));
+        lock.unlock();
+        render_cv.notify_all();
 
-        for (unsigned j = 0; j < filter_ctx->nb_inputs; j++) {
-            enum AVMediaType media_type;
+        if (frame && frame->pts != AV_NOPTS_VALUE)
+            frame->pts = av_rescale_q(frame->pts, sink_time_base, output->enc->time_base);
 
-            edge = filter_node->inpad_edges[j];
-            if (edge == 0) {
-                edge = editor_edge++;
-                filter_node->inpad_edges[j] = edge;
-                edge2pad.resize(editor_edge);
-            }
-            media_type = avfilter_pad_get_type(filter_ctx->input_pads, j);
-            if (media_type == AVMEDIA_TYPE_VIDEO) {
-                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(  0, 255, 255, 255));
-            } else {
-                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(255, 255,   0, 255));
-            }
-            edge2pad[edge] = (Edge2Pad { i, false, false, j, media_type });
-            filter_node->inpad_edges[j] = edge;
-            ImNodes::BeginInputAttribute(edge);
-            ImGui::Text("%s", avfilter_pad_get_name(filter_ctx->input_pads, j));
-            ImNodes::EndInputAttribute();
-            ImNodes::PopColorStyle();
+        ret = avcodec_send_frame(output->enc, frame);
+        av_frame_free(&frame);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            av_log(NULL, AV_LOG_ERROR, "Error while encoding %s.\n", output->label);
+            break;
         }
 
-        for (unsigned j = 0; j < filter_ctx->nb_outputs; j++) {
-            enum AVMediaType media_type;
-
-            edge = filter_node->outpad_edges[j];
-            if (edge == 0) {
-                edge = editor_edge++;
-                filter_node->outpad_edges[j] = edge;
-                edge2pad.resize(editor_edge);
-            }
-            media_type = avfilter_pad_get_type(filter_ctx->output_pads, j);
-            if (media_type == AVMEDIA_TYPE_VIDEO) {
-                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(  0, 255, 255, 255));
-            } else {
-                ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(255, 255,   0, 255));
+        while ((ret = avcodec_receive_packet(output->enc, pkt)) >= 0) {
+            av_packet_rescale_ts(pkt, output->enc->time_base, output->stream->time_base);
+            pkt->stream_index = output->stream->index;
+            ret = av_interleaved_write_frame(output->mux, pkt);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Error while writing %s.\n", output->file_name);
+                break;
             }
-            edge2pad[edge] = (Edge2Pad { i, false, true, j, media_type });
-            filter_node->outpad_edges[j] = edge;
-            ImNodes::BeginOutputAttribute(edge);
-            ImGui::Text("%s", avfilter_pad_get_name(filter_ctx->output_pads, j));
-            ImNodes::EndOutputAttribute();
-            ImNodes::PopColorStyle();
         }
 
-        ImNodes::EndNode();
-        ImNodes::SetNodeDraggable(filter_node->edge, true);
+        if (stopped || ret == AVERROR_EOF || (ret < 0 && ret != AVERROR(EAGAIN)))
+            break;
     }
 
-    for (unsigned i = 0; i < filter_links.size(); i++) {
-        const std::pair<int, int> p = filter_links[i];
-
-        if (edge2pad[p.first].removed  == true ||
-            edge2pad[p.second].removed == true) {
-            edge2pad[p.first].removed    = true;
-            edge2pad[p.second].removed   = true;
-            edge2pad[p.first].is_output  = false;
-            edge2pad[p.second].is_output = false;
+    if (output->header_written)
+        av_write_trailer(output->mux);
+    av_packet_free(&pkt);
 
-            filter_links.erase(filter_links.begin() + i);
-            continue;
-        }
+    std::lock_guard<std::mutex> lock(render_mutex);
+    output->eof = true;
+    output->encoder_done = true;
+    render_active--;
+    render_cv.notify_all();
+}
 
-        if (edge2pad[p.first].type  == AVMEDIA_TYPE_UNKNOWN ||
-            edge2pad[p.second].type == AVMEDIA_TYPE_UNKNOWN) {
-            edge2pad[p.first].removed    = true;
-            edge2pad[p.second].removed   = true;
-            edge2pad[p.first].is_output  = false;
-            edge2pad[p.second].is_output = false;
+static int open_render_encoder(RenderOutput *output)
+{
+    AVCodecContext *enc;
+    AVBufferRef *hw_frames_ctx;
+    int ret;
 
-            filter_links.erase(filter_links.begin() + i);
-            continue;
+    enc = output->enc = avcodec_alloc_context3(output->codec);
+    if (!enc)
+        return AVERROR(ENOMEM);
+
+    if (output->type == AVMEDIA_TYPE_VIDEO) {
+        enc->width = av_buffersink_get_w(output->ctx);
+        enc->height = av_buffersink_get_h(output->ctx);
+        enc->pix_fmt = (enum AVPixelFormat)av_buffersink_get_format(output->ctx);
+        enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(output->ctx);
+        enc->time_base = av_buffersink_get_time_base(output->ctx);
+        enc->framerate = av_buffersink_get_frame_rate(output->ctx);
+        hw_frames_ctx = av_buffersink_get_hw_frames_ctx(output->ctx);
+        if (hw_frames_ctx) {
+            enc->hw_frames_ctx = av_buffer_ref(hw_frames_ctx);
+            if (!enc->hw_frames_ctx)
+                return AVERROR(ENOMEM);
         }
+    } else {
+        enc->sample_rate = av_buffersink_get_sample_rate(output->ctx);
+        enc->sample_fmt = (enum AVSampleFormat)av_buffersink_get_format(output->ctx);
+        enc->time_base = av_make_q(1, enc->sample_rate);
+        ret = av_buffersink_get_ch_layout(output->ctx, &enc->ch_layout);
+        if (ret < 0)
+            return ret;
+    }
 
-        if (edge2pad[p.first].is_output == edge2pad[p.second].is_output) {
-            edge2pad[p.first].removed    = true;
-            edge2pad[p.second].removed   = true;
-            edge2pad[p.first].is_output  = false;
-            edge2pad[p.second].is_output = false;
-
-            filter_links.erase(filter_links.begin() + i);
-            continue;
-        }
+    if (output->mux->oformat->flags & AVFMT_GLOBALHEADER)
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-        ImNodes::Link(i, p.first, p.second);
+    ret = avcodec_open2(enc, output->codec, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open %s encoder for %s.\n", output->codec->name, output->label);
+        return ret;
     }
 
-    if (show_mini_map == true)
-        ImNodes::MiniMap(0.2f, mini_map_location);
-    ImNodes::EndNodeEditor();
+    if (output->type == AVMEDIA_TYPE_AUDIO && enc->frame_size > 0 &&
+        !(output->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        av_buffersink_set_frame_size(output->ctx, enc->frame_size);
 
-    for (unsigned i = 0; i < video_sink_threads.size(); i++) {
-        if (video_sink_threads[i].joinable()) {
-            ImGui::End();
-            return;
+    output->stream = avformat_new_stream(output->mux, NULL);
+    if (!output->stream)
+        return AVERROR(ENOMEM);
+    ret = avcodec_parameters_from_context(output->stream->codecpar, enc);
+    if (ret < 0)
+        return ret;
+    output->stream->time_base = enc->time_base;
+
+    if (!(output->mux->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&output->mux->pb, output->file_name, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot open '%s' for writing.\n", output->file_name);
+            return ret;
         }
     }
 
-    for (unsigned i = 0; i < audio_sink_threads.size(); i++) {
-        if (audio_sink_threads[i].joinable()) {
-            ImGui::End();
-            return;
-        }
+    ret = avformat_write_header(output->mux, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot write header for '%s'.\n", output->file_name);
+        return ret;
     }
+    output->header_written = true;
 
-    int link_id;
-    if (ImNodes::IsLinkDestroyed(&link_id) && filter_links.size() > 0) {
-        const std::pair<int, int> p = filter_links[link_id];
+    return 0;
+}
 
-        edge2pad[p.first].removed    = true;
-        edge2pad[p.second].removed   = true;
-        edge2pad[p.first].is_output  = false;
-        edge2pad[p.second].is_output = false;
+static int start_render()
+{
+    int ret = 0;
 
-        filter_links.erase(filter_links.begin() + link_id);
+    render_graph = avfilter_graph_alloc();
+    if (!render_graph) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot allocate render filter graph.\n");
+        return AVERROR(ENOMEM);
     }
 
-    const int links_selected = ImNodes::NumSelectedLinks();
-    if (!ImGui::IsItemHovered() && links_selected > 0 && ImGui::IsKeyReleased(ImGuiKey_X) && filter_links.size() > 0) {
-        std::vector<int> selected_links;
+    render_graph->nb_threads = filter_graph_nb_threads;
+    avfilter_graph_set_auto_convert(render_graph, filter_graph_auto_convert_flags);
 
-        selected_links.resize(static_cast<size_t>(links_selected));
-        ImNodes::GetSelectedLinks(selected_links.data());
-        std::sort(selected_links.begin(), selected_links.end(), std::greater <>());
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        RenderOutput *output = &render_outputs[i];
 
-        for (const int link_id : selected_links) {
-            const std::pair<int, int> p = filter_links[link_id];
+        output->eof = false;
+        output->encoder_done = false;
+        output->frames = 0;
+        output->position = 0.;
+        if (!output->enabled)
+            continue;
 
-            edge2pad[p.first].removed    = true;
-            edge2pad[p.second].removed   = true;
-            edge2pad[p.first].is_output  = false;
-            edge2pad[p.second].is_output = false;
+        ret = avformat_alloc_output_context2(&output->mux, NULL, NULL, output->file_name);
+        if (ret < 0 || !output->mux) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot find output format for '%s'.\n", output->file_name);
+            ret = ret < 0 ? ret : AVERROR(EINVAL);
+            goto error;
+        }
 
-            filter_links.erase(filter_links.begin() + link_id);
+        if (output->encoder_name[0])
+            output->codec = avcodec_find_encoder_by_name(output->encoder_name);
+        else
+            output->codec = avcodec_find_encoder(output->type == AVMEDIA_TYPE_VIDEO ?
+                                                 output->mux->oformat->video_codec :
+                                                 output->mux->oformat->audio_codec);
+        if (!output->codec || output->codec->type != output->type) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot find encoder for %s.\n", output->label);
+            ret = AVERROR(EINVAL);
+            goto error;
         }
+
+        ret = ring_buffer_init(&output->queue, RENDER_QUEUE_SIZE);
+        if (ret < 0)
+            goto error;
     }
 
-    const unsigned nodes_selected = ImNodes::NumSelectedNodes();
-    if (nodes_selected > 0 && nodes_selected <= filter_nodes.size() && !ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_X) && ImGui::GetIO().KeyShift) {
-        std::vector<int> selected_nodes;
+    ret = alloc_node_filters(render_graph);
+    if (ret < 0)
+        goto error;
 
-        selected_nodes.resize(static_cast<size_t>(nodes_selected));
-        ImNodes::GetSelectedNodes(selected_nodes.data());
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        RenderOutput *output = &render_outputs[i];
+        AVFilterContext *filter_ctx = avfilter_graph_get_filter(render_graph, output->label);
 
-        for (unsigned node_id = 0; node_id < selected_nodes.size(); node_id++) {
-            const int edge = selected_nodes[node_id];
-            if (edge < 0)
-                continue;
-            const unsigned node = edge2pad[edge].node;
-            std::vector<int> removed_edges;
+        output->ctx = filter_ctx;
+        if (!filter_ctx || !output->codec)
+            continue;
 
-            edge2pad[edge].removed = true;
-            edge2pad[edge].is_output = false;
-            filter_nodes[node].filter = NULL;
-            avfilter_free(filter_nodes[node].ctx);
-            filter_nodes[node].ctx = NULL;
-            av_freep(&filter_nodes[node].filter_name);
-            av_freep(&filter_nodes[node].filter_label);
-            av_freep(&filter_nodes[node].filter_options);
-            av_freep(&filter_nodes[node].ctx_options);
-            avfilter_free(filter_nodes[node].probe);
-            filter_nodes[node].probe = NULL;
+        if (output->type == AVMEDIA_TYPE_VIDEO && output->codec->pix_fmts)
+            ret = av_opt_set_int_list(filter_ctx, "pix_fmts", output->codec->pix_fmts,
+                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+        if (ret >= 0 && output->type == AVMEDIA_TYPE_AUDIO && output->codec->sample_fmts)
+            ret = av_opt_set_int_list(filter_ctx, "sample_fmts", output->codec->sample_fmts,
+                                      AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+        if (ret >= 0 && output->type == AVMEDIA_TYPE_AUDIO && output->codec->supported_samplerates)
+            ret = av_opt_set_int_list(filter_ctx, "sample_rates", output->codec->supported_samplerates,
+                                      0, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set %s output formats.\n", output->label);
+            goto error;
+        }
+    }
 
-            removed_edges.push_back(filter_nodes[node].edge);
-            for (unsigned j = 0; j < filter_nodes[node].inpad_edges.size(); j++)
-                removed_edges.push_back(filter_nodes[node].inpad_edges[j]);
+    ret = init_node_filters(render_graph);
+    if (ret < 0)
+        goto error;
 
-            for (unsigned j = 0; j < filter_nodes[node].outpad_edges.size(); j++)
-                removed_edges.push_back(filter_nodes[node].outpad_edges[j]);
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        RenderOutput *output = &render_outputs[i];
 
-            erased = true;
+        if (!output->codec || !output->ctx)
+            continue;
+        ret = open_render_encoder(output);
+        if (ret < 0)
+            goto error;
+    }
 
-            for (unsigned r = 0; r < removed_edges.size(); r++) {
-                std::vector<unsigned> selected_links;
-                const int removed_edge = removed_edges[r];
+    render_stop = false;
+    render_running = true;
+    render_start_time = av_gettime_relative();
+    render_end_time = 0;
+    render_active = 1;
+    render_threads.push_back(std::thread(render_driver));
+    for (unsigned i = 0; i < render_outputs.size(); i++) {
+        if (!render_outputs[i].enc)
+            continue;
+        render_active++;
+        render_threads.push_back(std::thread(render_encoder, &render_outputs[i]));
+    }
 
-                if (removed_edge < 0)
-                    continue;
-                edge2pad[removed_edge].type = AVMEDIA_TYPE_UNKNOWN;
-                edge2pad[removed_edge].is_output = false;
-                edge2pad[removed_edge].removed = true;
+    return 0;
+error:
+    free_render_graph();
 
-                if (filter_links.size() <= 0)
-                    continue;
+    return ret;
+}
+
+static void stop_render()
+{
+    {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        render_stop = true;
+        render_cv.notify_all();
+    }
 
-                for (unsigned l = 0; l < filter_links.size(); l++) {
-                    const std::pair<int, int> p = filter_links[l];
+    for (unsigned i = 0; i < render_threads.size(); i++) {
+        if (render_threads[i].joinable())
+            render_threads[i].join();
+    }
+    render_threads.clear();
 
-                    if (p.first == removed_edge || p.second == removed_edge)
-                        selected_links.push_back(l);
-                }
+    if (render_running)
+        render_end_time = av_gettime_relative();
+    render_running = false;
+    free_render_graph();
+}
+
+static void update_render_state()
+{
+    bool done;
+
+    if (!render_running)
+        return;
+
+    render_mutex.lock();
+    done = render_active == 0;
+    render_mutex.unlock();
+
+    if (done)
+        stop_render();
+}
+
+static void show_render(bool *p_open, bool focused)
+{
+    const int64_t now = render_running ? av_gettime_relative() : render_end_time;
+    const double elapsed = render_start_time && now > render_start_time ? (now - render_start_time) / 1000000. : 0.;
+    double position = 0.;
+    int64_t frames = 0;
 
-                std::sort(selected_links.begin(), selected_links.end(), std::greater <>());
-                for (const unsigned link_id : selected_links) {
-                    const std::pair<int, int> p = filter_links[link_id];
+    if (focused)
+        ImGui::SetNextWindowFocus();
+    ImGui::SetNextWindowSize(ImVec2(600, 200), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Render to File", p_open, 0)) {
+        ImGui::End();
+        return;
+    }
 
-                    edge2pad[p.first].removed    = true;
-                    edge2pad[p.second].removed   = true;
-                    edge2pad[p.first].is_output  = false;
-                    edge2pad[p.second].is_output = false;
+    if (!render_running)
+        sync_render_outputs();
+
+    if (ImGui::BeginTable("##Render Outputs", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Render", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Sink");
+        ImGui::TableSetupColumn("File");
+        ImGui::TableSetupColumn("Encoder");
+        ImGui::TableSetupColumn("Progress");
+        ImGui::TableHeadersRow();
+
+        for (unsigned i = 0; i < render_outputs.size(); i++) {
+            RenderOutput *output = &render_outputs[i];
+
+            ImGui::PushID(i);
+            ImGui::BeginDisabled(render_running);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Checkbox("##Enabled", &output->enabled);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(output->label);
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-FLT_MIN);
+            ImGui::InputText("##File", output->file_name, sizeof(output->file_name));
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-FLT_MIN);
+            ImGui::InputTextWithHint("##Encoder", "default", output->encoder_name, sizeof(output->encoder_name));
+            ImGui::EndDisabled();
+            ImGui::TableNextColumn();
+            if (output->enabled) {
+                int64_t output_frames;
+                double output_position;
 
-                    filter_links.erase(filter_links.begin() + link_id);
+                {
+                    std::lock_guard<std::mutex> lock(render_mutex);
+                    output_frames = output->frames;
+                    output_position = output->position;
                 }
+                ImGui::Text("%ld frames, %.2f s", output_frames, output_position);
+                position = std::max(position, output_position);
+                frames += output_frames;
             }
+            ImGui::PopID();
         }
+        ImGui::EndTable();
     }
 
-    if (erased && filter_nodes.size() > 0) {
-        unsigned i = filter_nodes.size() - 1;
-        do {
-            if (!filter_nodes[i].filter)
-                filter_nodes.erase(filter_nodes.begin() + i);
-            else
-                filter_nodes[i].set_pos = true;
-        } while (i--);
+    ImGui::BeginDisabled(render_running);
+    ImGui::DragFloat("Duration", &render_duration, 1.f, 0.f, FLT_MAX, render_duration > 0.f ? "%.2f s" : "until EOF");
+    ImGui::EndDisabled();
+
+    if (!render_running) {
+        if (ImGui::Button("Start") && start_render() < 0)
+            av_log(NULL, AV_LOG_ERROR, "Cannot start rendering.\n");
+    } else if (ImGui::Button("Stop")) {
+        stop_render();
     }
 
-    const unsigned copy_nodes_selected = ImNodes::NumSelectedNodes();
-    if (copy_nodes_selected > 0 && copy_nodes_selected <= filter_nodes.size() && !ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_C) && ImGui::GetIO().KeyShift) {
-        std::vector<int> selected_nodes;
+    if (render_duration > 0.f) {
+        ImGui::SameLine();
+        ImGui::ProgressBar(std::min(position / render_duration, 1.), ImVec2(-FLT_MIN, 0));
+    }
 
-        selected_nodes.resize(static_cast<size_t>(copy_nodes_selected));
-        ImNodes::GetSelectedNodes(selected_nodes.data());
+    if (elapsed > 0.)
+        ImGui::Text("%.2f s rendered in %.2f s | %.2fx realtime | %.1f frames/s",
+                    position, elapsed, position / elapsed, frames / elapsed);
 
-        for (unsigned i = 0; i < selected_nodes.size(); i++) {
-            const int e = selected_nodes[i];
-            if (e < 0)
-                continue;
-            FilterNode orig = filter_nodes[edge2pad[e].node];
-            FilterNode copy;
+    ImGui::End();
+}
 
-            copy.filter = orig.filter;
-            copy.id = filter_nodes.size();
-            copy.filter_name = av_strdup(orig.filter->name);
-            copy.filter_label = av_asprintf("%s%d", copy.filter->name, copy.id);
-            copy.filter_options = NULL;
-            copy.ctx_options = NULL;
-            copy.probe = avfilter_graph_alloc_filter(probe_graph, copy.filter, "probe");
-            copy.ctx = NULL;
-            copy.pos = find_node_spot(orig.pos);
-            copy.colapsed = false;
-            copy.set_pos = true;
-            copy.edge = editor_edge++;
+static int64_t update_sink_memory(BufferSink *sink, int64_t *slowest)
+{
+    const int64_t head = __atomic_load_n(&sink->head_pts, __ATOMIC_RELAXED);
+    std::vector<const AVBuffer *> seen;
 
-            av_opt_copy(copy.probe, orig.probe);
-            av_opt_copy(copy.probe->priv, orig.probe->priv);
+    sink->render_bytes = ring_buffer_bytes(&sink->render_frames, seen);
+    sink->cache_bytes = 0;
+    for (unsigned i = 0; i < sink->frame_cache.size(); i++)
+        sink->cache_bytes += unique_frame_bytes(sink->frame_cache[i].frame, seen);
 
-            edge2pad.push_back(Edge2Pad { copy.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
+    if (head != AV_NOPTS_VALUE && (*slowest == AV_NOPTS_VALUE || head < *slowest))
+        *slowest = head;
 
-            for (unsigned j = 0; j < orig.inpad_edges.size(); j++) {
-                copy.inpad_edges.push_back(editor_edge++);
-                edge2pad.push_back(Edge2Pad { copy.id, false, false, j, AVMEDIA_TYPE_UNKNOWN });
-            }
+    return get_sink_bytes(sink);
+}
 
-            for (unsigned j = 0; j < orig.outpad_edges.size(); j++) {
-                copy.outpad_edges.push_back(editor_edge++);
-                edge2pad.push_back(Edge2Pad { copy.id, false, true, j, AVMEDIA_TYPE_UNKNOWN });
-            }
+static void update_frame_memory()
+{
+    int64_t slowest = AV_NOPTS_VALUE;
+    int64_t total = 0;
 
-            filter_nodes.push_back(copy);
-        }
+    if (!filter_graph_is_valid || !filter_graph) {
+        __atomic_store_n(&frame_memory_total, INT64_C(0), __ATOMIC_RELAXED);
+        return;
     }
 
-    if (!ImGui::IsItemHovered() && ImGui::IsKeyReleased(ImGuiKey_A) && ImGui::GetIO().KeyShift) {
-        const AVFilter *buffersink  = avfilter_get_by_name("buffersink");
-        const AVFilter *abuffersink = avfilter_get_by_name("abuffersink");
-        std::vector<int> unconnected_edges;
-        std::vector<int> connected_edges;
-
-        for (unsigned l = 0; l < filter_links.size(); l++) {
-            const std::pair<int, int> p = filter_links[l];
+    for (unsigned i = 0; i < buffer_sinks.size(); i++)
+        total += update_sink_memory(&buffer_sinks[i], &slowest);
+    for (unsigned i = 0; i < abuffer_sinks.size(); i++)
+        total += update_sink_memory(&abuffer_sinks[i], &slowest);
 
-            connected_edges.push_back(p.first);
-            connected_edges.push_back(p.second);
-        }
+    __atomic_store_n(&frame_memory_slowest_pts, slowest, __ATOMIC_RELAXED);
+    __atomic_store_n(&frame_memory_total, total, __ATOMIC_RELAXED);
+}
 
-        for (int e = 0; e < editor_edge; e++) {
-            unsigned ee = 0;
-            for (; ee < connected_edges.size(); ee++) {
-                if (e == connected_edges[ee])
-                    break;
-            }
+static void draw_sink_memory_row(BufferSink *sink)
+{
+    const double mib = 1024. * 1024.;
+
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(sink->label);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.1f", __atomic_load_n(&sink->consume_bytes, __ATOMIC_RELAXED) / mib);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.1f", sink->render_bytes / mib);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.1f", __atomic_load_n(&sink->purge_bytes, __ATOMIC_RELAXED) / mib);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.1f", sink->cache_bytes / mib);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.1f", get_sink_bytes(sink) / mib);
+}
 
-            if (ee == connected_edges.size() &&
-                edge2pad[e].type != AVMEDIA_TYPE_UNKNOWN &&
-                edge2pad[e].is_output == true &&
-                edge2pad[e].removed == false) {
-                unconnected_edges.push_back(e);
-            }
-        }
+static void show_memory(bool *p_open, bool focused)
+{
+    const int64_t total = __atomic_load_n(&frame_memory_total, __ATOMIC_RELAXED);
+    const double mib = 1024. * 1024.;
 
-        for (unsigned i = 0; i < unconnected_edges.size(); i++) {
-            const int e = unconnected_edges[i];
-            if (e < 0)
-                continue;
-            enum AVMediaType type = edge2pad[e].type;
-            FilterNode src = filter_nodes[edge2pad[e].node];
-            FilterNode node;
+    if (focused)
+        ImGui::SetNextWindowFocus();
+    ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Frame Memory", p_open, 0)) {
+        ImGui::End();
+        return;
+    }
 
-            node.filter = type == AVMEDIA_TYPE_AUDIO ? abuffersink : buffersink;
-            node.id = filter_nodes.size();
-            node.filter_name = av_strdup(node.filter->name);
-            node.filter_label = av_asprintf("%s%d", node.filter->name, node.id);
-            node.filter_options = NULL;
-            node.ctx_options = NULL;
-            node.probe = NULL;
-            node.ctx = NULL;
-            node.pos = find_node_spot(src.pos);
-            node.colapsed = false;
-            node.set_pos = true;
-            node.edge = editor_edge++;
-            node.inpad_edges.push_back(editor_edge);
-            edge2pad.push_back(Edge2Pad { node.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
-            edge2pad.push_back(Edge2Pad { node.id, false, false, 0, AVMEDIA_TYPE_UNKNOWN });
+    if (frame_memory_cap_mb > 0) {
+        char overlay[64];
 
-            filter_nodes.push_back(node);
-            filter_links.push_back(std::make_pair(e, editor_edge++));
-        }
+        snprintf(overlay, sizeof(overlay), "%.1f / %d MiB", total / mib, frame_memory_cap_mb);
+        ImGui::ProgressBar(std::min(total / (frame_memory_cap_mb * mib), 1.), ImVec2(-FLT_MIN, 0), overlay);
+    } else {
+        ImGui::Text("Total: %.1f MiB", total / mib);
     }
+    ImGui::DragInt("Frame Memory Cap", &frame_memory_cap_mb, 16.f, 0, 1 << 20,
+                   frame_memory_cap_mb ? "%d MiB" : "unlimited", ImGuiSliderFlags_AlwaysClamp);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", "While over the cap, outputs ahead of the slowest one stop pulling");
 
-    int start_attr, end_attr;
-    if (ImNodes::IsLinkCreated(&start_attr, &end_attr)) {
-        const enum AVMediaType first  = edge2pad[start_attr].type;
-        const enum AVMediaType second = edge2pad[end_attr].type;
+    if (!filter_graph_is_valid || !filter_graph) {
+        ImGui::End();
+        return;
+    }
 
-        if (first == second && first != AVMEDIA_TYPE_UNKNOWN)
-            filter_links.push_back(std::make_pair(start_attr, end_attr));
+    if (ImGui::BeginTable("##Sink Memory", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Sink");
+        ImGui::TableSetupColumn("Queued MiB");
+        ImGui::TableSetupColumn("Render MiB");
+        ImGui::TableSetupColumn("Purge MiB");
+        ImGui::TableSetupColumn("Cache MiB");
+        ImGui::TableSetupColumn("Total MiB");
+        ImGui::TableHeadersRow();
+        for (unsigned i = 0; i < buffer_sinks.size(); i++)
+            draw_sink_memory_row(&buffer_sinks[i]);
+        for (unsigned i = 0; i < abuffer_sinks.size(); i++)
+            draw_sink_memory_row(&abuffer_sinks[i]);
+        ImGui::EndTable();
     }
 
+    ImGui::TextDisabled("%s", "Frames queued inside the FilterGraph are not counted.");
+
     ImGui::End();
 }
 
-static void draw_filters_commands(unsigned *toggle_filter)
+static void show_compare(bool *p_open, bool focused)
 {
-    static unsigned selected_filter = -1;
-
-    if (ImGui::BeginListBox("##Commands Box", ImVec2(-1, -1))) {
-        static ImGuiTextFilter imgui_filter;
+    const char *modes = "Split\0Flip\0Difference\0PSNR Heatmap\0";
+    const BufferSink *a, *b;
+    ImVec2 avail, size, pos;
+    bool update_stats;
+    float scale;
 
-        imgui_filter.Draw();
-        for (unsigned n = 0; n < filter_nodes.size(); n++) {
-            const AVFilterContext *ctx = filter_nodes[n].ctx;
-            const bool is_selected = selected_filter == n;
-            static bool is_opened = false;
-            static bool clean_storage = true;
+    if (focused)
+        ImGui::SetNextWindowFocus();
+    ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Compare Outputs", p_open, 0)) {
+        ImGui::End();
+        return;
+    }
 
-            if (!ctx)
-                continue;
+    if (!filter_graph_is_valid || buffer_sinks.size() < 2 || !show_buffersink_window || grid_presentation) {
+        ImGui::TextUnformatted("Needs two visible video FilterGraph outputs outside the grid.");
+        ImGui::End();
+        return;
+    }
 
-            if (!ctx->filter)
-                continue;
+    for (int i = 0; i < 2; i++) {
+        compare_sinks[i] = av_clip(compare_sinks[i], 0, buffer_sinks.size() - 1);
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.4f);
+        if (ImGui::BeginCombo(i ? "B" : "A", buffer_sinks[compare_sinks[i]].label)) {
+            for (unsigned j = 0; j < buffer_sinks.size(); j++) {
+                if (ImGui::Selectable(buffer_sinks[j].label, compare_sinks[i] == (int)j))
+                    compare_sinks[i] = j;
+            }
+            ImGui::EndCombo();
+        }
+        if (i == 0)
+            ImGui::SameLine();
+    }
+    a = &buffer_sinks[compare_sinks[0]];
+    b = &buffer_sinks[compare_sinks[1]];
 
-            if (!imgui_filter.PassFilter(ctx->filter->name))
-                continue;
+    ImGui::SetNextItemWidth(150);
+    ImGui::Combo("Mode", &compare_mode, modes);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150);
+    if (compare_mode == COMPARE_FLIP)
+        ImGui::DragInt("Interval", &compare_flip_ms, 10.f, 50, 5000, "%d ms", ImGuiSliderFlags_AlwaysClamp);
+    else if (compare_mode == COMPARE_DIFFERENCE)
+        ImGui::DragFloat("Gain", &compare_gain, 0.1f, 1.f, 64.f, "%.1f", ImGuiSliderFlags_AlwaysClamp);
+    else if (compare_mode == COMPARE_SPLIT)
+        ImGui::SliderFloat("Split", &compare_split, 0.f, 1.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+    else
+        ImGui::TextDisabled("red: 20 dB, blue: 50 dB");
 
-            if (ImGui::Selectable(ctx->filter->name, is_selected)) {
-                selected_filter = n;
-            }
+    if (!a->texture_width || !b->texture_width || !a->uploaded_frame || !b->uploaded_frame) {
+        ImGui::TextUnformatted("Waiting for frames.");
+        ImGui::End();
+        return;
+    }
 
-            if (ImGui::IsItemActive() || ImGui::IsItemHovered()) {
-                ImGui::SetTooltip("%s", ctx->name);
-            }
+    if (compare_mode == COMPARE_FLIP && av_gettime_relative() - compare_flip_time > compare_flip_ms * 1000LL) {
+        compare_flipped = !compare_flipped;
+        compare_flip_time = av_gettime_relative();
+    }
 
-            if (ImGui::IsItemClicked() && ImGui::IsItemActive()) {
-                selected_filter = n;
-                is_opened = true;
-            }
+    update_stats = compare_stats_pts[0] != a->uploaded_pts || compare_stats_pts[1] != b->uploaded_pts;
+    render_compare(a, b, update_stats);
+    compare_stats_pts[0] = a->uploaded_pts;
+    compare_stats_pts[1] = b->uploaded_pts;
 
-            if (is_opened && selected_filter == n)
-                draw_filter_commands(ctx, n, toggle_filter, is_opened, &clean_storage, true);
-        }
+    if (a->texture_width != b->texture_width || a->texture_height != b->texture_height)
+        ImGui::TextColored(ImVec4(1.f, 0.5f, 0.f, 1.f), "Size mismatch: %dx%d vs %dx%d",
+                           a->texture_width, a->texture_height, b->texture_width, b->texture_height);
+    else
+        ImGui::Text("PSNR: %.3f dB | SSIM: %.5f", compare_psnr, compare_ssim);
+    if (av_compare_ts(a->uploaded_pts, a->time_base, b->uploaded_pts, b->time_base)) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.f, 0.5f, 0.f, 1.f), "| PTS mismatch: %.5f vs %.5f",
+                           av_q2d(a->time_base) * a->uploaded_pts, av_q2d(b->time_base) * b->uploaded_pts);
+    }
 
-        ImGui::EndListBox();
+    avail = ImGui::GetContentRegionAvail();
+    scale = std::min(avail.x / compare_width, avail.y / compare_height);
+    size = ImVec2(compare_width * scale, compare_height * scale);
+    pos = ImGui::GetCursorScreenPos();
+    ImGui::Image((void*)(intptr_t)compare_texture, size);
+    if (compare_mode == COMPARE_SPLIT) {
+        const float x = pos.x + size.x * compare_split;
+
+        if (ImGui::IsItemHovered() && ImGui::IsMouseDown(ImGuiMouseButton_Left))
+            compare_split = av_clipf((ImGui::GetIO().MousePos.x - pos.x) / size.x, 0.f, 1.f);
+        ImGui::GetWindowDrawList()->AddLine(ImVec2(x, pos.y), ImVec2(x, pos.y + size.y), IM_COL32(255, 255, 255, 160));
+    } else if (compare_mode == COMPARE_FLIP) {
+        ImGui::GetWindowDrawList()->AddText(ImVec2(pos.x + 8, pos.y + 8), IM_COL32_WHITE, compare_flipped ? "B" : "A");
     }
+
+    ImGui::End();
 }
 
-static void show_commands(bool *p_open, bool focused)
+static void show_profile(bool *p_open, bool focused)
 {
-    static unsigned toggle_filter = UINT_MAX;
+    const ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                  ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+    std::vector<std::pair<unsigned, FilterStats>> rows;
+    int64_t total_time = 0;
 
-    if (filter_graph_is_valid == false || (
-        ((buffer_sinks.size() != mutexes.size() ||
-          buffer_sinks.size() == 0)) &&
-        ((abuffer_sinks.size() != amutexes.size() ||
-          abuffer_sinks.size() == 0))))
+    if (filter_graph_is_valid == false)
         return;
 
     if (focused)
         ImGui::SetNextWindowFocus();
-    if (!ImGui::Begin("Filter Commands", p_open, 0)) {
+    if (!ImGui::Begin("FilterGraph Profile", p_open, 0)) {
         ImGui::End();
         return;
     }
 
-    draw_filters_commands(&toggle_filter);
+    if (!profiling_active)
+        ImGui::TextUnformatted("Filter timing is disabled, enable it in FilterGraph Options.");
+    else
+        ImGui::TextDisabled("%s", "Only slice threaded filters are timed, others show no time or heat.");
+
+    bool tracing = trace_enabled;
+    if (ImGui::Checkbox("Record Timeline Trace", &tracing)) {
+        if (tracing)
+            start_trace();
+        else
+            dump_trace(trace_file_name);
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%s", "Unchecking writes a Chrome trace / Perfetto JSON file");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+    ImGui::InputText("##Trace File", trace_file_name, sizeof(trace_file_name));
 
-    ImGui::End();
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        FilterStats stats;
 
-    if (toggle_filter < UINT_MAX) {
-        const AVFilterContext *filter_ctx = filter_graph->filters[toggle_filter];
-        const int flag = !filter_ctx->is_disabled;
+        if (!filter_nodes[i].ctx)
+            continue;
+        get_filter_stats(&filter_nodes[i], &stats);
+        total_time += stats.time;
+        rows.push_back(std::make_pair(i, stats));
+    }
 
-        avfilter_graph_send_command(filter_graph, filter_ctx->name, "enable", flag ? "0" : "1", NULL, 0, 0);
-        toggle_filter = UINT_MAX;
+    if (ImGui::BeginTable("##Profile", 5, flags)) {
+        ImGuiTableSortSpecs *specs;
+
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Filter");
+        ImGui::TableSetupColumn("Label");
+        ImGui::TableSetupColumn("Time (ms)", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Share (%)", ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Jobs", ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableHeadersRow();
+
+        specs = ImGui::TableGetSortSpecs();
+        if (specs && specs->SpecsCount > 0) {
+            const int column = specs->Specs[0].ColumnIndex;
+            const bool ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+
+            std::stable_sort(rows.begin(), rows.end(), [column, ascending](const std::pair<unsigned, FilterStats> &a,
+                                                                           const std::pair<unsigned, FilterStats> &b) {
+                int64_t x, y;
+                int cmp;
+
+                switch (column) {
+                case 0:  cmp = strcmp(filter_nodes[a.first].filter_name, filter_nodes[b.first].filter_name); break;
+                case 1:  cmp = strcmp(filter_nodes[a.first].filter_label, filter_nodes[b.first].filter_label); break;
+                case 4:  x = a.second.calls;      y = b.second.calls;      cmp = (x > y) - (x < y); break;
+                default: x = a.second.time;       y = b.second.time;       cmp = (x > y) - (x < y); break;
+                }
+
+                return ascending ? cmp < 0 : cmp > 0;
+            });
+        }
+
+        for (unsigned i = 0; i < rows.size(); i++) {
+            const FilterNode *node = &filter_nodes[rows[i].first];
+            const FilterStats *stats = &rows[i].second;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(node->filter_name);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(node->filter_label);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats->time / 1000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", total_time > 0 ? 100.0 * stats->time / total_time : 0.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%ld", stats->calls);
+        }
+
+        ImGui::EndTable();
     }
+
+    ImGui::End();
 }
 
 static void show_dumpgraph(bool *p_open, bool focused)
@@ -3127,53 +7734,120 @@ static void show_dumpgraph(bool *p_open, bool focused)
     ImGui::End();
 }
 
+static thread_local LogEntry log_line;
+static thread_local int log_line_len = 0;
+
 static void log_callback(void *ptr, int level, const char *fmt, va_list args)
 {
-    log_mutex.lock();
+    const AVClass *avc = ptr ? *(const AVClass **)ptr : NULL;
+    LogEntry *entry;
+    unsigned index;
+    int len;
 
-    if (log_level >= level) {
-        int old_size = log_buffer.size();
+    if ((level & 0xff) > __atomic_load_n(&log_level, __ATOMIC_RELAXED))
+        return;
 
-        switch (level) {
-        case AV_LOG_QUIET:
-            break;
-        case AV_LOG_PANIC:
-            log_buffer.appendf("[panic] ");
-            break;
-        case AV_LOG_FATAL:
-            log_buffer.appendf("[fatal] ");
-            break;
-        case AV_LOG_ERROR:
-            log_buffer.appendf("[error] ");
-            break;
-        case AV_LOG_WARNING:
-            log_buffer.appendf("[warning] ");
-            break;
-        case AV_LOG_INFO:
-            log_buffer.appendf("[info] ");
-            break;
-        case AV_LOG_VERBOSE:
-            log_buffer.appendf("[verbose] ");
-            break;
-        case AV_LOG_DEBUG:
-            log_buffer.appendf("[debug] ");
-            break;
-        default:
-            log_buffer.appendf("[unknown%d] ", level);
-            break;
+    if (!log_line_len) {
+        log_line.level = level & 0xff;
+        log_line.time = av_gettime_relative() - log_start_time;
+        log_line.class_name[0] = 0;
+        log_line.item_name[0] = 0;
+        if (avc) {
+            av_strlcpy(log_line.class_name, avc->class_name, sizeof(log_line.class_name));
+            if (avc->item_name)
+                av_strlcpy(log_line.item_name, avc->item_name(ptr), sizeof(log_line.item_name));
         }
-        log_buffer.appendfv(fmt, args);
-        for (int new_size = log_buffer.size(); old_size < new_size; old_size++)
-            if (log_buffer[old_size] == '\n')
-                log_lines_offsets.push_back(old_size + 1);
     }
 
-    log_mutex.unlock();
+    len = vsnprintf(log_line.message + log_line_len, sizeof(log_line.message) - log_line_len, fmt, args);
+    if (len < 0)
+        return;
+    log_line_len = std::min(log_line_len + len, (int)sizeof(log_line.message) - 1);
+    if (!log_line_len)
+        return;
+
+    /* av_log() callers often build one line from several calls, so only
+     * publish once the line is complete or the buffer is full. */
+    if (log_line.message[log_line_len - 1] != '\n' && log_line_len < (int)sizeof(log_line.message) - 1)
+        return;
+    if (log_line.message[log_line_len - 1] == '\n')
+        log_line.message[log_line_len - 1] = 0;
+    log_line_len = 0;
+
+    index = __atomic_fetch_add(&log_write_index, 1U, __ATOMIC_RELAXED);
+    entry = &log_ring[index % LOG_RING_SIZE];
+
+    __atomic_store_n(&entry->seq, 0U, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    entry->level = log_line.level;
+    entry->time = log_line.time;
+    memcpy(entry->class_name, log_line.class_name, sizeof(entry->class_name));
+    memcpy(entry->item_name, log_line.item_name, sizeof(entry->item_name));
+    memcpy(entry->message, log_line.message, sizeof(entry->message));
+
+    __atomic_store_n(&entry->seq, index + 1U, __ATOMIC_RELEASE);
+}
+
+static bool read_log_entry(unsigned index, LogEntry *dst)
+{
+    const LogEntry *entry = &log_ring[index % LOG_RING_SIZE];
+    unsigned seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+    if (seq != index + 1U)
+        return false;
+    memcpy(dst, entry, sizeof(*dst));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static const char *get_log_level_name(int level)
+{
+    switch (level) {
+    case AV_LOG_PANIC:   return "panic";
+    case AV_LOG_FATAL:   return "fatal";
+    case AV_LOG_ERROR:   return "error";
+    case AV_LOG_WARNING: return "warning";
+    case AV_LOG_INFO:    return "info";
+    case AV_LOG_VERBOSE: return "verbose";
+    case AV_LOG_DEBUG:   return "debug";
+    case AV_LOG_TRACE:   return "trace";
+    default:             return "unknown";
+    }
+}
+
+static void draw_log_entry(const LogEntry *entry)
+{
+    ImVec4 color = ImGui::GetStyleColorVec4(ImGuiCol_Text);
+
+    if (entry->level <= AV_LOG_ERROR)
+        color = ImVec4(1.f, 0.4f, 0.4f, 1.f);
+    else if (entry->level <= AV_LOG_WARNING)
+        color = ImVec4(1.f, 0.8f, 0.3f, 1.f);
+    else if (entry->level >= AV_LOG_VERBOSE)
+        color.w *= 0.6f;
+
+    ImGui::PushStyleColor(ImGuiCol_Text, color);
+    if (entry->item_name[0])
+        ImGui::Text("[%9.3f] [%s] [%s @ %s] %s", entry->time / 1000000.,
+                    get_log_level_name(entry->level), entry->class_name, entry->item_name, entry->message);
+    else
+        ImGui::Text("[%9.3f] [%s] %s", entry->time / 1000000.,
+                    get_log_level_name(entry->level), entry->message);
+    ImGui::PopStyleColor();
 }
 
 static void show_log(bool *p_open, bool focused)
 {
     static ImGuiTextFilter filter;
+    static char instance[64] = { 0 };
+    static char filtered_instance[64] = { 0 };
+    static char filtered_text[IM_ARRAYSIZE(filter.InputBuf)] = { 0 };
+    static std::vector<unsigned> filtered;
+    static unsigned filtered_end = 0;
+    const unsigned end = __atomic_load_n(&log_write_index, __ATOMIC_ACQUIRE);
+    unsigned begin = end > LOG_RING_SIZE ? end - LOG_RING_SIZE : 0;
 
     if (focused)
         ImGui::SetNextWindowFocus();
@@ -3183,27 +7857,324 @@ static void show_log(bool *p_open, bool focused)
         return;
     }
 
-    filter.Draw("###Log Filter", ImGui::GetWindowSize().x);
-    if (filter.IsActive()) {
-        for (int line_no = 0; line_no < log_lines_offsets.Size; line_no++) {
-            const char *line_start = log_buffer.begin() + log_lines_offsets[line_no];
-            const char *line_end = (line_no + 1 < log_lines_offsets.Size) ? (log_buffer.begin() + log_lines_offsets[line_no + 1] - 1) : log_buffer.end();
-            if (filter.PassFilter(line_start, line_end))
-                ImGui::TextUnformatted(line_start, line_end);
+    if (ImGui::Button("Clear"))
+        log_clear_index = end;
+    if (log_clear_index > begin)
+        begin = log_clear_index;
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150.f);
+    if (ImGui::BeginCombo("##Log Instance", instance[0] ? instance : "All Filters", 0)) {
+        if (ImGui::Selectable("All Filters", !instance[0]))
+            instance[0] = 0;
+        for (unsigned i = 0; i < filter_nodes.size(); i++) {
+            const char *label = filter_nodes[i].filter_label;
+
+            if (ImGui::Selectable(label, !strcmp(instance, label)))
+                av_strlcpy(instance, label, sizeof(instance));
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    filter.Draw("###Log Filter", ImGui::GetContentRegionAvail().x);
+
+    ImGui::BeginChild("##Log Entries", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+    if (filter.IsActive() || instance[0]) {
+        unsigned first = 0;
+        LogEntry entry;
+
+        /* Only entries written since the last frame are matched, unless the
+         * filter itself changed. Entries that fell out of the ring or were
+         * cleared are dropped from the front. */
+        if (strcmp(filtered_text, filter.InputBuf) || strcmp(filtered_instance, instance)) {
+            av_strlcpy(filtered_text, filter.InputBuf, sizeof(filtered_text));
+            av_strlcpy(filtered_instance, instance, sizeof(filtered_instance));
+            filtered.clear();
+            filtered_end = begin;
+        }
+        while (first < filtered.size() && (int)(filtered[first] - begin) < 0)
+            first++;
+        filtered.erase(filtered.begin(), filtered.begin() + first);
+        if ((int)(filtered_end - begin) < 0)
+            filtered_end = begin;
+
+        for (; filtered_end != end; filtered_end++) {
+            if (!read_log_entry(filtered_end, &entry))
+                break;
+            if (instance[0] && strcmp(entry.item_name, instance))
+                continue;
+            if (!filter.PassFilter(entry.message) && !filter.PassFilter(entry.class_name))
+                continue;
+            filtered.push_back(filtered_end);
+        }
+
+        ImGuiListClipper clipper;
+        clipper.Begin(filtered.size());
+        while (clipper.Step()) {
+            for (int line_no = clipper.DisplayStart; line_no < clipper.DisplayEnd; line_no++) {
+                if (read_log_entry(filtered[line_no], &entry))
+                    draw_log_entry(&entry);
+                else
+                    ImGui::TextUnformatted("...");
+            }
         }
+        clipper.End();
     } else {
-        ImGui::TextUnformatted(log_buffer.begin(), log_buffer.end());
+        ImGuiListClipper clipper;
+        clipper.Begin(end - begin);
+        while (clipper.Step()) {
+            for (int line_no = clipper.DisplayStart; line_no < clipper.DisplayEnd; line_no++) {
+                LogEntry entry;
+
+                if (read_log_entry(begin + line_no, &entry))
+                    draw_log_entry(&entry);
+                else
+                    ImGui::TextUnformatted("...");
+            }
+        }
+        clipper.End();
     }
 
     if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
         ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
 
     ImGui::End();
 }
 
-int main(int, char**)
+static int64_t get_audio_clock()
+{
+    int64_t clock = INT64_MAX;
+
+    for (unsigned i = 0; i < abuffer_sinks.size(); i++) {
+        BufferSink *sink = &abuffer_sinks[i];
+        ALint queued = 0;
+
+        if (sink->pts == AV_NOPTS_VALUE || sink->frame_rate.num <= 0)
+            return AV_NOPTS_VALUE;
+
+        alGetSourcei(sink->source, AL_BUFFERS_QUEUED, &queued);
+        clock = std::min(clock, sink->qpts - av_rescale(queued * (int64_t)sink->frame_nb_samples,
+                                                        AV_TIME_BASE, sink->frame_rate.num));
+    }
+
+    return clock == INT64_MAX ? AV_NOPTS_VALUE : clock;
+}
+
+static void present_sink_frame(BufferSink *sink, std::mutex *mutex, std::condition_variable *cv,
+                               int64_t clock, bool step)
+{
+    const int64_t duration = sink->frame_rate.num > 0 ? av_rescale_q(1, av_inv_q(sink->frame_rate), AV_TIME_BASE_Q) : 0;
+
+    if (sink_wants_frame(sink))
+        request_sink_frame(sink, mutex, cv);
+
+    while (ring_buffer_num_items(&sink->consume_frames) > 0) {
+        AVFrame *next = NULL;
+        int64_t pts;
+
+        ring_buffer_peek(&sink->consume_frames, &next, 0);
+        if (!next->buf[0]) {
+            sink_dequeue_frame(sink, &next);
+            recycle_sink_frame(sink, &next);
+            continue;
+        }
+
+        pts = next->pts == AV_NOPTS_VALUE ? clock : av_rescale_q(next->pts, sink->time_base, AV_TIME_BASE_Q);
+        if (!step && pts > clock)
+            break;
+
+        sink_dequeue_frame(sink, &next);
+        if (!step && ring_buffer_num_items(&sink->consume_frames) > 0) {
+            AVFrame *after = NULL;
+
+            ring_buffer_peek(&sink->consume_frames, &after, 0);
+            if (after->buf[0] && after->pts != AV_NOPTS_VALUE &&
+                av_rescale_q(after->pts, sink->time_base, AV_TIME_BASE_Q) <= clock) {
+                sink->frames_dropped++;
+                recycle_sink_frame(sink, &next);
+                continue;
+            }
+        }
+
+        if (!step && duration > 0 && clock - pts > duration)
+            sink->frames_late++;
+
+        while (ring_buffer_num_items(&sink->render_frames) > 0) {
+            AVFrame *old = NULL;
+
+            ring_buffer_dequeue(&sink->render_frames, &old);
+            if (sink->uploaded_frame == old)
+                sink->uploaded_frame = NULL;
+            recycle_sink_frame(sink, &old);
+        }
+        if (ring_buffer_enqueue(&sink->render_frames, next) < 0)
+            recycle_sink_frame(sink, &next);
+        break;
+    }
+}
+
+static void get_process_usage(double *cpu_time, int64_t *peak_memory)
+{
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    PROCESS_MEMORY_COUNTERS counters;
+
+    *cpu_time = 0.;
+    *peak_memory = 0;
+    if (GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        const uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+        const uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+
+        *cpu_time = (kernel + user) / 10000000.;
+    }
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        *peak_memory = counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    *cpu_time = 0.;
+    *peak_memory = 0;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return;
+    *cpu_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000. +
+                usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.;
+#ifdef __APPLE__
+    *peak_memory = usage.ru_maxrss;
+#else
+    *peak_memory = usage.ru_maxrss * 1024LL;
+#endif
+#endif
+}
+
+static int64_t get_percentile(std::vector<int64_t> &values, int percentile)
+{
+    if (values.size() == 0)
+        return 0;
+
+    return values[(values.size() - 1) * percentile / 100];
+}
+
+static int run_headless(const char *script_file_name, int64_t max_frames)
+{
+    std::vector<BufferSink *> sinks;
+    std::vector<AVFilterContext *> sink_ctxs;
+    std::vector<std::vector<int64_t>> latencies;
+    std::vector<int64_t> durations;
+    std::vector<int64_t> frames;
+    int64_t start, end, peak_memory;
+    double cpu_time;
+    int ret;
+
+    import_filter_graph(script_file_name);
+    if (filter_nodes.size() == 0) {
+        av_log(NULL, AV_LOG_ERROR, "No filters loaded from '%s'.\n", script_file_name);
+        return 1;
+    }
+
+    ret = filters_setup();
+    if (ret < 0 || !filter_graph_is_valid)
+        return 1;
+
+    for (unsigned i = 0; i < buffer_sinks.size(); i++)
+        sinks.push_back(&buffer_sinks[i]);
+    for (unsigned i = 0; i < abuffer_sinks.size(); i++)
+        sinks.push_back(&abuffer_sinks[i]);
+    for (unsigned i = 0; i < sinks.size(); i++)
+        sink_ctxs.push_back(sinks[i]->ctx);
+
+    start = av_gettime_relative();
+    ret = pull_sink_frames(filter_graph, sink_ctxs, max_frames, 0, latencies, frames, durations);
+    end = av_gettime_relative();
+    get_process_usage(&cpu_time, &peak_memory);
+
+    printf("{\n");
+    printf("  \"script\": \"");
+    for (const char *c = script_file_name; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            putchar('\\');
+        putchar(*c);
+    }
+    printf("\",\n");
+    printf("  \"threads\": %d,\n", filter_graph_nb_threads);
+    printf("  \"auto_convert\": %d,\n", filter_graph_auto_convert_flags);
+    printf("  \"wall_time\": %.6f,\n", (end - start) / 1000000.);
+    printf("  \"cpu_time\": %.6f,\n", cpu_time);
+    printf("  \"peak_memory\": %ld,\n", peak_memory);
+    printf("  \"sinks\": [\n");
+    for (unsigned i = 0; i < sinks.size(); i++) {
+        const bool audio = i >= buffer_sinks.size();
+
+        std::sort(latencies[i].begin(), latencies[i].end());
+
+        printf("    {\n");
+        printf("      \"name\": \"%s\",\n", sinks[i]->label);
+        printf("      \"type\": \"%s\",\n", audio ? "audio" : "video");
+        printf("      \"frames\": %ld,\n", frames[i]);
+        printf("      \"fps\": %.3f,\n", durations[i] > 0 ? frames[i] * 1000000. / durations[i] : 0.);
+        printf("      \"latency_us\": { \"p50\": %ld, \"p95\": %ld, \"p99\": %ld }\n",
+               get_percentile(latencies[i], 50), get_percentile(latencies[i], 95), get_percentile(latencies[i], 99));
+        printf("    }%s\n", i + 1 < sinks.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    kill_audio_sink_threads();
+    kill_video_sink_threads();
+
+    for (unsigned i = 0; i < filter_nodes.size(); i++) {
+        FilterNode *node = &filter_nodes[i];
+
+        av_freep(&node->filter_name);
+        av_freep(&node->filter_label);
+        av_freep(&node->filter_options);
+        av_freep(&node->ctx_options);
+        avfilter_free(node->probe);
+        node->probe = NULL;
+        node->ctx = NULL;
+    }
+    filter_nodes.clear();
+
+    av_freep(&graphdump_text);
+    avfilter_graph_free(&filter_graph);
+    delete profile_counters;
+    profile_counters = NULL;
+    avfilter_graph_free(&probe_graph);
+    av_buffer_unref(&hw_device_ctx);
+
+    return ret < 0;
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-headless script] [-frames N] [-threads N] [-auto_convert N]\n", program);
+}
+
+int main(int argc, char **argv)
 {
-    ALCint attribs[] = { ALC_FREQUENCY, output_sample_rate, 0, 0 };
+    const char *headless_script = NULL;
+    int64_t headless_frames = 0;
+
+    trace_set_thread_name("main");
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-headless") && i + 1 < argc) {
+            headless_script = argv[++i];
+        } else if (!strcmp(argv[i], "-frames") && i + 1 < argc) {
+            headless_frames = strtoll(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+            filter_graph_nb_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-auto_convert") && i + 1 < argc) {
+            filter_graph_auto_convert_flags = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (headless_script) {
+        headless = true;
+        return run_headless(headless_script, headless_frames);
+    }
 
     al_dev = alcOpenDevice(NULL);
     if (!al_dev) {
@@ -3211,8 +8182,10 @@ int main(int, char**)
         return -1;
     }
 
-    al_ctx = alcCreateContext(al_dev, attribs);
+    al_ctx = alcCreateContext(al_dev, NULL);
     alcMakeContextCurrent(al_ctx);
+    alcGetIntegerv(al_dev, ALC_FREQUENCY, 1, &output_sample_rate);
+    al_multichannel_formats = alIsExtensionPresent("AL_EXT_MCFORMATS");
     alListenerfv(AL_POSITION, listener_position);
     alListenerfv(AL_ORIENTATION, listener_direction);
 
@@ -3244,6 +8217,7 @@ restart_window:
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
     glfwSwapInterval(1); // Enable vsync
 
+    log_start_time = av_gettime_relative();
     av_log_set_callback(log_callback);
 
     // Setup Dear ImGui context
@@ -3289,33 +8263,48 @@ restart_window:
         int64_t min_aqpts = INT64_MAX;
         int64_t min_qpts = INT64_MAX;
 
-        glfwPollEvents();
+        if (idle_frames <= 0 && can_idle()) {
+            const int64_t trace_start = trace_begin();
+
+            glfwWaitEventsTimeout(0.5);
+            trace_end("idle wait", trace_start, NULL);
+            idle_frames = 3;
+        } else {
+            glfwPollEvents();
+        }
+        if (idle_frames > 0)
+            idle_frames--;
 
         if (show_abuffersink_window == false) {
             if (audio_sink_threads.size() > 0) {
-                need_filters_reinit = true;
+                sink_threads_stop = true;
 
-                if (play_sound_thread.joinable())
-                    play_sound_thread.join();
+                stop_sound_thread();
                 play_sources.clear();
 
                 kill_audio_sink_threads();
 
                 audio_sink_threads.clear();
 
-                need_filters_reinit = false;
+                sink_threads_stop = false;
+
+                if (graph_driver_active)
+                    start_graph_driver_thread();
             }
         }
 
         if (show_buffersink_window == false) {
             if (video_sink_threads.size() > 0) {
-                need_filters_reinit = true;
+                sink_threads_stop = true;
 
                 kill_video_sink_threads();
 
                 video_sink_threads.clear();
 
-                need_filters_reinit = false;
+                sink_threads_stop = false;
+
+                if (graph_driver_active)
+                    start_graph_driver_thread();
             }
         }
 
@@ -3324,7 +8313,7 @@ restart_window:
             av_freep(&import_script_file_name);
         }
 
-        filters_setup();
+        update_graph_build();
 
         if (filter_graph_is_valid) {
             for (unsigned i = 0; i < buffer_sinks.size(); i++) {
@@ -3352,10 +8341,37 @@ restart_window:
             }
         }
 
+        const int64_t video_qpts = min_qpts;
+
         min_qpts = std::min(min_qpts, min_aqpts);
         min_aqpts = min_qpts;
 
-        if (filter_graph_is_valid) {
+        if (filter_graph_is_valid && present_by_clock) {
+            const bool step = paused && framestep;
+            int64_t clock = abuffer_sinks.size() > 0 ? get_audio_clock() : AV_NOPTS_VALUE;
+
+            if (!paused && !clock_running)
+                clock_offset = av_gettime_relative() - (video_qpts == AV_NOPTS_VALUE || video_qpts == INT64_MAX ? 0 : video_qpts);
+            clock_running = !paused;
+            if (clock == AV_NOPTS_VALUE)
+                clock = av_gettime_relative() - clock_offset;
+
+            for (unsigned i = 0; i < buffer_sinks.size(); i++) {
+                BufferSink *sink = &buffer_sinks[i];
+
+                if (paused && !step) {
+                    if (ring_buffer_num_items(&sink->render_frames) == 0 && sink_wants_frame(sink))
+                        request_sink_frame(sink, &mutexes[i], &cv[i]);
+                    if (ring_buffer_num_items(&sink->render_frames) > 0)
+                        continue;
+                }
+
+                present_sink_frame(sink, &mutexes[i], &cv[i], clock,
+                                   step || ring_buffer_num_items(&sink->render_frames) == 0);
+                if (sink->qpts != AV_NOPTS_VALUE)
+                    sink->drift = sink->qpts - clock;
+            }
+        } else if (filter_graph_is_valid) {
             for (unsigned i = 0; i < buffer_sinks.size(); i++) {
                 BufferSink *sink = &buffer_sinks[i];
                 AVFrame *render_frame = NULL;
@@ -3366,12 +8382,12 @@ restart_window:
                 if (sink->qpts > min_qpts)
                     continue;
 
-                { std::lock_guard lk(mutexes[i]); sink->ready = true; }
-                cv[i].notify_one();
-                ring_buffer_dequeue(&sink->consume_frames, &render_frame);
+                request_sink_frame(sink, &mutexes[i], &cv[i]);
+                sink_dequeue_frame(sink, &render_frame);
                 if (!render_frame)
                     continue;
-                ring_buffer_enqueue(&sink->render_frames, render_frame);
+                if (ring_buffer_enqueue(&sink->render_frames, render_frame) < 0)
+                    recycle_sink_frame(sink, &render_frame);
             }
         }
 
@@ -3384,10 +8400,10 @@ restart_window:
                     ALint queued = 0;
 
                     alGetSourcei(sink->source, AL_BUFFERS_QUEUED, &queued);
-                    if (queued > AL_BUFFERS / 2)
+                    if (queued > sink->queue_target)
                         continue;
 
-                    if (queued < AL_BUFFERS / 2)
+                    if (queued < sink->queue_target)
                         goto dequeue_consume_frames;
 
                     if (ring_buffer_num_items(&sink->render_frames) > sink->render_ring_size - 1)
@@ -3398,12 +8414,15 @@ restart_window:
                 }
 
 dequeue_consume_frames:
-                { std::lock_guard lk(amutexes[i]); sink->ready = true; }
-                acv[i].notify_one();
-                ring_buffer_dequeue(&sink->consume_frames, &render_frame);
+                if (ring_buffer_is_full(&sink->render_frames))
+                    continue;
+
+                request_sink_frame(sink, &amutexes[i], &acv[i]);
+                sink_dequeue_frame(sink, &render_frame);
                 if (!render_frame)
                     continue;
-                ring_buffer_enqueue(&sink->render_frames, render_frame);
+                if (ring_buffer_enqueue(&sink->render_frames, render_frame) < 0)
+                    recycle_sink_frame(sink, &render_frame);
             }
         }
 
@@ -3414,24 +8433,27 @@ dequeue_consume_frames:
 
                 ring_buffer_peek(&sink->render_frames, &play_frame, 0);
                 if (play_frame) {
-                    const float *src = (const float *)play_frame->extended_data[0];
-
-                    if (src && play_frame->nb_samples > 0) {
-                        float min = FLT_MAX, max = -FLT_MAX;
-
-                        for (int n = 0; n < play_frame->nb_samples; n++) {
-                            max = std::max(max, src[n]);
-                            min = std::min(min, src[n]);
-                        }
+                    const AudioAnalysis *analysis = play_frame->opaque_ref ? (const AudioAnalysis *)play_frame->opaque_ref->data : NULL;
 
+                    if (play_frame->nb_samples > 0) {
                         sink->frame_number++;
                         sink->pts = play_frame->pts;
                         sink->pos = play_frame->pkt_pos;
                         sink->frame_nb_samples = play_frame->nb_samples;
-                        sink->samples[sink->sample_index++] = max;
-                        sink->samples[sink->sample_index++] = min;
+                    }
+
+                    if (analysis && play_frame->nb_samples > 0) {
+                        sink->samples[sink->sample_index++] = analysis->max;
+                        sink->samples[sink->sample_index++] = analysis->min;
                         if (sink->sample_index >= sink->nb_samples)
                             sink->sample_index = 0;
+                        sink->nb_channels = analysis->nb_channels;
+                        memcpy(sink->peak, analysis->peak, sizeof(sink->peak));
+                        memcpy(sink->rms, analysis->rms, sizeof(sink->rms));
+                        if (analysis->have_spectrum && sink->spectrum) {
+                            memcpy(sink->spectrum, analysis->spectrum, sizeof(analysis->spectrum));
+                            sink->new_spectrum = true;
+                        }
                     }
 
                     queue_sound(play_frame, sink);
@@ -3444,7 +8466,9 @@ dequeue_consume_frames:
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        if (filter_graph_is_valid && show_buffersink_window == true) {
+        if (filter_graph_is_valid && show_buffersink_window == true && grid_presentation) {
+            draw_grid(&show_buffersink_window);
+        } else if (filter_graph_is_valid && show_buffersink_window == true) {
             for (unsigned i = 0; i < buffer_sinks.size(); i++) {
                 BufferSink *sink = &buffer_sinks[i];
                 AVFrame *render_frame = NULL;
@@ -3480,6 +8504,26 @@ dequeue_consume_frames:
             show_log_window = true;
         if (show_log_window)
             show_log(&show_log_window, focused);
+        focused = ImGui::IsKeyReleased(ImGuiKey_F6);
+        if (focused)
+            show_profile_window = true;
+        if (show_profile_window)
+            show_profile(&show_profile_window, focused);
+        focused = ImGui::IsKeyReleased(ImGuiKey_F8);
+        if (focused)
+            show_memory_window = true;
+        if (show_memory_window)
+            show_memory(&show_memory_window, focused);
+        focused = ImGui::IsKeyReleased(ImGuiKey_F9);
+        if (focused)
+            show_compare_window = true;
+        if (show_compare_window)
+            show_compare(&show_compare_window, focused);
+        focused = ImGui::IsKeyReleased(ImGuiKey_F7);
+        if (focused)
+            show_render_window = true;
+        if (show_render_window)
+            show_render(&show_render_window, focused);
         focused = ImGui::IsKeyReleased(ImGuiKey_F2);
         if (focused)
             show_filtergraph_editor_window = true;
@@ -3496,20 +8540,33 @@ dequeue_consume_frames:
             draw_console(&show_console);
 
         // Rendering
+        int64_t trace_start = trace_begin();
         ImGui::Render();
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
         glClear(GL_COLOR_BUFFER_BIT);
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        trace_end("ui render", trace_start, NULL);
 
+        trace_start = trace_begin();
         glfwSwapBuffers(window);
+        trace_end("swap buffers", trace_start, NULL);
+
+        update_playback_state();
+        update_render_state();
+        update_frame_memory();
+        update_tap_previews();
+        update_autotune();
 
         if (filter_graph_is_valid) {
             for (unsigned i = 0; i < buffer_sinks.size(); i++) {
                 BufferSink *sink = &buffer_sinks[i];
                 AVFrame *purge_frame = NULL;
 
+                if (present_by_clock)
+                    break;
+
                 if (paused && !framestep)
                     continue;
 
@@ -3522,9 +8579,9 @@ dequeue_consume_frames:
                 ring_buffer_dequeue(&sink->render_frames, &purge_frame);
                 if (!purge_frame)
                     continue;
-                ring_buffer_enqueue(&sink->purge_frames, purge_frame);
-
-                clear_ring_buffer(&sink->purge_frames);
+                if (sink->uploaded_frame == purge_frame)
+                    sink->uploaded_frame = NULL;
+                recycle_sink_frame(sink, &purge_frame);
             }
         }
 
@@ -3537,13 +8594,13 @@ dequeue_consume_frames:
                     ALint queued = 0;
 
                     alGetSourcei(sink->source, AL_BUFFERS_QUEUED, &queued);
-                    if (queued > AL_BUFFERS / 2)
+                    if (queued > sink->queue_target)
                         continue;
 
                     if (paused && !framestep)
                         continue;
 
-                    if (queued < AL_BUFFERS / 2)
+                    if (queued < sink->queue_target)
                         goto dequeue_render_frames;
 
                     if (sink->qpts > min_aqpts)
@@ -3557,9 +8614,7 @@ dequeue_render_frames:
                 ring_buffer_dequeue(&sink->render_frames, &purge_frame);
                 if (!purge_frame)
                     continue;
-                ring_buffer_enqueue(&sink->purge_frames, purge_frame);
-
-                clear_ring_buffer(&sink->purge_frames);
+                recycle_sink_frame(sink, &purge_frame);
             }
         }
 
@@ -3569,12 +8624,16 @@ dequeue_render_frames:
 
     need_filters_reinit = true;
 
-    if (play_sound_thread.joinable())
-        play_sound_thread.join();
+    stop_graph_build();
+    stop_render();
+    stop_autotune();
+    stop_sound_thread();
     play_sources.clear();
 
+    sink_threads_stop = true;
     kill_audio_sink_threads();
     kill_video_sink_threads();
+    sink_threads_stop = false;
 
     video_sink_threads.clear();
     audio_sink_threads.clear();
@@ -3595,11 +8654,25 @@ dequeue_render_frames:
 
     av_freep(&graphdump_text);
 
+    free_tap_previews();
     avfilter_graph_free(&filter_graph);
+    delete profile_counters;
+    profile_counters = NULL;
     avfilter_graph_free(&probe_graph);
+    free_trace_buffers();
 
     filter_links.clear();
 
+    av_buffer_unref(&hw_device_ctx);
+
+    glDeleteProgram(yuv2rgb_program);
+    yuv2rgb_program = 0;
+    free_compare();
+    free_grid();
+    free_scope_programs();
+    glDeleteVertexArrays(1, &empty_vao);
+    empty_vao = 0;
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImNodes::EditorContextFree(node_editor_context);
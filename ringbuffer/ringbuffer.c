@@ -1,61 +1,98 @@
 #include <stdint.h>
+#include <libavutil/error.h>
 #include <libavutil/frame.h>
+#include <libavutil/mem.h>
 
-#define RING_BUFFER_SIZE 8U
-
-#define RING_BUFFER_MASK (RING_BUFFER_SIZE-1)
-
+/* single producer writes head_index, single consumer writes tail_index */
 typedef struct ring_buffer_t {
-    AVFrame *buffer[RING_BUFFER_SIZE];
+    AVFrame **buffer;
+    unsigned capacity;
+    unsigned mask;
     unsigned tail_index;
     unsigned head_index;
 } ring_buffer_t;
 
-static void ring_buffer_init(ring_buffer_t *buffer)
+static int ring_buffer_init(ring_buffer_t *buffer, unsigned capacity)
 {
+    unsigned size = 1;
+
+    while (size < capacity)
+        size <<= 1;
+
     buffer->tail_index = 0;
     buffer->head_index = 0;
+    buffer->capacity = 0;
+    buffer->mask = 0;
+    buffer->buffer = (AVFrame **)av_calloc(size, sizeof(*buffer->buffer));
+    if (!buffer->buffer)
+        return AVERROR(ENOMEM);
+    buffer->capacity = size;
+    buffer->mask = size - 1;
+
+    return 0;
+}
+
+static void ring_buffer_free(ring_buffer_t *buffer)
+{
+    av_freep(&buffer->buffer);
+    buffer->capacity = 0;
+    buffer->mask = 0;
+    buffer->tail_index = 0;
+    buffer->head_index = 0;
+}
+
+static inline unsigned ring_buffer_num_items(ring_buffer_t *buffer)
+{
+    const unsigned head = __atomic_load_n(&buffer->head_index, __ATOMIC_ACQUIRE);
+    const unsigned tail = __atomic_load_n(&buffer->tail_index, __ATOMIC_ACQUIRE);
+
+    return head - tail;
 }
 
 static inline int ring_buffer_is_empty(ring_buffer_t *buffer)
 {
-    return buffer->head_index == buffer->tail_index;
+    return ring_buffer_num_items(buffer) == 0;
 }
 
 static inline int ring_buffer_is_full(ring_buffer_t *buffer)
 {
-    return ((buffer->head_index - buffer->tail_index) & RING_BUFFER_MASK) == RING_BUFFER_MASK;
+    return ring_buffer_num_items(buffer) >= buffer->capacity;
 }
 
-static void ring_buffer_enqueue(ring_buffer_t *buffer, AVFrame *data)
+static int ring_buffer_enqueue(ring_buffer_t *buffer, AVFrame *data)
 {
-    buffer->buffer[buffer->head_index] = data;
-    buffer->head_index = ((buffer->head_index + 1U) & RING_BUFFER_MASK);
+    const unsigned head = __atomic_load_n(&buffer->head_index, __ATOMIC_RELAXED);
+    const unsigned tail = __atomic_load_n(&buffer->tail_index, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= buffer->capacity)
+        return AVERROR(ENOSPC);
+
+    buffer->buffer[head & buffer->mask] = data;
+    __atomic_store_n(&buffer->head_index, head + 1U, __ATOMIC_RELEASE);
+
+    return 0;
 }
 
 static void ring_buffer_dequeue(ring_buffer_t *buffer, AVFrame **data)
 {
-    if (!ring_buffer_is_empty(buffer)) {
-        *data = buffer->buffer[buffer->tail_index];
-        buffer->buffer[buffer->tail_index] = NULL;
-        buffer->tail_index = ((buffer->tail_index + 1U) & RING_BUFFER_MASK);
+    const unsigned tail = __atomic_load_n(&buffer->tail_index, __ATOMIC_RELAXED);
+    const unsigned head = __atomic_load_n(&buffer->head_index, __ATOMIC_ACQUIRE);
+
+    if (head != tail) {
+        *data = buffer->buffer[tail & buffer->mask];
+        buffer->buffer[tail & buffer->mask] = NULL;
+        __atomic_store_n(&buffer->tail_index, tail + 1U, __ATOMIC_RELEASE);
     }
 }
 
 static void ring_buffer_peek(ring_buffer_t *buffer, AVFrame **data, unsigned index)
 {
-    unsigned max = (buffer->head_index - buffer->tail_index) & RING_BUFFER_MASK;
+    const unsigned tail = __atomic_load_n(&buffer->tail_index, __ATOMIC_RELAXED);
+    const unsigned head = __atomic_load_n(&buffer->head_index, __ATOMIC_ACQUIRE);
+    const unsigned max = head - tail;
+
     if (max > 0) {
-        unsigned data_index = (buffer->tail_index + std::min(index, max - 1)) & RING_BUFFER_MASK;
+        unsigned data_index = (tail + (index < max - 1 ? index : max - 1)) & buffer->mask;
         *data = buffer->buffer[data_index];
     }
 }
-
-static inline unsigned ring_buffer_num_items(ring_buffer_t *buffer)
-{
-    unsigned ret;
-
-    ret = (buffer->head_index - buffer->tail_index) & RING_BUFFER_MASK;
-
-    return ret;
-}